@@ -1,8 +1,8 @@
-uniform vec4 color;
 uniform vec4 outline_color;
 uniform sampler2D sampler;
 
 in vec2 tex_coord_out;
+in vec4 color;
 out vec4 color_out;
 
 // Colour cutoffs, corresponding to "dist" below.
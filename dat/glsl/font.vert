@@ -2,9 +2,12 @@ uniform mat4 projection;
 
 in vec4 vertex;
 in vec2 tex_coord;
+in vec4 vertex_color;
 out vec2 tex_coord_out;
+out vec4 color;
 
 void main(void) {
    tex_coord_out = tex_coord;
+   color = vertex_color;
    gl_Position = projection * vertex;
 }
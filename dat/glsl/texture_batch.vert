@@ -0,0 +1,16 @@
+uniform mat4 projection;
+
+in vec4 vertex;
+in vec2 vertex_tex;
+in vec4 vertex_color;
+in float vertex_inter;
+out vec2 tex_coord;
+out vec4 color;
+out float inter;
+
+void main(void) {
+   tex_coord   = vertex_tex;
+   color       = vertex_color;
+   inter       = vertex_inter;
+   gl_Position = projection * vertex;
+}
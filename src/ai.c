@@ -76,6 +76,7 @@
 
 #include "array.h"
 #include "board.h"
+#include "conf.h"
 #include "escort.h"
 #include "faction.h"
 #include "hook.h"
@@ -630,6 +631,7 @@ static int ai_loadProfile( const char* filename )
 {
    char* buf = NULL;
    size_t bufsize = 0;
+   char envname[STRMAX_SHORT];
    nlua_env env;
    AI_Profile *prof;
    size_t len;
@@ -648,6 +650,8 @@ static int ai_loadProfile( const char* filename )
    env = nlua_newEnv(1);
    nlua_loadStandard(env);
    prof->env = env;
+   snprintf( envname, sizeof(envname), "ai/%s", prof->name );
+   nlua_nameEnv( env, envname );
 
    /* Register C functions in Lua */
    nlua_register(env, "ai", aiL_methods, 0);
@@ -782,8 +786,10 @@ void ai_think( Pilot* pilot, const double dt )
          ai_run(env, 0); /* run control */
       }
 
+      /* Spread the ticks so pilots created together don't all run control together. */
       nlua_getenv(env, "control_rate");
-      cur_pilot->tcontrol = lua_tonumber(naevL,-1);
+      cur_pilot->tcontrol = lua_tonumber(naevL,-1) *
+            (1. + AI_CONTROL_SPREAD * (ai_jitter(cur_pilot) - 0.5));
       lua_pop(naevL,1);
 
       /* Task may have changed due to control tick. */
@@ -846,6 +852,63 @@ void ai_think( Pilot* pilot, const double dt )
 }
 
 
+/**
+ * @brief Gets how long a pilot can go without thinking.
+ *
+ * Pilots far from the player think less often and hold their thrust and turn
+ *  in between. Pilots the player interacts with, escorts and pilots under
+ *  manual control always think every update. While simulating a system on
+ *  entry, pilots think once per simulation step, but never hold their controls
+ *  longer than AI_LOD_FAR_INTERVAL.
+ *
+ *    @param p Pilot to check.
+ *    @return Seconds until the pilot has to think again, 0. to think every update.
+ */
+double ai_thinkInterval( const Pilot *p )
+{
+   double d;
+
+   if (space_isSimulation())
+      return MIN( conf.simulate_dt, AI_LOD_FAR_INTERVAL );
+
+   if (!conf.ai_lod || (player.p == NULL) || (p == player.p))
+      return 0.;
+
+   /* Important pilots. */
+   if (pilot_isFlag(p, PILOT_MANUAL_CONTROL) ||
+         (p->parent == PLAYER_ID) ||
+         (p->target == PLAYER_ID) ||
+         (player.p->target == p->id))
+      return 0.;
+
+   d = vect_dist2( &p->solid->pos, &player.p->solid->pos );
+   if (d < pow2(AI_LOD_NEAR))
+      return 0.;
+   else if (d < pow2(AI_LOD_FAR))
+      return AI_LOD_MID_INTERVAL;
+   return AI_LOD_FAR_INTERVAL;
+}
+
+
+/**
+ * @brief Gets the next value of a pilot's jitter sequence.
+ *
+ * Used to spread out the AI ticks of pilots without touching the random number
+ *  generator, so it doesn't change the random stream of the game. Each pilot
+ *  starts at a different point of the sequence based on its ID and the values
+ *  are well spread over [0,1).
+ *
+ *    @param p Pilot to get the jitter of.
+ *    @return Jitter in [0,1).
+ */
+double ai_jitter( Pilot *p )
+{
+   double x;
+   x = (double)(p->id + p->njitter++) * AI_JITTER_STEP;
+   return x - floor(x);
+}
+
+
 /**
  * @brief Triggers the attacked() function in the pilot's AI.
  *
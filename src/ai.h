@@ -28,6 +28,15 @@ typedef struct Pilot_ Pilot;
 #define MAX_AI_TIMERS   2 /**< Max amount of AI timers. */
 
 
+/* level of detail */
+#define AI_LOD_NEAR           5000. /**< Distance to the player under which pilots think every update. */
+#define AI_LOD_FAR            15000. /**< Distance to the player over which pilots think least often. */
+#define AI_LOD_MID_INTERVAL   0.1 /**< Seconds between thinks between AI_LOD_NEAR and AI_LOD_FAR. */
+#define AI_LOD_FAR_INTERVAL   0.25 /**< Seconds between thinks past AI_LOD_FAR. */
+#define AI_CONTROL_SPREAD     0.5 /**< Spread of the control rate, as a fraction of it. */
+#define AI_JITTER_STEP        0.6180339887498949 /**< Golden ratio conjugate, steps the per pilot jitter sequence. */
+
+
 /**
  * @struct Task
  *
@@ -93,6 +102,8 @@ void ai_attacked( Pilot* attacked, const unsigned int attacker, double dmg );
 void ai_refuel( Pilot* refueler, unsigned int target );
 void ai_getDistress( Pilot *p, const Pilot *distressed, const Pilot *attacker );
 void ai_think( Pilot* pilot, const double dt );
+double ai_thinkInterval( const Pilot *p );
+double ai_jitter( Pilot *p );
 void ai_setPilot( Pilot *p );
 
 
@@ -0,0 +1,305 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+/**
+ * @file bench.c
+ *
+ * @brief Benchmarks the simulation core.
+ *
+ * Enters a system, lets the usual spawn scripts populate it and then runs a
+ *  fixed number of fixed time step updates without rendering, timing each
+ *  subsystem. A minimal player is created so the player dependent code, such
+ *  as the hooks, runs as in the game. The results are written as JSON to a
+ *  file, or stdout if none is given. Optionally a number of bolts is kept in
+ *  flight to stress the weapon code.
+ */
+
+
+/** @cond */
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include "SDL.h"
+
+#include "naev.h"
+/** @endcond */
+
+#include "bench.h"
+
+#include "array.h"
+#include "hook.h"
+#include "log.h"
+#include "ntime.h"
+#include "pilot.h"
+#include "player.h"
+#include "rng.h"
+#include "space.h"
+#include "spfx.h"
+#include "start.h"
+#include "weapon.h"
+
+
+/**
+ * @brief Subsystems timed by the benchmark.
+ */
+typedef enum BenchSubsystem_ {
+   BENCH_SPACE,   /**< space_update() */
+   BENCH_WEAPONS, /**< weapons_update() */
+   BENCH_SPFX,    /**< spfx_update() */
+   BENCH_PILOTS,  /**< pilots_update() */
+   BENCH_HOOKS,   /**< hooks_update() and the "update" hooks. */
+   BENCH_MAX      /**< Sentinel. */
+} BenchSubsystem;
+
+
+/**
+ * @brief Timing of a subsystem.
+ */
+typedef struct BenchTiming_ {
+   const char *name; /**< Name reported. */
+   Uint64 total; /**< Total performance counter ticks. */
+   Uint64 max; /**< Longest update in performance counter ticks. */
+} BenchTiming;
+
+
+/*
+ * Prototypes.
+ */
+static void bench_add( BenchTiming *t, Uint64 start, Uint64 end );
+static int bench_player (void);
+static int bench_fire( int bolts );
+static void bench_printString( FILE *f, const char *str );
+static void bench_printTiming( FILE *f, const BenchTiming *t, int ticks, double freq, int last );
+
+
+/**
+ * @brief Adds an update to a timing.
+ */
+static void bench_add( BenchTiming *t, Uint64 start, Uint64 end )
+{
+   Uint64 d = end - start;
+   t->total += d;
+   t->max    = MAX( t->max, d );
+}
+
+
+/**
+ * @brief Creates a minimal player for the benchmark.
+ *
+ * The player gets the starting ship at the centre of the system and can't be
+ *  hit, so it stays around for the whole benchmark.
+ *
+ *    @return 0 on success.
+ */
+static int bench_player (void)
+{
+   Ship *ship;
+
+   ship = ship_get( start_ship() );
+   if (ship == NULL) {
+      WARN(_("Unable to benchmark: starting ship not found!"));
+      return -1;
+   }
+
+   ntime_set( start_date() );
+   if (player_newShip( ship, "Bench", 0, 1 ) == NULL)
+      return -1;
+   pilot_setFlag( player.p, PILOT_INVINCIBLE );
+   return 0;
+}
+
+
+/**
+ * @brief Fires bolts from the pilots in the system until enough are in flight.
+ *
+ * Pilots take turns firing their first bolt weapon in a random direction.
+ *
+ *    @param bolts Number of weapons to have in flight.
+ *    @return Number of weapons fired.
+ */
+static int bench_fire( int bolts )
+{
+   static int next = 0;
+   int j, n, fired, misses;
+   Pilot *p;
+   const PilotOutfitSlot *slot;
+   Pilot *const* pilots = pilot_getAll();
+
+   n      = array_size( pilots );
+   fired  = 0;
+   misses = 0;
+   /* Stops after a full round without anyone able to fire. */
+   while ((weapon_count() < bolts) && (misses < n)) {
+      p    = pilots[ next++ % n ];
+      slot = NULL;
+      for (j=0; j<array_size(p->outfit_weapon); j++) {
+         if ((p->outfit_weapon[j].outfit != NULL) &&
+               outfit_isBolt(p->outfit_weapon[j].outfit)) {
+            slot = &p->outfit_weapon[j];
+            break;
+         }
+      }
+      if (slot == NULL) {
+         misses++;
+         continue;
+      }
+      misses = 0;
+
+      weapon_add( slot->outfit, slot->heat_T, RNGF() * 2.*M_PI,
+            &p->solid->pos, &p->solid->vel, p, p->target, 0. );
+      fired++;
+   }
+   return fired;
+}
+
+
+/**
+ * @brief Prints a quoted JSON string.
+ */
+static void bench_printString( FILE *f, const char *str )
+{
+   fputc( '"', f );
+   for (; *str != '\0'; str++) {
+      if ((*str == '"') || (*str == '\\'))
+         fputc( '\\', f );
+      fputc( *str, f );
+   }
+   fputc( '"', f );
+}
+
+
+/**
+ * @brief Prints the timing of a subsystem as a JSON member.
+ */
+static void bench_printTiming( FILE *f, const BenchTiming *t, int ticks, double freq, int last )
+{
+   fprintf( f, "    \"%s\": { \"total_ms\": %.3f, \"mean_us\": %.3f, \"max_us\": %.3f }%s\n",
+         t->name,
+         1e3 * (double)t->total / freq,
+         1e6 * (double)t->total / freq / (double)MAX(ticks,1),
+         1e6 * (double)t->max / freq,
+         last ? "" : "," );
+}
+
+
+/**
+ * @brief Runs the simulation benchmark.
+ *
+ * The data must already be loaded. The random number generator is seeded with
+ *  BENCH_SEED so runs are comparable.
+ *
+ *    @param sysname Name of the system to benchmark in.
+ *    @param ticks Number of updates to run.
+ *    @param bolts Number of bolts to keep in flight, 0 to not fire any.
+ *    @param out File to write the results to, NULL for stdout.
+ *    @return 0 on success.
+ */
+int bench_run( const char *sysname, int ticks, int bolts, const char *out )
+{
+   int i, fired;
+   double freq, dt;
+   Uint64 t0, t1, init;
+   BenchTiming timings[BENCH_MAX];
+   HookParam h[3];
+   FILE *f;
+
+   if (system_get( sysname ) == NULL) {
+      WARN(_("Unable to benchmark system '%s': system not found!"), sysname);
+      return -1;
+   }
+
+   memset( timings, 0, sizeof(timings) );
+   timings[BENCH_SPACE].name   = "space_update";
+   timings[BENCH_WEAPONS].name = "weapons_update";
+   timings[BENCH_SPFX].name    = "spfx_update";
+   timings[BENCH_PILOTS].name  = "pilots_update";
+   timings[BENCH_HOOKS].name   = "hooks";
+   freq = (double) SDL_GetPerformanceFrequency();
+   dt   = BENCH_DT;
+
+   if (bench_player())
+      return -1;
+
+   rng_initSeed( BENCH_SEED );
+
+   /* Entering the system spawns and settles its population. */
+   t0   = SDL_GetPerformanceCounter();
+   space_init( sysname );
+   init = SDL_GetPerformanceCounter() - t0;
+
+   /* No GUI to show messages in, space_init() turns them back on. */
+   player_messageToggle( 0 );
+
+   h[0].type  = HOOK_PARAM_NUMBER;
+   h[0].u.num = dt;
+   h[1].type  = HOOK_PARAM_NUMBER;
+   h[1].u.num = dt;
+   h[2].type  = HOOK_PARAM_SENTINEL;
+
+   /* Same order as update_routine(). */
+   fired = 0;
+   for (i=0; i<ticks; i++) {
+      ntime_update( dt );
+
+      if (bolts > 0)
+         fired += bench_fire( bolts );
+
+      t0 = SDL_GetPerformanceCounter();
+      space_update( dt );
+      t1 = SDL_GetPerformanceCounter();
+      bench_add( &timings[BENCH_SPACE], t0, t1 );
+
+      weapons_update( dt );
+      t0 = SDL_GetPerformanceCounter();
+      bench_add( &timings[BENCH_WEAPONS], t1, t0 );
+
+      spfx_update( dt, dt );
+      t1 = SDL_GetPerformanceCounter();
+      bench_add( &timings[BENCH_SPFX], t0, t1 );
+
+      pilots_update( dt );
+      t0 = SDL_GetPerformanceCounter();
+      bench_add( &timings[BENCH_PILOTS], t1, t0 );
+
+      hooks_update( dt );
+      hooks_runParam( "update", h );
+      t1 = SDL_GetPerformanceCounter();
+      bench_add( &timings[BENCH_HOOKS], t0, t1 );
+   }
+
+   /* Report, stdout also gets the log so a file is better for parsing. */
+   if (out != NULL) {
+      f = fopen( out, "w" );
+      if (f == NULL) {
+         WARN(_("Unable to open '%s' for writing: %s"), out, strerror(errno));
+         return -1;
+      }
+   }
+   else
+      f = stdout;
+   fprintf( f, "{\n" );
+   fprintf( f, "  \"system\": " );
+   bench_printString( f, sysname );
+   fprintf( f, ",\n" );
+   fprintf( f, "  \"ticks\": %d,\n", ticks );
+   fprintf( f, "  \"dt\": %f,\n", dt );
+   fprintf( f, "  \"seed\": %u,\n", BENCH_SEED );
+   fprintf( f, "  \"pilots\": %d,\n", array_size( pilot_getAll() ) );
+   fprintf( f, "  \"bolts\": %d,\n", bolts );
+   fprintf( f, "  \"bolts_fired\": %d,\n", fired );
+   fprintf( f, "  \"space_init_ms\": %.3f,\n", 1e3 * (double)init / freq );
+   fprintf( f, "  \"subsystems\": {\n" );
+   for (i=0; i<BENCH_MAX; i++)
+      bench_printTiming( f, &timings[i], ticks, freq, (i==BENCH_MAX-1) );
+   fprintf( f, "  }\n" );
+   fprintf( f, "}\n" );
+   if (out != NULL) {
+      fclose( f );
+      LOG(_("Benchmark results written to '%s'."), out);
+   }
+   else
+      fflush( stdout );
+
+   return 0;
+}
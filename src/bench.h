@@ -0,0 +1,17 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+#ifndef BENCH_H
+#  define BENCH_H
+
+
+#define BENCH_DT     (1./60.)    /**< Fixed time step of a benchmark update. */
+#define BENCH_SEED   0x6e616576  /**< Random seed used for benchmarks. */
+
+
+int bench_run( const char *sysname, int ticks, int bolts, const char *out );
+
+
+#endif /* BENCH_H */
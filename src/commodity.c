@@ -27,6 +27,7 @@
 #include "hook.h"
 #include "log.h"
 #include "ndata.h"
+#include "nhash.h"
 #include "nstring.h"
 #include "ntime.h"
 #include "nxml.h"
@@ -48,6 +49,7 @@
 /* commodity stack */
 Commodity* commodity_stack = NULL; /**< Contains all the commodities. */
 static Commodity** commodity_temp = NULL; /**< Contains all the temporary commodities. */
+static NHash *commodity_names = NULL; /**< Index of the commodity stack by name. */
 
 /* gatherables stack */
 static Gatherable* gatherable_stack = NULL; /**< Contains the gatherable stuff floating around. */
@@ -134,9 +136,9 @@ void tonnes2str( char *str, int tonnes )
 Commodity* commodity_get( const char* name )
 {
    int i;
-   for (i=0; i<array_size(commodity_stack); i++)
-      if (strcmp(commodity_stack[i].name,name)==0)
-         return &commodity_stack[i];
+   i = nhash_get( commodity_names, name );
+   if (i >= 0)
+      return &commodity_stack[i];
    for (i=0; i<array_size(commodity_temp); i++)
       if (strcmp(commodity_temp[i]->name, name) == 0)
          return commodity_temp[i];
@@ -155,9 +157,9 @@ Commodity* commodity_get( const char* name )
 Commodity* commodity_getW( const char* name )
 {
    int i;
-   for (i=0; i<array_size(commodity_stack); i++)
-      if (strcmp(commodity_stack[i].name, name) == 0)
-         return &commodity_stack[i];
+   i = nhash_get( commodity_names, name );
+   if (i >= 0)
+      return &commodity_stack[i];
    for (i=0; i<array_size(commodity_temp); i++)
       if (strcmp(commodity_temp[i]->name, name) == 0)
          return commodity_temp[i];
@@ -603,9 +605,8 @@ int commodity_isTemp( const char* name )
    for (i=0; i<array_size(commodity_temp); i++)
       if (strcmp(commodity_temp[i]->name, name) == 0)
          return 1;
-   for (i=0; i<array_size(commodity_stack); i++)
-      if (strcmp(commodity_stack[i].name,name)==0)
-         return 0;
+   if (nhash_get( commodity_names, name ) >= 0)
+      return 0;
 
    WARN(_("Commodity '%s' not found in stack"), name);
    return 0;
@@ -669,6 +670,7 @@ int commodity_tempIllegalto( Commodity *com, int faction )
  */
 int commodity_load (void)
 {
+   int i;
    xmlNodePtr node;
    xmlDocPtr doc;
    Commodity *c;
@@ -715,6 +717,11 @@ int commodity_load (void)
 
    xmlFreeDoc(doc);
 
+   /* Index by name. */
+   commodity_names = nhash_create( array_size(commodity_stack) );
+   for (i=0; i<array_size(commodity_stack); i++)
+      nhash_insert( commodity_names, commodity_stack[i].name, i );
+
    DEBUG( n_( "Loaded %d Commodity", "Loaded %d Commodities", array_size(commodity_stack) ), array_size(commodity_stack) );
 
    return 0;
@@ -733,6 +740,8 @@ void commodity_free (void)
       commodity_freeOne( &commodity_stack[i] );
    array_free( commodity_stack );
    commodity_stack = NULL;
+   nhash_free( commodity_names );
+   commodity_names = NULL;
 
    for (i=0; i<array_size(commodity_temp); i++) {
       commodity_freeOne( commodity_temp[i] );
@@ -23,6 +23,12 @@
 static nlua_env cond_env = LUA_NOREF; /** Conditional Lua env. */
 
 
+/*
+ * Prototypes.
+ */
+static int cond_result( int ret );
+
+
 /**
  * @brief Initializes the conditional subsystem.
  */
@@ -62,15 +68,90 @@ void cond_exit (void)
  */
 int cond_check( const char* cond )
 {
-   int b;
    int ret;
 
    /* Load the string. */
    lua_pushstring(naevL, "return ");
    lua_pushstring(naevL, cond);
    lua_concat(naevL, 2);
-   ret = nlua_dobufenv(cond_env, lua_tostring(naevL,-1),
+   ret = luaL_loadbuffer(naevL, lua_tostring(naevL,-1),
                        lua_strlen(naevL,-1), "Lua Conditional");
+   if (ret == 0) {
+      nlua_pushenv(cond_env);
+      lua_setfenv(naevL, -2);
+      ret = nlua_pcall(cond_env, 0, 1);
+   }
+   return cond_result( ret );
+}
+
+
+/**
+ * @brief Compiles a condition so it can be checked repeatedly.
+ *
+ *    @param cond Condition to compile.
+ *    @return Reference to the compiled condition, LUA_NOREF on error.
+ */
+int cond_compile( const char *cond )
+{
+   int ret;
+
+   lua_pushstring(naevL, "return ");
+   lua_pushstring(naevL, cond);
+   lua_concat(naevL, 2);
+   ret = luaL_loadbuffer(naevL, lua_tostring(naevL,-1),
+                       lua_strlen(naevL,-1), "Lua Conditional");
+   if (ret != 0) {
+      WARN(_("Lua conditional syntax error: %s"), lua_tostring(naevL, -1));
+      lua_settop(naevL, 0);
+      return LUA_NOREF;
+   }
+   nlua_pushenv(cond_env);
+   lua_setfenv(naevL, -2);
+   ret = luaL_ref(naevL, LUA_REGISTRYINDEX);
+   lua_settop(naevL, 0);
+   return ret;
+}
+
+
+/**
+ * @brief Checks to see if a compiled condition is true.
+ *
+ *    @param ref Condition compiled by cond_compile().
+ *    @return 0 if is false, 1 if is true, -1 on error.
+ */
+int cond_checkRef( int ref )
+{
+   if (ref == LUA_NOREF)
+      return -1;
+
+   lua_rawgeti(naevL, LUA_REGISTRYINDEX, ref);
+   return cond_result( nlua_pcall(cond_env, 0, 1) );
+}
+
+
+/**
+ * @brief Frees a compiled condition.
+ *
+ *    @param ref Condition compiled by cond_compile().
+ */
+void cond_free( int ref )
+{
+   if (ref == LUA_NOREF)
+      return;
+   luaL_unref(naevL, LUA_REGISTRYINDEX, ref);
+}
+
+
+/**
+ * @brief Gets the result of running a condition, left on the stack.
+ *
+ *    @param ret Return value of running the condition.
+ *    @return 0 if is false, 1 if is true, -1 on error.
+ */
+static int cond_result( int ret )
+{
+   int b;
+
    switch (ret) {
       case  LUA_ERRSYNTAX:
          WARN(_("Lua conditional syntax error: %s"), lua_tostring(naevL, -1));
@@ -113,6 +113,11 @@ static void print_usage( void )
 #ifdef DEBUGGING
    LOG(_("   --devmode             enables dev mode perks like the editors"));
 #endif /* DEBUGGING */
+   LOG(_("   --bench s             benchmarks the simulation in system s and exits"));
+   LOG(_("   --bench-ticks n       number of updates to benchmark"));
+   LOG(_("   --bench-bolts n       keeps n bolts in flight while benchmarking"));
+   LOG(_("   --bench-out f         writes the benchmark results to file f"));
+   LOG(_("   --lua-profile f       profiles Lua and writes the results to f on exit"));
    LOG(_("   -h, --help            display this message and exit"));
    LOG(_("   -v, --version         print the version and exit"));
 }
@@ -156,6 +161,11 @@ void conf_setDefaults (void)
    conf.devmode      = 0;
    conf.devautosave  = 0;
    conf.lastversion = strdup( "" );
+   conf.bench        = NULL;
+   conf.bench_ticks  = BENCH_TICKS_DEFAULT;
+   conf.bench_bolts  = 0;
+   conf.bench_out    = NULL;
+   conf.lua_profile  = NULL;
 
    /* Gameplay. */
    conf_setGameplayDefaults();
@@ -191,6 +201,9 @@ void conf_setGameplayDefaults (void)
    conf.mouse_thrust          = MOUSE_THRUST_DEFAULT;
    conf.mouse_doubleclick     = MOUSE_DOUBLECLICK_TIME;
    conf.autonav_reset_speed   = AUTONAV_RESET_SPEED_DEFAULT;
+   conf.simulate_time         = SIMULATE_TIME_DEFAULT;
+   conf.simulate_dt           = SIMULATE_DT_DEFAULT;
+   conf.ai_lod                = AI_LOD_DEFAULT;
    conf.zoom_manual           = MANUAL_ZOOM_DEFAULT;
 }
 
@@ -389,6 +402,9 @@ int conf_loadConfig ( const char* file )
       /* Misc. */
       conf_loadFloat( lEnv, "compression_velocity", conf.compression_velocity );
       conf_loadFloat( lEnv, "compression_mult", conf.compression_mult );
+      conf_loadFloat( lEnv, "simulate_time", conf.simulate_time );
+      conf_loadFloat( lEnv, "simulate_dt", conf.simulate_dt );
+      conf_loadBool( lEnv, "ai_lod", conf.ai_lod );
       conf_loadBool( lEnv, "redirect_file", conf.redirect_file );
       conf_loadBool( lEnv, "save_compress", conf.save_compress );
       conf_loadInt( lEnv, "afterburn_sensitivity", conf.afterburn_sens );
@@ -546,6 +562,11 @@ void conf_parseCLI( int argc, char** argv )
 #ifdef DEBUGGING
       { "devmode", no_argument, 0, 'D' },
 #endif /* DEBUGGING */
+      { "bench", required_argument, 0, 'B' },
+      { "bench-ticks", required_argument, 0, 'T' },
+      { "bench-bolts", required_argument, 0, 'O' },
+      { "bench-out", required_argument, 0, 'R' },
+      { "lua-profile", required_argument, 0, 'P' },
       { "help", no_argument, 0, 'h' },
       { "version", no_argument, 0, 'v' },
       { NULL, 0, 0, 0 } };
@@ -612,6 +633,24 @@ void conf_parseCLI( int argc, char** argv )
             LOG(_("Enabling developer mode."));
             break;
 #endif /* DEBUGGING */
+         case 'B':
+            free(conf.bench);
+            conf.bench = strdup(optarg);
+            break;
+         case 'T':
+            conf.bench_ticks = atoi(optarg);
+            break;
+         case 'O':
+            conf.bench_bolts = atoi(optarg);
+            break;
+         case 'R':
+            free(conf.bench_out);
+            conf.bench_out = strdup(optarg);
+            break;
+         case 'P':
+            free(conf.lua_profile);
+            conf.lua_profile = strdup(optarg);
+            break;
 
          case 'v':
             /* by now it has already displayed the version */
@@ -970,6 +1009,19 @@ int conf_saveConfig ( const char* file )
    conf_saveFloat("compression_mult",conf.compression_mult);
    conf_saveEmptyLine();
 
+   conf_saveComment(_("Seconds of game time to simulate a system for when entering it, so it is already populated."));
+   conf_saveFloat("simulate_time",conf.simulate_time);
+   conf_saveEmptyLine();
+
+   conf_saveComment(_("Time step (in seconds) for simulating a system when entering it. Spawning and AI run once per step, physics still runs at 1/30."));
+   conf_saveComment(_("Larger is faster, but pilots hold their controls longer (up to 0.25 seconds) so the settled population is less accurate."));
+   conf_saveFloat("simulate_dt",conf.simulate_dt);
+   conf_saveEmptyLine();
+
+   conf_saveComment(_("Whether pilots far away from the player run their AI less often. Saves CPU, especially with time compression."));
+   conf_saveBool("ai_lod",conf.ai_lod);
+   conf_saveEmptyLine();
+
    conf_saveComment(_("Redirects log and error output to files"));
    conf_saveBool("redirect_file",conf.redirect_file);
    conf_saveEmptyLine();
@@ -1116,6 +1168,9 @@ void conf_copy( PlayerConf_t *dest, const PlayerConf_t *src )
    STRDUP(language);
    STRDUP(joystick_nam);
    STRDUP(lastversion);
+   STRDUP(bench);
+   STRDUP(bench_out);
+   STRDUP(lua_profile);
    STRDUP(dev_save_sys);
    STRDUP(dev_save_map);
    STRDUP(dev_save_asset);
@@ -1133,6 +1188,9 @@ void conf_free( PlayerConf_t *config )
    free(config->language);
    free(config->joystick_nam);
    free(config->lastversion);
+   free(config->bench);
+   free(config->bench_out);
+   free(config->lua_profile);
    free(config->dev_save_sys);
    free(config->dev_save_map);
    free(config->dev_save_asset);
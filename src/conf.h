@@ -18,6 +18,10 @@
 #define SAVE_COMPRESSION_DEFAULT             1     /**< Whether or not saved games should be compressed. */
 #define MOUSE_THRUST_DEFAULT                 1     /**< Whether or not to use mouse thrust controls. */
 #define MOUSE_DOUBLECLICK_TIME               0.5   /**< How long to consider double-clicks for. */
+#define SIMULATE_TIME_DEFAULT                30.   /**< Time to simulate a system before the player is added. */
+#define SIMULATE_DT_DEFAULT                  (1./15.) /**< Time step used when simulating a system on entry. */
+#define AI_LOD_DEFAULT                       1     /**< Whether far away pilots think less often. */
+#define BENCH_TICKS_DEFAULT                  3600  /**< Number of updates to run when benchmarking. */
 #define AUTONAV_RESET_SPEED_DEFAULT          1.    /**< Shield level (0-1) to reset autonav speed at. 1 means at enemy presence, 0 means at armour damage. */
 #define MANUAL_ZOOM_DEFAULT                  0     /**< Whether or not to enable manual zoom controls. */
 #define MAP_OVERLAY_OPACITY_DEFAULT          0.3   /**< Opacity fraction (0-1) for the overlay map. */
@@ -137,10 +141,18 @@ typedef struct PlayerConf_s {
    int mouse_thrust; /**< Whether mouse flying controls thrust. */
    double mouse_doubleclick; /**< How long to consider double-clicks for. */
    double autonav_reset_speed; /**< Condition for resetting autonav speed. */
+   double simulate_time; /**< Time to simulate a system on entry. */
+   double simulate_dt; /**< Time step to simulate a system on entry with. */
+   int ai_lod; /**< Whether far away pilots think less often. */
    int nosave; /**< Disables conf saving. */
    int devmode; /**< Developer mode. */
    int devautosave; /**< Developer mode autosave. */
    char *lastversion; /**< The last version the game was ran in. */
+   char *bench; /**< System to benchmark instead of playing, NULL to play. */
+   int bench_ticks; /**< Number of updates to benchmark. */
+   int bench_bolts; /**< Number of bolts to keep in flight while benchmarking. */
+   char *bench_out; /**< File to write the benchmark results to, NULL for stdout. */
+   char *lua_profile; /**< File to write the Lua profile to on exit, NULL to not profile Lua. */
 
    /* Debugging. */
    int fpu_except; /**< Enable FPU exceptions? */
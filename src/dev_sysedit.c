@@ -383,6 +383,7 @@ static void sysedit_btnNew( unsigned int wid_unused, char *unused )
    p        = planet_new();
    p->real  = ASSET_REAL;
    p->name  = name;
+   space_invalidateNames();
 
    /* Base planet data off another. */
    b                    = planet_get( space_getRndPlanet(0, 0, NULL) );
@@ -453,6 +454,7 @@ static void sysedit_btnRename( unsigned int wid_unused, char *unused )
          free(p->name);
 
          p->name = name;
+         space_invalidateNames();
          window_modifyText( sysedit_widEdit, "txtName", p->name );
          dpl_savePlanet( p );
       }
@@ -703,6 +703,7 @@ static void uniedit_renameSys (void)
       free(sys->name);
 
       sys->name = name;
+      space_invalidateNames();
       dsys_saveSystem(sys);
 
       /* Re-save adjacent systems. */
@@ -743,6 +744,7 @@ static void uniedit_newSys( double x, double y )
    /* Create the system. */
    sys         = system_new();
    sys->name   = name;
+   space_invalidateNames();
    sys->pos.x  = x;
    sys->pos.y  = y;
    sys->stars  = STARS_DENSITY_DEFAULT;
@@ -16,6 +16,8 @@
 /** @cond */
 #include <stdint.h>
 #include <stdio.h>
+#include "SDL.h"
+#include "SDL_thread.h"
 
 #ifdef HAVE_SUITESPARSE_CS_H
 #include <suitesparse/cs.h>
@@ -39,6 +41,7 @@
 #include "rng.h"
 #include "space.h"
 #include "spfx.h"
+#include "threadpool.h"
 
 
 /*
@@ -49,6 +52,9 @@
 #define ECON_FACTION_MOD   0.1 /**< Modifier on Base for faction standings. */
 #define ECON_PROD_MODIFIER 500000. /**< Production modifier, divide production by this amount. */
 #define ECON_PROD_VAR      0.01 /**< Defines the variability of production. */
+#define ECON_PRICE_SCALE   1. /**< How much the supply level lowers prices. */
+#define ECON_PRICE_MIN     0.5 /**< Lowest price modifier from supply. */
+#define ECON_PRICE_MAX     1.5 /**< Highest price modifier from supply. */
 
 
 /* systems stack. */
@@ -65,6 +71,14 @@ extern Commodity* commodity_stack;
 static int econ_initialized   = 0; /**< Is economy system initialized? */
 static int econ_queued        = 0; /**< Whether there are any queued updates. */
 static cs *econ_G             = NULL; /**< Admittance matrix. */
+static css *econ_S            = NULL; /**< Symbolic Cholesky analysis of the admittance matrix. */
+static csn *econ_N            = NULL; /**< Cholesky factorization of the admittance matrix. */
+static double *econ_prod      = NULL; /**< Production factor of each system. */
+static int econ_nprod         = 0; /**< Number of systems econ_prod has room for. */
+static double *econ_X         = NULL; /**< Intensities, then supply levels, of each commodity in each system. */
+static double *econ_work      = NULL; /**< Workspace of the solver. */
+static SDL_sem *econ_done     = NULL; /**< Posted when the solver job finishes. */
+static int econ_solving       = 0; /**< Whether a solver job is running or its results are unpublished. */
 int *econ_comm         = NULL; /**< Commodities to calculate. */
 
 
@@ -72,9 +86,11 @@ int *econ_comm         = NULL; /**< Commodities to calculate. */
  * Prototypes.
  */
 /* Economy. */
-//static double econ_calcJumpR( StarSystem *A, StarSystem *B );
-//static double econ_calcSysI( unsigned int dt, StarSystem *sys, int price );
-//static int econ_createGMatrix (void);
+static double econ_calcJumpR( StarSystem *A, StarSystem *B );
+static double econ_calcSysI( StarSystem *sys, int price );
+static int econ_createGMatrix (void);
+static int econ_solveJob( void *data );
+static void econ_sync( int wait );
 
 /*
  * Externed prototypes.
@@ -112,11 +128,14 @@ credits_t economy_getPrice( const Commodity *com,
 credits_t economy_getPriceAtTime( const Commodity *com,
                                   const StarSystem *sys, const Planet *p, ntime_t tme )
 {
-   int i, k;
-   double price;
+   int i, j, k;
+   double price, supply;
    double t;
    CommodityPrice *commPrice;
-   (void) sys;
+
+   /* Pick up the latest economy update. */
+   econ_sync( 1 );
+
    /* Get current time in periods.
     * Note, taking off and landing takes about 1e7 ntime, which is 1 period.
     * Time does not advance when on a planet.
@@ -128,12 +147,12 @@ credits_t economy_getPriceAtTime( const Commodity *com,
    k = com - commodity_stack;
 
    /* Find what commodity that is. */
-   for (i=0; i<array_size(econ_comm); i++)
-      if (econ_comm[i] == k)
+   for (j=0; j<array_size(econ_comm); j++)
+      if (econ_comm[j] == k)
          break;
 
    /* Check if found. */
-   if (i >= array_size(econ_comm)) {
+   if (j >= array_size(econ_comm)) {
       WARN(_("Price for commodity '%s' not known."), com->name);
       return 0;
    }
@@ -148,10 +167,9 @@ credits_t economy_getPriceAtTime( const Commodity *com,
      return 0;
    }
    commPrice = &p->commodityPrice[i];
-   /* Calculate price. */
-   /* price  = (double) com->price; */
-   /* price *= sys->prices[i]; */
-   price = (commPrice->price + commPrice->sysVariation
+   /* Calculate price, the supply in the system shifts the base price. */
+   supply = ((sys != NULL) && (sys->prices != NULL)) ? sys->prices[j] : 1.;
+   price = (commPrice->price * supply + commPrice->sysVariation
             * sin(2 * M_PI * t / commPrice->sysPeriod)
          + commPrice->planetVariation
             * sin(2 * M_PI * t / commPrice->planetPeriod));
@@ -273,7 +291,6 @@ int economy_getAveragePrice( const Commodity *com, credits_t *mean, double *std
 }
 
 
-#if 0
 /**
  * @brief Calculates the resistance between two star systems.
  *
@@ -309,104 +326,166 @@ static double econ_calcJumpR( StarSystem *A, StarSystem *B )
 /**
  * @brief Calculates the intensity in a system node.
  *
- * @todo Make it time/item dependent.
+ *    @param sys System to calculate the intensity of.
+ *    @param price Index of the commodity in econ_comm.
+ *    @return The production of the commodity in the system.
  */
-static double econ_calcSysI( unsigned int dt, StarSystem *sys, int price )
+static double econ_calcSysI( StarSystem *sys, int price )
 {
-   int i;
-   double I;
-   double prodfactor, p;
-   double ddt;
+   int i, j;
+   double p;
    Planet *planet;
+   Commodity *com;
 
-   ddt = (double)(dt / NTIME_UNIT_LENGTH);
+   com = &commodity_stack[ econ_comm[price] ];
 
-   /* Calculate production level. */
+   /* Production of the inhabited planets trading the commodity. */
    p = 0.;
-   for (i=0; i<sys->nplanets; i++) {
+   for (i=0; i<array_size(sys->planets); i++) {
       planet = sys->planets[i];
-      if (planet_hasService(planet, PLANET_SERVICE_INHABITED)) {
-         /*
-          * Calculate production.
-          */
-         /* We base off the current production. */
-         prodfactor  = planet->cur_prodfactor;
-         /* Add a variability factor based on the Gaussian distribution. */
-         prodfactor += ECON_PROD_VAR * RNG_2SIGMA() * ddt;
-         /* Add a tendency to return to the planet's base production. */
-         prodfactor -= ECON_PROD_VAR *
-               (planet->cur_prodfactor - prodfactor)*ddt;
-         /* Save for next iteration. */
-         planet->cur_prodfactor = prodfactor;
-         /* We base off the sqrt of the population otherwise it changes too fast. */
-         p += prodfactor * sqrt(planet->population);
-      }
+      if (!planet_hasService(planet, PLANET_SERVICE_INHABITED))
+         continue;
+      for (j=0; j<array_size(planet->commodities); j++)
+         if (strcmp(planet->commodities[j]->name, com->name) == 0)
+            break;
+      if (j >= array_size(planet->commodities))
+         continue;
+      /* We base off the sqrt of the population otherwise it changes too fast. */
+      p += sqrt(planet->population);
    }
 
    /* The intensity is basically the modified production. */
-   I = p / ECON_PROD_MODIFIER;
-
-   return I;
+   return econ_prod[sys->id] * p / ECON_PROD_MODIFIER;
 }
 
 
 /**
- * @brief Creates the admittance matrix.
+ * @brief Creates the admittance matrix and factorizes it.
  *
  *    @return 0 on success.
  */
 static int econ_createGMatrix (void)
 {
    int ret;
-   int i, j;
-   double R, Rsum;
+   int i, j, n, t;
+   double R, *diag;
    cs *M;
    StarSystem *sys;
 
+   n = array_size(systems_stack);
+
    /* Create the matrix. */
-   M = cs_spalloc( array_size(systems_stack), array_size(systems_stack), 1, 1, 1 );
+   M = cs_spalloc( n, n, 1, 1, 1 );
    if (M == NULL)
       ERR(_("Unable to create CSparse Matrix."));
 
-   /* Fill the matrix. */
-   for (i=0; i < array_size(systems_stack); i++) {
+   /* Fill the matrix, each route is only counted once. */
+   diag = calloc( n, sizeof(double) );
+   for (i=0; i < n; i++) {
       sys   = &systems_stack[i];
-      Rsum = 0.;
-
-      /* Set some values. */
       for (j=0; j < array_size(sys->jumps); j++) {
+         t = sys->jumps[j].targetid;
+         if ((t < i) && (jump_getTarget( sys, sys->jumps[j].target ) != NULL))
+            continue;
 
          /* Get the resistances. */
          R     = econ_calcJumpR( sys, sys->jumps[j].target );
          R     = 1./R; /* Must be inverted. */
-         Rsum += R;
+         diag[i] += R;
+         diag[t] += R;
 
          /* Matrix is symmetrical and non-diagonal is negative. */
-         ret = cs_entry( M, i, sys->jumps[j].target->id, -R );
+         ret = cs_entry( M, i, t, -R );
          if (ret != 1)
             WARN(_("Unable to enter CSparse Matrix Cell."));
-         ret = cs_entry( M, sys->jumps[j].target->id, i, -R );
+         ret = cs_entry( M, t, i, -R );
          if (ret != 1)
             WARN(_("Unable to enter CSparse Matrix Cell."));
       }
-
-      /* Set the diagonal. */
-      Rsum += 1./ECON_SELF_RES; /* We add a resistance for dampening. */
-      cs_entry( M, i, i, Rsum );
    }
 
+   /* Set the diagonal. */
+   for (i=0; i < n; i++)
+      cs_entry( M, i, i, diag[i] + 1./ECON_SELF_RES ); /* We add a resistance for dampening. */
+   free( diag );
+
    /* Compress M matrix and put into G. */
    cs_spfree( econ_G );
    econ_G = cs_compress( M );
    if (econ_G == NULL)
       ERR(_("Unable to create economy G Matrix."));
+   cs_dupl( econ_G );
 
    /* Clean up. */
    cs_spfree(M);
 
+   /* The matrix is symmetric positive definite, so factorize it once. */
+   cs_sfree( econ_S );
+   cs_nfree( econ_N );
+   econ_S = cs_schol( 1, econ_G );
+   econ_N = (econ_S != NULL) ? cs_chol( econ_G, econ_S ) : NULL;
+   if (econ_N == NULL) {
+      WARN(_("Unable to factorize the economy G Matrix."));
+      return -1;
+   }
+
    return 0;
 }
-#endif
+
+
+/**
+ * @brief Threadpool job solving the supply of all the commodities.
+ *
+ * Works in place on econ_X, one column per commodity, with the stored
+ * factorization.
+ */
+static int econ_solveJob( void *data )
+{
+   int j, n;
+   double *b;
+   (void) data;
+
+   n = econ_G->n;
+   for (j=0; j<array_size(econ_comm); j++) {
+      b = &econ_X[ j*n ];
+      cs_ipvec( econ_S->pinv, b, econ_work, n );
+      cs_lsolve( econ_N->L, econ_work );
+      cs_ltsolve( econ_N->L, econ_work );
+      cs_pvec( econ_S->pinv, econ_work, b, n );
+   }
+
+   SDL_SemPost( econ_done );
+   return 0;
+}
+
+
+/**
+ * @brief Publishes the results of the solver job into the systems.
+ *
+ *    @param wait Whether to wait for the job to finish.
+ */
+static void econ_sync( int wait )
+{
+   int i, j, n;
+   double x;
+
+   if (!econ_solving)
+      return;
+   if (wait)
+      SDL_SemWait( econ_done );
+   else if (SDL_SemTryWait( econ_done ) != 0)
+      return;
+   econ_solving = 0;
+
+   /* Higher supply means lower prices. */
+   n = econ_G->n;
+   for (j=0; j<array_size(econ_comm); j++) {
+      for (i=0; i<n; i++) {
+         x = 1. - ECON_PRICE_SCALE * econ_X[ j*n+i ];
+         systems_stack[i].prices[j] = CLAMP( ECON_PRICE_MIN, ECON_PRICE_MAX, x );
+      }
+   }
+}
 
 
 /**
@@ -416,7 +495,7 @@ static int econ_createGMatrix (void)
  */
 int economy_init (void)
 {
-   int i;
+   int i, j;
 
    /* Must not be initialized. */
    if (econ_initialized)
@@ -425,9 +504,20 @@ int economy_init (void)
    /* Allocate price space. */
    for (i=0; i<array_size(systems_stack); i++) {
       free(systems_stack[i].prices);
-      systems_stack[i].prices = calloc(array_size(econ_comm), sizeof(double));
+      systems_stack[i].prices = malloc(array_size(econ_comm) * sizeof(double));
+      for (j=0; j<array_size(econ_comm); j++)
+         systems_stack[i].prices[j] = 1.;
    }
 
+   /* Production starts off at the base. */
+   free( econ_prod );
+   econ_nprod = array_size(systems_stack);
+   econ_prod  = malloc( econ_nprod * sizeof(double) );
+   for (i=0; i<econ_nprod; i++)
+      econ_prod[i] = 1.;
+   if (econ_done == NULL)
+      econ_done = SDL_CreateSemaphore( 0 );
+
    /* Mark economy as initialized. */
    econ_initialized = 1;
 
@@ -457,6 +547,8 @@ int economy_execQueued (void)
    if (econ_queued)
       return economy_refresh();
 
+   /* Pick up the last update if it's done. */
+   econ_sync( 0 );
    return 0;
 }
 
@@ -467,13 +559,34 @@ int economy_execQueued (void)
  */
 int economy_refresh (void)
 {
+   int i, j, n;
+
    /* Economy must be initialized. */
    if (econ_initialized == 0)
       return 0;
 
+   /* The solver can't be running while the matrix changes. */
+   econ_sync( 1 );
+
+   /* Systems created since economy_init() (e.g. by the editor) need prices. */
+   n = array_size(systems_stack);
+   for (i=0; i<n; i++) {
+      if (systems_stack[i].prices != NULL)
+         continue;
+      systems_stack[i].prices = malloc(array_size(econ_comm) * sizeof(double));
+      for (j=0; j<array_size(econ_comm); j++)
+         systems_stack[i].prices[j] = 1.;
+   }
+   if (n > econ_nprod) {
+      econ_prod = realloc( econ_prod, n * sizeof(double) );
+      for (i=econ_nprod; i<n; i++)
+         econ_prod[i] = 1.;
+      econ_nprod = n;
+   }
+
    /* Create the resistance matrix. */
-   //if (econ_createGMatrix())
-   //   return -1;
+   if (econ_createGMatrix())
+      return -1;
 
    /* Initialize the prices. */
    economy_update( 0 );
@@ -489,75 +602,42 @@ int economy_refresh (void)
  */
 int economy_update( unsigned int dt )
 {
-   (void)dt;
-#if 0
-   int i, j;
-   double *X;
-   double scale, offset;
-   /*double min, max;*/
+   int i, j, n;
+   double ddt, prodfactor;
 
    /* Economy must be initialized. */
-   if (econ_initialized == 0)
+   if ((econ_initialized == 0) || (econ_N == NULL))
       return 0;
 
-   /* Create the vector to solve the system. */
-   X = malloc(sizeof(double)*array_size(systems_stack));
-   if (X == NULL) {
-      WARN(_("Out of Memory"));
-      return -1;
-   }
-
-   /* Calculate the results for each price set. */
-   for (j=0; j<array_size(econ_comm); j++) {
-
+   /* Only one update at a time. */
+   econ_sync( 1 );
 
-      /* First we must load the vector with intensities. */
-      for (i=0; i<array_size(systems_stack); i++)
-         X[i] = econ_calcSysI( dt, &systems_stack[i], j );
-
-      /* Solve the system. */
-      /** @TODO This should be improved to try to use better factorizations (LU/Cholesky)
-       * if possible or just outright try to use some other library that does fancy stuff
-       * like UMFPACK. Would be also interesting to see if it could be optimized so we
-       * store the factorization or update that instead of handling it individually. Another
-       * point of interest would be to split loops out to make the solving faster, however,
-       * this may be trickier to do (although it would surely let us use cholesky always if we
-       * enforce that condition). */
-      ret = cs_qrsol( 3, econ_G, X );
-      if (ret != 1)
-         WARN(_("Failed to solve the Economy System."));
-
-      /*
-       * Get the minimum and maximum to scale.
-       */
-      /*
-      min = +HUGE_VALF;
-      max = -HUGE_VALF;
-      for (i=0; i<array_size(systems_stack); i++) {
-         if (X[i] < min)
-            min = X[i];
-         if (X[i] > max)
-            max = X[i];
-      }
-      scale = 1. / (max - min);
-      offset = 0.5 - min * scale;
-      */
-
-      /*
-       * I'm not sure I like the filtering of the results, but it would take
-       * much more work to get a good system working without the need of post
-       * filtering.
-       */
-      scale    = 1.;
-      offset   = 1.;
-      for (i=0; i<array_size(systems_stack); i++)
-         systems_stack[i].prices[j] = X[i] * scale + offset;
+   /* Let production wander, with a tendency to return to the base. */
+   n   = array_size(systems_stack);
+   ddt = ntime_convertSeconds( dt ) / NT_PERIOD_SECONDS;
+   for (i=0; i<n; i++) {
+      prodfactor    = econ_prod[i] + ECON_PROD_VAR * RNG_2SIGMA() * ddt;
+      prodfactor   -= ECON_PROD_VAR * (prodfactor - 1.) * ddt;
+      econ_prod[i]  = prodfactor;
    }
 
-   /* Clean up. */
-   free(X);
+   /* Load the intensities of all the commodities. */
+   free( econ_X );
+   free( econ_work );
+   econ_X    = malloc( n * MAX(1,array_size(econ_comm)) * sizeof(double) );
+   econ_work = malloc( n * sizeof(double) );
+   for (j=0; j<array_size(econ_comm); j++)
+      for (i=0; i<n; i++)
+         econ_X[ j*n+i ] = econ_calcSysI( &systems_stack[i], j );
+
+   /* Solve them in the background, they get published when next needed. */
+   econ_solving = 1;
+   if (threadpool_newJob( econ_solveJob, NULL ) != 0) {
+      /* No threadpool, solve and publish them right away instead. */
+      econ_solveJob( NULL );
+      econ_sync( 1 );
+   }
 
-#endif
    econ_queued = 0;
    return 0;
 }
@@ -574,6 +654,9 @@ void economy_destroy (void)
    if (!econ_initialized)
       return;
 
+   /* Wait for the solver to be done with everything. */
+   econ_sync( 1 );
+
    /* Clean up the prices in the systems stack. */
    for (i=0; i<array_size(systems_stack); i++) {
       free(systems_stack[i].prices);
@@ -583,6 +666,19 @@ void economy_destroy (void)
    /* Destroy the economy matrix. */
    cs_spfree( econ_G );
    econ_G = NULL;
+   cs_sfree( econ_S );
+   econ_S = NULL;
+   cs_nfree( econ_N );
+   econ_N = NULL;
+   free( econ_prod );
+   econ_prod  = NULL;
+   econ_nprod = 0;
+   free( econ_X );
+   econ_X = NULL;
+   free( econ_work );
+   econ_work = NULL;
+   SDL_DestroySemaphore( econ_done );
+   econ_done = NULL;
 
    /* Economy is now deinitialized. */
    econ_initialized = 0;
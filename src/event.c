@@ -63,6 +63,7 @@ typedef struct EventData_ {
 
    EventTrigger_t trigger; /**< What triggers the event. */
    char *cond; /**< Conditional Lua code to execute. */
+   int cond_ref; /**< Compiled conditional, LUA_NOREF if none. */
    double chance; /**< Chance of appearing. */
    int priority; /**< Event priority: 0 = main plot, 5 = default, 10 = insignificant. */
 } EventData;
@@ -247,6 +248,7 @@ static int event_create( int dataid, unsigned int *id )
 {
    Event_t *ev;
    EventData *data;
+   char envname[STRMAX_SHORT];
 
    if (event_active==NULL)
       event_active = array_create( Event_t );
@@ -265,6 +267,8 @@ static int event_create( int dataid, unsigned int *id )
 
    /* Open the new state. */
    ev->env = nlua_newEnv(1);
+   snprintf( envname, sizeof(envname), "event/%s", data->name );
+   nlua_nameEnv( ev->env, envname );
    nlua_loadStandard(ev->env);
    nlua_loadEvt(ev->env);
    nlua_loadHook(ev->env);
@@ -404,7 +408,7 @@ void events_trigger( EventTrigger_t trigger )
 
       /* Test conditional. */
       if (event_data[i].cond != NULL) {
-         c = cond_check(event_data[i].cond);
+         c = cond_checkRef(event_data[i].cond_ref);
          if (c<0) {
             WARN(_("Conditional for event '%s' failed to run."), event_data[i].name);
             continue;
@@ -437,6 +441,7 @@ static int event_parseXML( EventData *temp, const xmlNodePtr parent )
    char *buf;
 
    memset( temp, 0, sizeof(EventData) );
+   temp->cond_ref = LUA_NOREF;
 
    /* get the name */
    xmlr_attr_strd(parent, "name", temp->name);
@@ -507,6 +512,10 @@ static int event_parseXML( EventData *temp, const xmlNodePtr parent )
    MELEMENT(temp->trigger==EVENT_TRIGGER_NULL,"trigger");
 #undef MELEMENT
 
+   /* Compile the conditional once instead of on every trigger. */
+   if (temp->cond != NULL)
+      temp->cond_ref = cond_compile( temp->cond );
+
    return 0;
 }
 
@@ -644,6 +653,7 @@ static void event_freeData( EventData *event )
    free( event->lua );
    free( event->sourcefile );
    free( event->cond );
+   cond_free( event->cond_ref );
 #if DEBUGGING
    memset( event, 0, sizeof(EventData) );
 #endif /* DEBUGGING */
@@ -11,6 +11,7 @@
 
 /** @cond */
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include "naev.h"
@@ -23,6 +24,7 @@
 #include "hook.h"
 #include "log.h"
 #include "ndata.h"
+#include "nhash.h"
 #include "nlua.h"
 #include "nluadef.h"
 #include "nxml.h"
@@ -47,6 +49,10 @@
 #define faction_isFlag(fa,f)  ((fa)->flags & (f))
 #define faction_isKnown_(fa)   ((fa)->flags & (FACTION_KNOWN))
 
+#define faction_bitGet(bits,i) (((bits)[(i)>>5] >> ((i)&31)) & 1u) /**< Tests a bit of a bitset. */
+#define faction_bitSet(bits,i) ((bits)[(i)>>5] |= (1u << ((i)&31))) /**< Sets a bit of a bitset. */
+#define faction_bitRm(bits,i)  ((bits)[(i)>>5] &= ~(1u << ((i)&31))) /**< Clears a bit of a bitset. */
+
 /**
  * @struct Faction
  *
@@ -87,6 +93,15 @@ typedef struct Faction_ {
 } Faction;
 
 static Faction* faction_stack = NULL; /**< Faction stack. */
+static NHash *faction_names = NULL; /**< Index of the faction stack by name. */
+static int faction_namesDirty = 0; /**< Whether the name index must be rebuilt. */
+
+/* Relation matrix. */
+static uint32_t *faction_enemyBits = NULL; /**< Bitset of enemies, bit a*n+b is set if a and b are enemies. */
+static uint32_t *faction_allyBits = NULL; /**< Bitset of allies, bit a*n+b is set if a and b are allies. */
+static uint32_t *faction_playerKnown = NULL; /**< Bitset of factions with up to date player relations in the matrix. */
+static int faction_relN = 0; /**< Number of factions in the relation matrix. */
+static int faction_relDirty = 1; /**< Relation matrix has to be rebuilt. */
 
 
 /*
@@ -94,12 +109,19 @@ static Faction* faction_stack = NULL; /**< Faction stack. */
  */
 /* static */
 static int faction_getRaw( const char *name );
+static void faction_buildNames (void);
+static void faction_addName( int id );
 static void faction_freeOne( Faction *f );
 static void faction_sanitizePlayer( Faction* faction );
 static void faction_modPlayerLua( int f, double mod, const char *source, int secondary );
 static int faction_parse( Faction* temp, xmlNodePtr parent );
 static void faction_parseSocial( xmlNodePtr parent );
 static void faction_addStandingScript( Faction* temp, const char* scriptname );
+static void faction_relChange (void);
+static void faction_relPlayerChange( int f );
+static void faction_relBuild (void);
+static void faction_relPlayer( int f );
+static void faction_relFree (void);
 /* externed */
 int pfaction_save( xmlTextWriterPtr writer );
 int pfaction_load( xmlNodePtr parent );
@@ -113,23 +135,60 @@ int pfaction_load( xmlNodePtr parent );
  */
 static int faction_getRaw( const char* name )
 {
-   int i;
    /* Escorts are part of the "player" faction. */
    if (strcmp(name, "Escort") == 0)
       return FACTION_PLAYER;
 
    if (name != NULL) {
-      for (i=0; i<array_size(faction_stack); i++)
-         if (strcmp(faction_stack[i].name, name)==0)
-            break;
-
-      if (i != array_size(faction_stack))
-         return i;
+      faction_buildNames();
+      return nhash_get( faction_names, name );
    }
    return -1;
 }
 
 
+/**
+ * @brief Rebuilds the faction name index if it is out of date.
+ *
+ * The index is kept up to date as factions get added, this is only needed
+ *  after removing factions.
+ */
+static void faction_buildNames (void)
+{
+   int i;
+
+   if (faction_names == NULL)
+      faction_names = nhash_create( MAX( array_size(faction_stack), 64 ) );
+   else if (faction_namesDirty)
+      nhash_clear( faction_names );
+   else
+      return;
+
+   for (i=0; i<array_size(faction_stack); i++)
+      if (faction_stack[i].name != NULL)
+         nhash_insert( faction_names, faction_stack[i].name, i );
+   faction_namesDirty = 0;
+}
+
+
+/**
+ * @brief Adds a newly added faction to the name index.
+ *
+ *    @param id ID of the faction.
+ */
+static void faction_addName( int id )
+{
+   if (faction_stack[id].name == NULL)
+      return;
+   /* Creating the index picks up the faction. */
+   if ((faction_names == NULL) || faction_namesDirty) {
+      faction_buildNames();
+      return;
+   }
+   nhash_insert( faction_names, faction_stack[id].name, id );
+}
+
+
 /**
  * @brief Checks to see if a faction exists by name.
  *
@@ -484,6 +543,7 @@ void faction_addEnemy( int f, int o )
 
    tmp = &array_grow( &ff->enemies );
    *tmp = o;
+   faction_relChange();
 }
 
 
@@ -510,6 +570,7 @@ void faction_rmEnemy( int f, int o )
    for (i=0;i<array_size(ff->enemies);i++) {
       if (ff->enemies[i] == o) {
          array_erase( &ff->enemies, &ff->enemies[i], &ff->enemies[i+1] );
+         faction_relChange();
          return;
       }
    }
@@ -558,6 +619,7 @@ void faction_addAlly( int f, int o )
 
    tmp = &array_grow( &ff->allies );
    *tmp = o;
+   faction_relChange();
 }
 
 
@@ -584,6 +646,7 @@ void faction_rmAlly( int f, int o )
    for (i=0;i<array_size(ff->allies);i++) {
       if (ff->allies[i] == o) {
          array_erase( &ff->allies, &ff->allies[i], &ff->allies[i+1] );
+         faction_relChange();
          return;
       }
    }
@@ -682,6 +745,7 @@ static void faction_modPlayerLua( int f, double mod, const char *source, int sec
 
    /* Sanitize just in case. */
    faction_sanitizePlayer( faction );
+   faction_relPlayerChange( f );
 
    /* Run hook if necessary. */
    delta = faction->player - old;
@@ -788,6 +852,7 @@ void faction_modPlayerRaw( int f, double mod )
 
    faction = &faction_stack[f];
    faction->player += mod;
+   faction_relPlayerChange( f );
    /* Run hook if necessary. */
    hparam[0].type    = HOOK_PARAM_FACTION;
    hparam[0].u.lf    = f;
@@ -798,6 +863,7 @@ void faction_modPlayerRaw( int f, double mod )
 
    /* Sanitize just in case. */
    faction_sanitizePlayer( faction );
+   faction_relPlayerChange( f );
 
    /* Tell space the faction changed. */
    space_factionChange();
@@ -824,6 +890,7 @@ void faction_setPlayer( int f, double value )
    faction = &faction_stack[f];
    mod = value - faction->player;
    faction->player = value;
+   faction_relPlayerChange( f );
    /* Run hook if necessary. */
    hparam[0].type    = HOOK_PARAM_FACTION;
    hparam[0].u.lf    = f;
@@ -834,6 +901,7 @@ void faction_setPlayer( int f, double value )
 
    /* Sanitize just in case. */
    faction_sanitizePlayer( faction );
+   faction_relPlayerChange( f );
 
    /* Tell space the faction changed. */
    space_factionChange();
@@ -1108,6 +1176,135 @@ const char *faction_getStandingBroad( int f, int bribed, int override )
 }
 
 
+/**
+ * @brief Marks the relation matrix as out of date.
+ *
+ * Must be called whenever factions are added or removed, or their allies or
+ *  enemies change.
+ */
+static void faction_relChange (void)
+{
+   faction_relDirty = 1;
+}
+
+
+/**
+ * @brief Marks the player relations of a faction as out of date.
+ *
+ * Must be called whenever the player's standing changes.
+ *
+ *    @param f Faction whose standing changed, negative for all.
+ */
+static void faction_relPlayerChange( int f )
+{
+   if (faction_relDirty)
+      return;
+   if (f < 0)
+      memset( faction_playerKnown, 0, sizeof(uint32_t) * ((faction_relN+31)/32) );
+   else if (f < faction_relN)
+      faction_bitRm( faction_playerKnown, f );
+}
+
+
+/**
+ * @brief Rebuilds the relation matrix from the allies and enemies lists.
+ *
+ * Relations are symmetric, so listing the other faction on either side is
+ *  enough. Player relations depend on standing and are filled in lazily by
+ *  faction_relPlayer().
+ */
+static void faction_relBuild (void)
+{
+   int i, j, n, o;
+   size_t size;
+   Faction *f;
+
+   faction_relFree();
+   n    = array_size(faction_stack);
+   size = ((size_t)n*n + 31) / 32;
+   faction_enemyBits    = calloc( MAX( size, 1 ), sizeof(uint32_t) );
+   faction_allyBits     = calloc( MAX( size, 1 ), sizeof(uint32_t) );
+   faction_playerKnown  = calloc( (n+31)/32 + 1, sizeof(uint32_t) );
+   faction_relN         = n;
+
+   for (i=0; i<n; i++) {
+      /* Player handled separately. */
+      if (i == FACTION_PLAYER)
+         continue;
+      f = &faction_stack[i];
+
+      for (j=0; j<array_size(f->enemies); j++) {
+         o = f->enemies[j];
+         if ((o < 0) || (o >= n) || (o == i) || (o == FACTION_PLAYER))
+            continue;
+         faction_bitSet( faction_enemyBits, i*n+o );
+         faction_bitSet( faction_enemyBits, o*n+i );
+      }
+      for (j=0; j<array_size(f->allies); j++) {
+         o = f->allies[j];
+         if ((o < 0) || (o >= n) || (o == FACTION_PLAYER))
+            continue;
+         faction_bitSet( faction_allyBits, i*n+o );
+         faction_bitSet( faction_allyBits, o*n+i );
+      }
+   }
+
+   /* Factions are always allied to themselves. */
+   for (i=0; i<n; i++)
+      faction_bitSet( faction_allyBits, i*n+i );
+
+   faction_relDirty = 0;
+}
+
+
+/**
+ * @brief Fills in the player relations of a faction in the relation matrix.
+ *
+ *    @param f Faction to update relations of.
+ */
+static void faction_relPlayer( int f )
+{
+   int n = faction_relN;
+
+   faction_bitRm( faction_enemyBits, FACTION_PLAYER*n+f );
+   faction_bitRm( faction_enemyBits, f*n+FACTION_PLAYER );
+   faction_bitRm( faction_allyBits, FACTION_PLAYER*n+f );
+   faction_bitRm( faction_allyBits, f*n+FACTION_PLAYER );
+
+   if (f == FACTION_PLAYER)
+      faction_bitSet( faction_allyBits, f*n+f );
+   else {
+      /* we assume player becomes allies with high rating */
+      if (faction_isPlayerEnemy(f)) {
+         faction_bitSet( faction_enemyBits, FACTION_PLAYER*n+f );
+         faction_bitSet( faction_enemyBits, f*n+FACTION_PLAYER );
+      }
+      if (faction_isPlayerFriend(f)) {
+         faction_bitSet( faction_allyBits, FACTION_PLAYER*n+f );
+         faction_bitSet( faction_allyBits, f*n+FACTION_PLAYER );
+      }
+   }
+
+   faction_bitSet( faction_playerKnown, f );
+}
+
+
+/**
+ * @brief Frees the relation matrix.
+ */
+static void faction_relFree (void)
+{
+   free( faction_enemyBits );
+   faction_enemyBits = NULL;
+   free( faction_allyBits );
+   faction_allyBits = NULL;
+   free( faction_playerKnown );
+   faction_playerKnown = NULL;
+   faction_relN = 0;
+   faction_relDirty = 1;
+}
+
+
 /**
  * @brief Checks whether two factions are enemies.
  *
@@ -1117,43 +1314,22 @@ const char *faction_getStandingBroad( int f, int bribed, int override )
  */
 int areEnemies( int a, int b )
 {
-   Faction *fa, *fb;
-   int i;
-
    if (a==b) return 0; /* luckily our factions aren't masochistic */
 
-   /* handle a */
-   if (faction_isFaction(a))
-      fa = &faction_stack[a];
-   else { /* a is invalid */
-      //WARN(_("Faction id '%d' is invalid."), a);
+   /* Invalid factions have no enemies. */
+   if (!faction_isFaction(a) || !faction_isFaction(b))
       return 0;
-   }
 
-   /* handle b */
-   if (faction_isFaction(b))
-      fb = &faction_stack[b];
-   else { /* b is invalid */
-      //WARN(_("Faction id '%d' is invalid."), b);
-      return 0;
-   }
+   if (faction_relDirty)
+      faction_relBuild();
 
    /* player handled separately */
-   if (a==FACTION_PLAYER) {
-      return faction_isPlayerEnemy(b);
-   }
-   else if (b==FACTION_PLAYER) {
-      return faction_isPlayerEnemy(a);
-   }
+   if ((a==FACTION_PLAYER) && !faction_bitGet( faction_playerKnown, b ))
+      faction_relPlayer( b );
+   else if ((b==FACTION_PLAYER) && !faction_bitGet( faction_playerKnown, a ))
+      faction_relPlayer( a );
 
-   for (i=0;i<array_size(fa->enemies);i++)
-      if (fa->enemies[i] == b)
-         return 1;
-   for (i=0;i<array_size(fb->enemies);i++)
-      if (fb->enemies[i] == a)
-         return 1;
-
-   return 0;
+   return faction_bitGet( faction_enemyBits, a*faction_relN+b );
 }
 
 
@@ -1166,44 +1342,23 @@ int areEnemies( int a, int b )
  */
 int areAllies( int a, int b )
 {
-   Faction *fa, *fb;
-   int i;
-
    /* If they are the same they must be allies. */
    if (a==b) return 1;
 
-   /* handle a */
-   if (faction_isFaction(a))
-      fa = &faction_stack[a];
-   else { /* a is invalid */
-      //WARN(_("Faction id '%d' is invalid."), a);
-      return 0;
-   }
-
-   /* handle b */
-   if (faction_isFaction(b))
-      fb = &faction_stack[b];
-   else { /* b is invalid */
-      //WARN(_("Faction id '%d' is invalid."), b);
+   /* Invalid factions have no allies. */
+   if (!faction_isFaction(a) || !faction_isFaction(b))
       return 0;
-   }
 
-   /* we assume player becomes allies with high rating */
-   if (a==FACTION_PLAYER) {
-      return faction_isPlayerFriend(b);
-   }
-   else if (b==FACTION_PLAYER) {
-      return faction_isPlayerFriend(a);
-   }
+   if (faction_relDirty)
+      faction_relBuild();
 
-   for (i=0;i<array_size(fa->allies);i++)
-      if (fa->allies[i] == b)
-         return 1;
-   for (i=0;i<array_size(fb->allies);i++)
-      if (fb->allies[i] == a)
-         return 1;
+   /* player handled separately */
+   if ((a==FACTION_PLAYER) && !faction_bitGet( faction_playerKnown, b ))
+      faction_relPlayer( b );
+   else if ((b==FACTION_PLAYER) && !faction_bitGet( faction_playerKnown, a ))
+      faction_relPlayer( a );
 
-   return 0;
+   return faction_bitGet( faction_allyBits, a*faction_relN+b );
 }
 
 
@@ -1459,6 +1614,7 @@ void factions_reset (void)
       faction_stack[i].player = faction_stack[i].player_def;
       faction_stack[i].flags = faction_stack[i].oflags;
    }
+   faction_relPlayerChange( -1 );
 }
 
 
@@ -1496,6 +1652,7 @@ int factions_load (void)
    f = &array_grow( &faction_stack );
    memset( f, 0, sizeof(Faction) );
    f->name        = strdup("Player");
+   faction_addName( array_size(faction_stack)-1 );
    f->flags       = FACTION_STATIC | FACTION_INVISIBLE;
    f->equip_env   = LUA_NOREF;
    f->env         = LUA_NOREF;
@@ -1512,6 +1669,7 @@ int factions_load (void)
          /* Load faction. */
          faction_parse( f, node );
          f->oflags = f->flags;
+         faction_addName( array_size(faction_stack)-1 );
       }
    } while (xml_nextNode(node));
 
@@ -1559,6 +1717,7 @@ int factions_load (void)
    }
 
    xmlFreeDoc(doc);
+   faction_relChange();
 
    DEBUG( n_( "Loaded %d Faction", "Loaded %d Factions", array_size(faction_stack) ), array_size(faction_stack) );
 
@@ -1599,6 +1758,10 @@ void factions_free (void)
       faction_freeOne( &faction_stack[i] );
    array_free(faction_stack);
    faction_stack = NULL;
+   faction_relFree();
+   nhash_free( faction_names );
+   faction_names = NULL;
+   faction_namesDirty = 0;
 }
 
 
@@ -1680,6 +1843,7 @@ int pfaction_load( xmlNodePtr parent )
       }
    } while (xml_nextNode(node));
 
+   faction_relPlayerChange( -1 );
    return 0;
 }
 
@@ -1738,6 +1902,8 @@ void factions_clearDynamic (void)
       if (faction_isFlag(f, FACTION_DYNAMIC)) {
          faction_freeOne( f );
          array_erase( &faction_stack, f, f+1 );
+         faction_relChange();
+         faction_namesDirty = 1;
          i--;
       }
    }
@@ -1760,6 +1926,7 @@ int faction_dynAdd( int base, const char* name, const char* display, const char*
    f = &array_grow( &faction_stack );
    memset( f, 0, sizeof(Faction) );
    f->name        = strdup( name );
+   faction_addName( array_size(faction_stack)-1 );
    f->displayname = display==NULL ? NULL : strdup( display );
    f->ai          = (ai==NULL) ? NULL : strdup( ai );
    f->allies      = array_create( int );
@@ -1793,6 +1960,7 @@ int faction_dynAdd( int base, const char* name, const char* display, const char*
       /* Lua stuff. */
       f->equip_env = bf->equip_env;
    }
+   faction_relChange();
 
    return f-faction_stack;
 }
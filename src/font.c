@@ -39,6 +39,7 @@
 #define HASH_LUT_SIZE 512 /**< Size of glyph look up table. */
 #define DEFAULT_TEXTURE_SIZE 1024 /**< Default size of texture caches for glyphs. */
 #define MAX_ROWS 64 /**< Max number of rows per texture cache. */
+#define FONT_BATCH_VERTEX 8 /**< Floats per batched glyph vertex (position, texture coords, colour). */
 
 
 /**
@@ -50,6 +51,13 @@ static FT_Library font_library = NULL; /**< Global, reference-counted FreeType l
 static int        font_library_refs = 0; /**< Our refcount for font_library, because FreeType inexplicably hides its own. */
 static FT_UInt    prev_glyph_index; /**< Index of last character drawn (for kerning). */
 static int        prev_glyph_ft_index; /**< HACK: Index into which stsh->ft[_].face? */
+static gl_vbo     *font_vbo = NULL; /**< Streaming VBO for batched glyphs. */
+static GLfloat    *font_vbo_data = NULL; /**< Vertex data of the glyphs being batched. */
+static int        font_vbo_n = 0; /**< Glyphs being batched. */
+static int        font_vbo_m = 0; /**< Glyphs that fit in font_vbo_data. */
+static GLuint     font_vbo_tex = 0; /**< Texture page of the glyphs being batched. */
+static glColour   font_col; /**< Colour of the glyphs being batched. */
+static double     font_pen_x = 0.; /**< Horizontal position of the next glyph (unscaled). */
 
 
 /**
@@ -137,10 +145,8 @@ typedef struct glFontStash_s {
    int tw; /**< Width of textures. */
    int th; /**< Height of textures. */
    glFontTex *tex; /**< Textures. */
-   gl_vbo *vbo_tex; /**< VBO associated to texture coordinates. */
-   gl_vbo *vbo_vert; /**< VBO associated to vertex coordinates. */
-   GLfloat *vbo_tex_data; /**< Copy of texture coordinate data. */
-   GLshort *vbo_vert_data; /**< Copy of vertex coordinate data. */
+   GLfloat *vbo_tex_data; /**< Texture coordinate data of the glyphs. */
+   GLshort *vbo_vert_data; /**< Vertex coordinate data of the glyphs. */
    int nvbo; /**< Amount of vbo data. */
    int mvbo; /**< Amount of vbo memory. */
    glFontGlyph *glyphs; /**< Unicode glyphs. */
@@ -177,13 +183,13 @@ static const glColour* gl_fontGetColour( uint32_t ch );
 /* Get unicode glyphs from cache. */
 static glFontGlyph* gl_fontGetGlyph( glFontStash *stsh, uint32_t ch );
 /* Render.
- * TODO this should be changed to be more like font-stash (https://github.com/akrinke/Font-Stash)
- * In particular, instead of writing char by char, they should be batched up by textures and rendered
+ * Glyphs are batched up by texture and rendered when the texture changes or
  * when gl_fontRenderEnd() is called, saving lots of opengl calls.
  */
 static void gl_fontRenderStart( const glFontStash *stsh, double x, double y, const glColour *c, double outlineR );
 static void gl_fontRenderStartH( const glFontStash* stsh, const gl_Matrix4 *H, const glColour *c, double outlineR );
 static int gl_fontRenderGlyph( glFontStash *stsh, uint32_t ch, const glColour *c, int state );
+static void gl_fontRenderFlush (void);
 static void gl_fontRenderEnd (void);
 /* Fussy layout concerns. */
 static void gl_fontKernStart (void);
@@ -361,9 +367,6 @@ static int gl_fontAddGlyphTex( glFontStash *stsh, font_char_t *ch, glFontGlyph *
    vbo_vert[ 5 ] = vy;
    vbo_vert[ 6 ] = vx+vw; /* Bottom right. */
    vbo_vert[ 7 ] = vy;
-   /* Update vbos. */
-   gl_vboData( stsh->vbo_tex,  sizeof(GLfloat)*n,  stsh->vbo_tex_data );
-   gl_vboData( stsh->vbo_vert, sizeof(GLshort)*n, stsh->vbo_vert_data );
 
    /* Add space for the new character. */
    gr->x += ch->w;
@@ -372,10 +375,6 @@ static int gl_fontAddGlyphTex( glFontStash *stsh, font_char_t *ch, glFontGlyph *
    glyph->vbo_id = (n-8)/2;
    glyph->tex_index = tex - stsh->tex;
 
-   /* Since the VBOs have possibly changed, we have to reset the data. */
-   gl_vboActivateAttribOffset( stsh->vbo_vert, shaders.font.vertex, 0, 2, GL_SHORT, 0 );
-   gl_vboActivateAttribOffset( stsh->vbo_tex, shaders.font.tex_coord, 0, 2, GL_FLOAT, 0 );
-
    return 0;
 }
 
@@ -1206,8 +1205,13 @@ static void gl_fontRenderStartH( const glFontStash* stsh, const gl_Matrix4 *H, c
    else
       col = c;
 
+   /* Keep ordering with any pending sprites. */
+   gl_batchFlush();
+
+   font_col = *col;
+   font_col.a = a;
+
    glUseProgram(shaders.font.program);
-   gl_uniformAColor(shaders.font.color, col, a);
    if (outlineR == 0.)
       gl_uniformAColor(shaders.font.outline_color, col, 0.);
    else
@@ -1216,14 +1220,19 @@ static void gl_fontRenderStartH( const glFontStash* stsh, const gl_Matrix4 *H, c
    scale = (double)stsh->h / FONT_DISTANCE_FIELD_SIZE;
    font_projection_mat = gl_Matrix4_Scale(*H, scale, scale, 1 );
 
+   gl_Matrix4_Uniform(shaders.font.projection, font_projection_mat);
+
    font_restoreLast = 0;
+   font_pen_x = 0.;
    gl_fontKernStart();
 
-   /* Activate the appropriate VBOs. */
+   /* Set up the batch. */
+   if (font_vbo == NULL)
+      font_vbo = gl_vboCreateStream( 0, NULL );
+   font_vbo_n = 0;
    glEnableVertexAttribArray( shaders.font.vertex );
-   gl_vboActivateAttribOffset( stsh->vbo_vert, shaders.font.vertex, 0, 2, GL_SHORT, 0 );
    glEnableVertexAttribArray( shaders.font.tex_coord );
-   gl_vboActivateAttribOffset( stsh->vbo_tex, shaders.font.tex_coord, 0, 2, GL_FLOAT, 0 );
+   glEnableVertexAttribArray( shaders.font.vertex_color );
 }
 
 
@@ -1378,10 +1387,16 @@ static int gl_fontKernGlyph( glFontStash* stsh, uint32_t ch, glFontGlyph* glyph
  */
 static int gl_fontRenderGlyph( glFontStash* stsh, uint32_t ch, const glColour *c, int state )
 {
+   /* Corners of the glyph quad as two triangles. */
+   static const int corners[6] = { 0, 1, 2, 2, 1, 3 };
    double scale;
    double a;
    const glColour *col;
-   int kern_adv_x;
+   int i, kern_adv_x;
+   GLuint tex;
+   GLfloat *v;
+   const GLfloat *vt;
+   const GLshort *vv;
 
    /* Handle escape sequences. */
    if ((ch == FONT_COLOUR_CODE) && (state==0)) {/* Start sequence. */
@@ -1390,12 +1405,14 @@ static int gl_fontRenderGlyph( glFontStash* stsh, uint32_t ch, const glColour *c
    if ((state == 1) && (ch != FONT_COLOUR_CODE)) {
       col = gl_fontGetColour( ch );
       a = (c==NULL) ? 1. : c->a;
-      if (col != NULL)
-         gl_uniformAColor(shaders.font.color, col, a );
+      if (col != NULL) {
+         font_col = *col;
+         font_col.a = a;
+      }
       else if (c==NULL)
-         gl_uniformColor(shaders.font.color, &cWhite);
+         font_col = cWhite;
       else
-         gl_uniformColor(shaders.font.color, c);
+         font_col = *c;
       font_lastCol = col;
       return 0;
    }
@@ -1412,24 +1429,70 @@ static int gl_fontRenderGlyph( glFontStash* stsh, uint32_t ch, const glColour *c
    /* Kern if possible. */
    scale = (double)stsh->h / FONT_DISTANCE_FIELD_SIZE;
    kern_adv_x = gl_fontKernGlyph( stsh, ch, glyph );
-   if (kern_adv_x) {
-      font_projection_mat = gl_Matrix4_Translate( font_projection_mat,
-            kern_adv_x/scale, 0, 0 );
+   if (kern_adv_x)
+      font_pen_x += kern_adv_x/scale;
+
+   /* Texture change. */
+   tex = stsh->tex[glyph->tex_index].id;
+   if ((font_vbo_n > 0) && (tex != font_vbo_tex))
+      gl_fontRenderFlush();
+   font_vbo_tex = tex;
+
+   /* Make room. */
+   if (font_vbo_n >= font_vbo_m) {
+      font_vbo_m = MAX( 2*font_vbo_m, 256 );
+      font_vbo_data = realloc( font_vbo_data,
+            sizeof(GLfloat) * font_vbo_m*6*FONT_BATCH_VERTEX );
    }
 
-   /* Activate texture. */
-   glBindTexture(GL_TEXTURE_2D, stsh->tex[glyph->tex_index].id);
+   /* Add the element. */
+   vv = &stsh->vbo_vert_data[ 2*glyph->vbo_id ];
+   vt = &stsh->vbo_tex_data[ 2*glyph->vbo_id ];
+   v  = &font_vbo_data[ font_vbo_n*6*FONT_BATCH_VERTEX ];
+   for (i=0; i<6; i++) {
+      v[0] = vv[ 2*corners[i]   ] + font_pen_x;
+      v[1] = vv[ 2*corners[i]+1 ];
+      v[2] = vt[ 2*corners[i]   ];
+      v[3] = vt[ 2*corners[i]+1 ];
+      v[4] = font_col.r;
+      v[5] = font_col.g;
+      v[6] = font_col.b;
+      v[7] = font_col.a;
+      v += FONT_BATCH_VERTEX;
+   }
+   font_vbo_n++;
 
-   gl_Matrix4_Uniform(shaders.font.projection, font_projection_mat);
+   /* Advance. */
+   font_pen_x += glyph->adv_x/scale;
 
-   /* Draw the element. */
-   glDrawArrays( GL_TRIANGLE_STRIP, glyph->vbo_id, 4 );
+   return 0;
+}
 
-   /* Translate matrix. */
-   font_projection_mat = gl_Matrix4_Translate( font_projection_mat,
-         glyph->adv_x/scale, 0, 0 );
 
-   return 0;
+/**
+ * @brief Draws the glyphs batched so far.
+ */
+static void gl_fontRenderFlush (void)
+{
+   GLsizei stride;
+
+   if (font_vbo_n <= 0)
+      return;
+
+   gl_vboData( font_vbo, sizeof(GLfloat) * font_vbo_n*6*FONT_BATCH_VERTEX,
+         font_vbo_data );
+
+   stride = sizeof(GLfloat) * FONT_BATCH_VERTEX;
+   gl_vboActivateAttribOffset( font_vbo, shaders.font.vertex,
+         0, 2, GL_FLOAT, stride );
+   gl_vboActivateAttribOffset( font_vbo, shaders.font.tex_coord,
+         sizeof(GLfloat) * 2, 2, GL_FLOAT, stride );
+   gl_vboActivateAttribOffset( font_vbo, shaders.font.vertex_color,
+         sizeof(GLfloat) * 4, 4, GL_FLOAT, stride );
+
+   glBindTexture( GL_TEXTURE_2D, font_vbo_tex );
+   glDrawArrays( GL_TRIANGLES, 0, font_vbo_n*6 );
+   font_vbo_n = 0;
 }
 
 
@@ -1438,8 +1501,11 @@ static int gl_fontRenderGlyph( glFontStash* stsh, uint32_t ch, const glColour *c
  */
 static void gl_fontRenderEnd (void)
 {
+   gl_fontRenderFlush();
+
    glDisableVertexAttribArray( shaders.font.vertex );
    glDisableVertexAttribArray( shaders.font.tex_coord );
+   glDisableVertexAttribArray( shaders.font.vertex_color );
    glUseProgram(0);
 
    /* Check for errors. */
@@ -1570,8 +1636,6 @@ int gl_fontInit( glFont* font, const char *fname, const unsigned int h, const ch
    stsh->mvbo = 256;
    stsh->vbo_tex_data  = calloc( 8*stsh->mvbo, sizeof(GLfloat) );
    stsh->vbo_vert_data = calloc( 8*stsh->mvbo, sizeof(GLshort) );
-   stsh->vbo_tex  = gl_vboCreateStatic( sizeof(GLfloat)*8*stsh->mvbo,  stsh->vbo_tex_data );
-   stsh->vbo_vert = gl_vboCreateStatic( sizeof(GLshort)*8*stsh->mvbo, stsh->vbo_vert_data );
 
    return 0;
 }
@@ -1713,6 +1777,13 @@ void gl_freeFont( glFont* font )
    if (--font_library_refs == 0) {
       FT_Done_FreeType( font_library );
       font_library = NULL;
+
+      /* Last font, so also get rid of the batch. */
+      gl_vboDestroy( font_vbo );
+      font_vbo = NULL;
+      free( font_vbo_data );
+      font_vbo_data = NULL;
+      font_vbo_m = 0;
    }
 
    free( stsh->fname );
@@ -1721,8 +1792,6 @@ void gl_freeFont( glFont* font )
    array_free( stsh->tex );
 
    array_free( stsh->glyphs );
-   gl_vboDestroy(stsh->vbo_tex);
-   gl_vboDestroy(stsh->vbo_vert);
    free(stsh->vbo_tex_data);
    free(stsh->vbo_vert_data);
    memset( stsh, 0, sizeof(glFontStash) );
@@ -31,12 +31,14 @@
 
 #include "hook.h"
 
+#include "array.h"
 #include "claim.h"
 #include "event.h"
 #include "log.h"
 #include "menu.h"
 #include "mission.h"
 #include "nlua_hook.h"
+#include "nhash.h"
 #include "nlua_pilot.h"
 #include "nstring.h"
 #include "nxml.h"
@@ -76,9 +78,12 @@ typedef enum HookType_e {
  */
 typedef struct Hook_ {
    struct Hook_ *next; /**< Linked list. */
+   struct Hook_ *snext; /**< Next hook in the same stack. */
+   struct Hook_ *sprev; /**< Previous hook in the same stack. */
 
    unsigned int id; /**< unique id */
-   char *stack; /**< stack it's a part of */
+   const char *stack; /**< stack it's a part of (owned by hook_stacks) */
+   int stackid; /**< Index of the stack in hook_stacks. */
    int created; /**< Hook has just been created. */
    int delete; /**< indicates it should be deleted when possible */
    int ran_once; /**< Indicates if the hook already ran, useful when iterating. */
@@ -86,7 +91,8 @@ typedef struct Hook_ {
 
    /* Timer information. */
    int is_timer; /**< Whether or not is actually a timer. */
-   double ms; /**< Milliseconds left. */
+   double ms; /**< Value of hook_timerClock at which the timer expires. */
+   int heap; /**< Position in hook_timers or -1 if not in it. */
 
    /* Date information. */
    int is_date; /**< Whether or not it is a date hook. */
@@ -107,11 +113,25 @@ typedef struct Hook_ {
 } Hook;
 
 
+/**
+ * @brief Hooks that belong to a stack.
+ */
+typedef struct HookStack_ {
+   char *name; /**< Name of the stack. */
+   Hook *list; /**< Linked list of hooks in the stack (through snext). */
+} HookStack;
+
+
 /*
  * the stack
  */
 static unsigned int hook_id   = 0; /**< Unique hook id generator. */
 static Hook* hook_list        = NULL; /**< Stack of hooks. */
+static HookStack *hook_stacks = NULL; /**< Array (array.h): Hooks by stack. */
+static NHash *hook_stackIndex = NULL; /**< Maps stack names to hook_stacks. */
+static Hook **hook_timers     = NULL; /**< Array (array.h): Min-heap of timer hooks by expiry. */
+static Hook **hook_timersLate = NULL; /**< Array (array.h): Timers to requeue after updating. */
+static double hook_timerClock = 0.; /**< Time timer hooks are measured against. */
 static int hook_runningstack  = 0; /**< Check if stack is running. */
 static int hook_loadingstack  = 0; /**< Check if the hooks are being loaded. */
 
@@ -128,6 +148,14 @@ static void hooks_purgeList (void);
 static Hook* hook_get( unsigned int id );
 static unsigned int hook_genID (void);
 static Hook* hook_new( HookType_t type, const char *stack );
+static int hook_stackGet( const char *stack );
+static int hook_stackID( const char *stack );
+static void hook_stackRm( Hook *h );
+static void hook_timerPush( Hook *h );
+static void hook_timerRm( Hook *h );
+static void hook_timerUp( int i );
+static void hook_timerDown( int i );
+static void hook_timerSwap( int i, int j );
 static int hook_parseParam( lua_State *L, const HookParam *param );
 static int hook_runMisn( Hook *hook, const HookParam *param, int claims );
 static int hook_runEvent( Hook *hook, const HookParam *param, int claims );
@@ -469,6 +497,7 @@ static unsigned int hook_genID (void)
 static Hook* hook_new( HookType_t type, const char *stack )
 {
    Hook *new_hook;
+   HookStack *hs;
 
    /* Get and create new hook. */
    new_hook = calloc( 1, sizeof(Hook) );
@@ -483,8 +512,17 @@ static Hook* hook_new( HookType_t type, const char *stack )
    /* Fill out generic details. */
    new_hook->type    = type;
    new_hook->id      = hook_genID();
-   new_hook->stack   = strdup(stack);
+   new_hook->stackid = hook_stackID(stack);
    new_hook->created = 1;
+   new_hook->heap    = -1;
+
+   /* Add to the stack's list, also at the front. */
+   hs = &hook_stacks[ new_hook->stackid ];
+   new_hook->stack   = hs->name;
+   new_hook->snext   = hs->list;
+   if (hs->list != NULL)
+      hs->list->sprev = new_hook;
+   hs->list = new_hook;
 
    /** @TODO fix this hack. */
    if (strcmp(stack,"safe")==0)
@@ -494,6 +532,147 @@ static Hook* hook_new( HookType_t type, const char *stack )
 }
 
 
+/**
+ * @brief Gets the index of a stack in hook_stacks.
+ *
+ *    @param stack Name of the stack.
+ *    @return Index of the stack or -1 if no hook was ever added to it.
+ */
+static int hook_stackGet( const char *stack )
+{
+   return nhash_get( hook_stackIndex, stack );
+}
+
+
+/**
+ * @brief Gets the index of a stack in hook_stacks, creating it if needed.
+ *
+ *    @param stack Name of the stack.
+ *    @return Index of the stack.
+ */
+static int hook_stackID( const char *stack )
+{
+   int id;
+   HookStack *hs;
+
+   id = hook_stackGet( stack );
+   if (id >= 0)
+      return id;
+
+   if (hook_stacks == NULL) {
+      hook_stacks     = array_create( HookStack );
+      hook_stackIndex = nhash_create( 64 );
+   }
+   id       = array_size( hook_stacks );
+   hs       = &array_grow( &hook_stacks );
+   hs->name = strdup( stack );
+   hs->list = NULL;
+   nhash_insert( hook_stackIndex, hs->name, id );
+   return id;
+}
+
+
+/**
+ * @brief Removes a hook from its stack's list.
+ */
+static void hook_stackRm( Hook *h )
+{
+   if (h->sprev == NULL)
+      hook_stacks[ h->stackid ].list = h->snext;
+   else
+      h->sprev->snext = h->snext;
+   if (h->snext != NULL)
+      h->snext->sprev = h->sprev;
+   h->snext = NULL;
+   h->sprev = NULL;
+}
+
+
+/**
+ * @brief Swaps two timers in the heap.
+ */
+static void hook_timerSwap( int i, int j )
+{
+   Hook *h = hook_timers[i];
+   hook_timers[i] = hook_timers[j];
+   hook_timers[j] = h;
+   hook_timers[i]->heap = i;
+   hook_timers[j]->heap = j;
+}
+
+
+/**
+ * @brief Moves a timer up the heap until it is in place.
+ */
+static void hook_timerUp( int i )
+{
+   int p;
+   while (i > 0) {
+      p = (i-1) / 2;
+      if (hook_timers[p]->ms <= hook_timers[i]->ms)
+         break;
+      hook_timerSwap( i, p );
+      i = p;
+   }
+}
+
+
+/**
+ * @brief Moves a timer down the heap until it is in place.
+ */
+static void hook_timerDown( int i )
+{
+   int c, n;
+   n = array_size( hook_timers );
+   while (1) {
+      c = 2*i+1;
+      if (c >= n)
+         break;
+      if ((c+1 < n) && (hook_timers[c+1]->ms < hook_timers[c]->ms))
+         c++;
+      if (hook_timers[i]->ms <= hook_timers[c]->ms)
+         break;
+      hook_timerSwap( i, c );
+      i = c;
+   }
+}
+
+
+/**
+ * @brief Adds a timer hook to the heap.
+ */
+static void hook_timerPush( Hook *h )
+{
+   if (hook_timers == NULL)
+      hook_timers = array_create( Hook* );
+   h->heap = array_size( hook_timers );
+   array_push_back( &hook_timers, h );
+   hook_timerUp( h->heap );
+}
+
+
+/**
+ * @brief Removes a timer hook from the heap.
+ */
+static void hook_timerRm( Hook *h )
+{
+   int i, n;
+
+   i = h->heap;
+   if (i < 0)
+      return;
+   n = array_size( hook_timers ) - 1;
+   if (i != n)
+      hook_timerSwap( i, n );
+   array_resize( &hook_timers, n );
+   h->heap = -1;
+   if (i != n) {
+      hook_timerUp( i );
+      hook_timerDown( i );
+   }
+}
+
+
 /**
  * @brief Adds a new mission type hook.
  *
@@ -561,7 +740,8 @@ unsigned int hook_addTimerMisn( unsigned int parent, const char *func, double ms
 
    /* Timer information. */
    new_hook->is_timer      = 1;
-   new_hook->ms            = ms;
+   new_hook->ms            = hook_timerClock + ms;
+   hook_timerPush( new_hook );
 
    return new_hook->id;
 }
@@ -588,7 +768,8 @@ unsigned int hook_addTimerEvt( unsigned int parent, const char *func, double ms
 
    /* Timer information. */
    new_hook->is_timer      = 1;
-   new_hook->ms            = ms;
+   new_hook->ms            = hook_timerClock + ms;
+   hook_timerPush( new_hook );
 
    return new_hook->id;
 }
@@ -619,6 +800,8 @@ static void hooks_purgeList (void)
 
          /* Free. */
          h->next = NULL;
+         hook_stackRm( h );
+         hook_timerRm( h );
          hook_free( h );
 
          /* Last. */
@@ -649,21 +832,26 @@ void hooks_updateDate( ntime_t change )
  */
 static void hooks_updateDateExecute( ntime_t change )
 {
-   int j;
+   int j, id;
    Hook *h;
 
    /* Don't update without player. */
    if ((player.p == NULL) || player_isFlag(PLAYER_CREATING))
       return;
 
+   /* Date hooks all live in the "date" stack. */
+   id = hook_stackGet( "date" );
+   if (id < 0)
+      return;
+
    /* Clear creation flags. */
-   for (h=hook_list; h!=NULL; h=h->next)
+   for (h=hook_stacks[id].list; h!=NULL; h=h->snext)
       h->created = 0;
 
    /* On j=0 we increment all timers and try to run, then on j=1 we update the timers. */
    hook_runningstack++; /* running hooks */
    for (j=1; j>=0; j--) {
-      for (h=hook_list; h!=NULL; h=h->next) {
+      for (h=hook_stacks[id].list; h!=NULL; h=h->snext) {
          /* Not be deleting. */
          if (h->delete)
             continue;
@@ -741,7 +929,7 @@ unsigned int hook_addDateEvt( unsigned int parent, const char *func, ntime_t res
  */
 void hooks_update( double dt )
 {
-   int j;
+   int i, j, n;
    Hook *h;
 
    /* Don't update without player. */
@@ -749,35 +937,57 @@ void hooks_update( double dt )
       return;
 
    /* Clear creation flags. */
-   for (h=hook_list; h!=NULL; h=h->next)
-      h->created = 0;
+   for (i=0; i<array_size(hook_timers); i++)
+      hook_timers[i]->created = 0;
 
+   /* On j=1 we run timers that had already expired, on j=0 we advance the clock
+    * and run the ones that expire now. Only expired timers are ever looked at. */
+   if (hook_timersLate == NULL)
+      hook_timersLate = array_create( Hook* );
    hook_runningstack++; /* running hooks */
    for (j=1; j>=0; j--) {
-      for (h=hook_list; h!=NULL; h=h->next) {
+      if (j==0) {
+         hook_timerClock += dt;
+         /* Timers that didn't run on the claimed pass get another try. */
+         n = 0;
+         for (i=0; i<array_size(hook_timersLate); i++) {
+            if (hook_timersLate[i]->created == 0)
+               hook_timerPush( hook_timersLate[i] );
+            else
+               hook_timersLate[n++] = hook_timersLate[i];
+         }
+         array_resize( &hook_timersLate, n );
+      }
+      while ((array_size(hook_timers) > 0) && (hook_timers[0]->ms <= hook_timerClock)) {
+         h = hook_timers[0];
+         hook_timerRm( h );
+
          /* Not be deleting. */
          if (h->delete)
             continue;
-         /* Find valid timer hooks. */
-         if (h->is_timer == 0)
-            continue;
-         /* Don't update newly created hooks. */
-         if (h->created != 0)
-            continue;
-
-         /* Decrement timer and check to see if should run. */
-         if (j==0)
-            h->ms -= dt;
-         if (h->ms > 0.)
+         /* Don't update newly created hooks, they get requeued. */
+         if (h->created != 0) {
+            array_push_back( &hook_timersLate, h );
             continue;
+         }
 
          /* Run the timer hook. */
          hook_run( h, NULL, j );
+         /* Not claimed or main menu open, it gets requeued. */
+         if (!h->delete && !h->ran_once) {
+            array_push_back( &hook_timersLate, h );
+            continue;
+         }
          hook_rmRaw( h );
       }
    }
    hook_runningstack--; /* not running hooks anymore */
 
+   /* Put back timers created while running. */
+   for (i=0; i<array_size(hook_timersLate); i++)
+      hook_timerPush( hook_timersLate[i] );
+   array_resize( &hook_timersLate, 0 );
+
    /* Second pass to delete. */
    hooks_purgeList();
 }
@@ -897,7 +1107,7 @@ int hook_hasEventParent( unsigned int parent )
 
 static int hooks_executeParam( const char* stack, const HookParam *param )
 {
-   int j;
+   int j, id;
    int run;
    Hook *h;
 
@@ -905,17 +1115,21 @@ static int hooks_executeParam( const char* stack, const HookParam *param )
    if ((player.p == NULL) || player_isFlag(PLAYER_DESTROYED))
       return 0;
 
+   /* Nothing was ever hooked to this stack. */
+   id = hook_stackGet( stack );
+   if (id < 0)
+      return 0;
+
    /* Reset the current stack's ran and creation flags. */
-   for (h=hook_list; h!=NULL; h=h->next)
-      if (strcmp(stack, h->stack)==0) {
-         h->ran_once = 0;
-         h->created = 0;
-      }
+   for (h=hook_stacks[id].list; h!=NULL; h=h->snext) {
+      h->ran_once = 0;
+      h->created = 0;
+   }
 
    run = 0;
    hook_runningstack++; /* running hooks */
    for (j=1; j>=0; j--) {
-      for (h=hook_list; h!=NULL; h=h->next) {
+      for (h=hook_stacks[id].list; h!=NULL; h=h->snext) {
          /* Should be deleted. */
          if (h->delete)
             continue;
@@ -925,9 +1139,6 @@ static int hooks_executeParam( const char* stack, const HookParam *param )
          /* Don't update newly created hooks. */
          if (h->created != 0)
             continue;
-         /* Doesn't match stack. */
-         if (strcmp(stack, h->stack) != 0)
-            continue;
 
          /* Run hook. */
          hook_run( h, param, j );
@@ -1105,9 +1316,6 @@ static void hook_free( Hook *h )
    /* Remove from all the pilots. */
    pilots_rmHook( h->id );
 
-   /* Generic freeing. */
-   free( h->stack );
-
    /* Free type specific. */
    switch (h->type) {
       case HOOK_TYPE_MISN:
@@ -1131,6 +1339,7 @@ static void hook_free( Hook *h )
  */
 void hook_cleanup (void)
 {
+   int i;
    Hook *h, *hn;
 
    if (hook_runningstack)
@@ -1147,6 +1356,19 @@ void hook_cleanup (void)
    }
    /* safe defaults just in case */
    hook_list  = NULL;
+
+   /* Clear the stacks and timers. */
+   for (i=0; i<array_size(hook_stacks); i++)
+      free( hook_stacks[i].name );
+   array_free( hook_stacks );
+   hook_stacks = NULL;
+   nhash_free( hook_stackIndex );
+   hook_stackIndex = NULL;
+   array_free( hook_timers );
+   hook_timers = NULL;
+   array_free( hook_timersLate );
+   hook_timersLate = NULL;
+   hook_timerClock = 0.;
 }
 
 
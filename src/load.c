@@ -10,6 +10,7 @@
 
 
 /** @cond */
+#include "libxml/xmlreader.h"
 #include "physfs.h"
 
 #include "naev.h"
@@ -35,6 +36,7 @@
 #include "nxml.h"
 #include "outfit.h"
 #include "player.h"
+#include "save.h"
 #include "shiplog.h"
 #include "space.h"
 #include "toolkit.h"
@@ -87,7 +89,12 @@ static void load_menu_update( unsigned int wid, char *str );
 static void load_menu_close( unsigned int wdw, char *str );
 static void load_menu_load( unsigned int wdw, char *str );
 static void load_menu_delete( unsigned int wdw, char *str );
-static int load_load( nsave_t *save, const char *path );
+static int load_load( nsave_t *save, const char *path, PHYSFS_sint64 size );
+static int load_loadHeader( nsave_t *save, const char *path, PHYSFS_sint64 size );
+static int load_loadStream( nsave_t *save, const char *path );
+static char *load_readerStr( xmlTextReaderPtr reader );
+static char *load_readerAttr( xmlTextReaderPtr reader, const char *name );
+static void load_freeSave( nsave_t *ns );
 static int load_gameInternal( const char* file, const char* version );
 static int load_enumerateCallback( void* data, const char* origdir, const char* fname );
 static int load_sortCompare( const void *p1, const void *p2 );
@@ -98,37 +105,62 @@ static xmlDocPtr load_xml_parsePhysFS( const char* filename );
  * @brief Loads an individual save.
  * @param[out] save Structure to populate.
  * @param path PhysicsFS path (i.e., relative path starting with "saves/").
+ * @param size Size of the save file, used to validate its header.
  */
-static int load_load( nsave_t *save, const char *path )
+static int load_load( nsave_t *save, const char *path, PHYSFS_sint64 size )
 {
-   xmlDocPtr doc;
-   xmlNodePtr root, parent, node, cur;
-   int cycles, periods, seconds;
+   memset( save, 0, sizeof(nsave_t) );
 
+   /* Try the header index first, it's much smaller. */
+   if (load_loadHeader( save, path, size ) == 0)
+      return 0;
+   load_freeSave( save );
    memset( save, 0, sizeof(nsave_t) );
 
-   /* Load the XML. */
-   doc = load_xml_parsePhysFS( path );
-   if (doc == NULL) {
-      WARN( _("Unable to parse save path '%s'."), path);
+   /* Fall back to reading the start of the save itself. */
+   if (load_loadStream( save, path ) == 0)
+      return 0;
+   load_freeSave( save );
+   memset( save, 0, sizeof(nsave_t) );
+   return -1;
+}
+
+
+/**
+ * @brief Loads the information of a save from its header index.
+ *
+ *    @param[out] save Structure to populate.
+ *    @param path PhysicsFS path of the save.
+ *    @param size Size of the save file.
+ *    @return 0 on success, -1 if there is no up to date header.
+ */
+static int load_loadHeader( nsave_t *save, const char *path, PHYSFS_sint64 size )
+{
+   char buf[PATH_MAX];
+   xmlDocPtr doc;
+   xmlNodePtr root, parent, node;
+   int64_t hsize;
+
+   snprintf( buf, sizeof(buf), "%s"SAVE_HEADER_SUFFIX, path );
+   if (!PHYSFS_exists( buf ))
       return -1;
-   }
-   root = doc->xmlChildrenNode; /* base node */
-   if (root == NULL) {
-      WARN( _("Unable to get child node of save '%s'."), path);
+   doc = load_xml_parsePhysFS( buf );
+   if (doc == NULL)
+      return -1;
+   root = doc->xmlChildrenNode;
+   if ((root == NULL) || !xml_isNode(root, "naev_save_header")) {
       xmlFreeDoc(doc);
       return -1;
    }
 
-   /* Save path. */
    save->path = strdup(path);
-
-   /* Iterate inside the naev_save. */
+   hsize = -1;
    parent = root->xmlChildrenNode;
    do {
       xml_onlyNodes(parent);
 
-      /* Info. */
+      xmlr_long(parent, "size", hsize);
+
       if (xml_isNode(parent, "version")) {
          node = parent->xmlChildrenNode;
          do {
@@ -138,32 +170,16 @@ static int load_load( nsave_t *save, const char *path )
          continue;
       }
 
-      else if (xml_isNode(parent, "player")) {
-         /* Get name. */
+      if (xml_isNode(parent, "player")) {
          xmlr_attr_strd(parent, "name", save->name);
-         /* Parse rest. */
          node = parent->xmlChildrenNode;
          do {
             xml_onlyNodes(node);
 
-            /* Player info. */
             xmlr_strd(node, "location", save->planet);
             xmlr_ulong(node, "credits", save->credits);
+            xmlr_long(node, "date", save->date);
 
-            /* Time. */
-            if (xml_isNode(node, "time")) {
-               cur = node->xmlChildrenNode;
-               cycles = periods = seconds = 0;
-               do {
-                  xmlr_int(cur, "SCU", cycles);
-                  xmlr_int(cur, "STP", periods);
-                  xmlr_int(cur, "STU", seconds);
-               } while (xml_nextNode(cur));
-               save->date = ntime_create( cycles, periods, seconds );
-               continue;
-            }
-
-            /* Ship info. */
             if (xml_isNode(node, "ship")) {
                xmlr_attr_strd(node, "name", save->shipname);
                xmlr_attr_strd(node, "model", save->shipmodel);
@@ -173,14 +189,146 @@ static int load_load( nsave_t *save, const char *path )
          continue;
       }
    } while (xml_nextNode(parent));
-
-   /* Clean up. */
    xmlFreeDoc(doc);
 
+   /* Header is stale if the save was written by something else since. */
+   if (hsize != size)
+      return -1;
    return 0;
 }
 
 
+/**
+ * @brief Loads the information of a save by streaming it.
+ *
+ * Only reads up to the end of the player node, which is near the start of
+ *  the save, instead of building the whole document.
+ *
+ *    @param[out] save Structure to populate.
+ *    @param path PhysicsFS path of the save.
+ *    @return 0 on success.
+ */
+static int load_loadStream( nsave_t *save, const char *path )
+{
+   char buf[PATH_MAX];
+   xmlTextReaderPtr reader;
+   const char *name;
+   char *str;
+   int ret, type, depth, sect, intime;
+   int cycles, periods, seconds;
+
+   snprintf( buf, sizeof(buf), "%s/%s", PHYSFS_getWriteDir(), path );
+   reader = xmlReaderForFile( buf, NULL, 0 );
+   if (reader == NULL) {
+      WARN( _("Unable to parse save path '%s'."), path);
+      return -1;
+   }
+
+   /* Save path. */
+   save->path = strdup(path);
+
+   cycles = periods = seconds = 0;
+   sect   = 0; /* 1 inside version, 2 inside player. */
+   intime = 0;
+   while ((ret = xmlTextReaderRead( reader )) == 1) {
+      type  = xmlTextReaderNodeType( reader );
+      depth = xmlTextReaderDepth( reader );
+      name  = (const char*) xmlTextReaderConstName( reader );
+
+      /* Everything we want is before the end of the player. */
+      if (type == XML_READER_TYPE_END_ELEMENT) {
+         if ((depth == 1) && (sect == 2))
+            break;
+         continue;
+      }
+      if (type != XML_READER_TYPE_ELEMENT)
+         continue;
+
+      if (depth == 1) {
+         sect = 0;
+         if (strcmp(name, "version") == 0)
+            sect = 1;
+         else if (strcmp(name, "player") == 0) {
+            sect = 2;
+            save->name = load_readerAttr( reader, "name" );
+         }
+      }
+      else if ((depth == 2) && (sect == 1)) {
+         if (strcmp(name, "naev") == 0)
+            save->version = load_readerStr( reader );
+         else if (strcmp(name, "data") == 0)
+            save->data = load_readerStr( reader );
+      }
+      else if ((depth == 2) && (sect == 2)) {
+         intime = (strcmp(name, "time") == 0);
+         if (strcmp(name, "location") == 0)
+            save->planet = load_readerStr( reader );
+         else if (strcmp(name, "credits") == 0) {
+            str = load_readerStr( reader );
+            save->credits = (str == NULL) ? 0 : strtoull( str, NULL, 10 );
+            free( str );
+         }
+         else if (strcmp(name, "ship") == 0) {
+            save->shipname  = load_readerAttr( reader, "name" );
+            save->shipmodel = load_readerAttr( reader, "model" );
+         }
+      }
+      else if ((depth == 3) && (sect == 2) && intime) {
+         str = load_readerStr( reader );
+         if (str == NULL)
+            continue;
+         if (strcmp(name, "SCU") == 0)
+            cycles = atoi( str );
+         else if (strcmp(name, "STP") == 0)
+            periods = atoi( str );
+         else if (strcmp(name, "STU") == 0)
+            seconds = atoi( str );
+         free( str );
+      }
+   }
+   xmlFreeTextReader( reader );
+
+   if (ret < 0) {
+      WARN( _("Unable to parse save path '%s'."), path);
+      return -1;
+   }
+   save->date = ntime_create( cycles, periods, seconds );
+   return 0;
+}
+
+
+/**
+ * @brief Gets the text of the current node of a reader.
+ */
+static char *load_readerStr( xmlTextReaderPtr reader )
+{
+   xmlChar *str;
+   char *ret;
+   str = xmlTextReaderReadString( reader );
+   if (str == NULL)
+      return NULL;
+   ret = strdup( (char*)str );
+   xmlFree( str );
+   return ret;
+}
+
+
+/**
+ * @brief Gets an attribute of the current node of a reader.
+ */
+static char *load_readerAttr( xmlTextReaderPtr reader, const char *name )
+{
+   xmlChar *str;
+   char *ret;
+   str = xmlTextReaderGetAttribute( reader, (const xmlChar*)name );
+   if (str == NULL)
+      return NULL;
+   ret = strdup( (char*)str );
+   xmlFree( str );
+   return ret;
+}
+
+
 /**
  * @brief Loads or refreshes saved games.
  */
@@ -231,7 +379,7 @@ int load_refresh (void)
       if (!ok)
          ns = &array_grow( &load_saves );
       snprintf( buf, sizeof(buf), "saves/%s", files[i].name );
-      ok = load_load( ns, buf );
+      ok = load_load( ns, buf, files[i].stat.filesize );
    }
 
    /* If the save was invalid, array is 1 member too large. */
@@ -306,23 +454,29 @@ static int load_sortCompare( const void *p1, const void *p2 )
 void load_free (void)
 {
    int i;
-   nsave_t *ns;
 
-   for (i=0; i<array_size(load_saves); i++) {
-      ns = &load_saves[i];
-      free(ns->path);
-      free(ns->name);
-      free(ns->version);
-      free(ns->data);
-      free(ns->planet);
-      free(ns->shipname);
-      free(ns->shipmodel);
-   }
+   for (i=0; i<array_size(load_saves); i++)
+      load_freeSave( &load_saves[i] );
    array_free( load_saves );
    load_saves = NULL;
 }
 
 
+/**
+ * @brief Frees the contents of a save.
+ */
+static void load_freeSave( nsave_t *ns )
+{
+   free(ns->path);
+   free(ns->name);
+   free(ns->version);
+   free(ns->data);
+   free(ns->planet);
+   free(ns->shipname);
+   free(ns->shipmodel);
+}
+
+
 /**
  * @brief Gets the array (array.h) of loaded saves.
  */
@@ -495,6 +649,7 @@ static void load_menu_delete( unsigned int wdw, char *str )
 {
    (void)str;
    char *save;
+   char path[PATH_MAX];
    int wid, pos;
 
    wid = window_get( "wdwLoadGameMenu" );
@@ -510,6 +665,9 @@ static void load_menu_delete( unsigned int wdw, char *str )
    /* Remove it. */
    pos = toolkit_getListPos( wid, "lstSaves" );
    PHYSFS_delete( load_saves[pos].path );
+   snprintf( path, sizeof(path), "%s"SAVE_HEADER_SUFFIX, load_saves[pos].path );
+   if (PHYSFS_exists( path ))
+      PHYSFS_delete( path );
 
    /* need to reload the menu */
    load_menu_close(wdw, NULL);
@@ -117,6 +117,8 @@ static void map_selectCur (void);
 static void map_genModeList(void);
 static void map_update_commod_av_price();
 static void map_window_close( unsigned int wid, char *str );
+/* Pathfinding. */
+static void A_free (void);
 
 
 /**
@@ -157,6 +159,8 @@ void map_exit (void)
 
    gl_freeTexture( gl_faction_disk );
 
+   A_free();
+
    if (decorator_stack != NULL) {
       for (i=0; i<array_size(decorator_stack); i++)
          gl_freeTexture( decorator_stack[i].image );
@@ -2269,131 +2273,141 @@ void map_select( StarSystem *sys, char shifted )
  * none.
  */
 /**
- * @brief Node structure for A* pathfinding.
+ * @brief Node structure for A* pathfinding, pooled and indexed by StarSystem::id.
  */
 typedef struct SysNode_ {
-   struct SysNode_ *next; /**< Next node */
-   struct SysNode_ *gnext; /**< Next node in the garbage collector. */
-
-   struct SysNode_ *parent; /**< Parent node. */
-   StarSystem* sys; /**< System in node. */
+   unsigned int search; /**< Search the node belongs to, stale if not the current one. */
+   int parent; /**< ID of the parent system, -1 if none. */
    int g; /**< step */
+   unsigned int order; /**< Order in which the node was opened, breaks ties. */
+   int heap; /**< Position in the open heap, -1 if closed. */
 } SysNode; /**< System Node for use in A* pathfinding. */
-static SysNode *A_gc;
+static SysNode *A_nodes = NULL; /**< Node pool, one per system. */
+static int *A_open = NULL; /**< Open set, binary heap of system IDs. */
+static unsigned int A_search = 0; /**< Current search. */
+static unsigned int A_order = 0; /**< Amount of nodes opened in the current search. */
 /* prototypes */
-static SysNode* A_newNode( StarSystem* sys );
-static int A_g( SysNode* n );
-static SysNode* A_add( SysNode *first, SysNode *cur );
-static SysNode* A_rm( SysNode *first, StarSystem *cur );
-static SysNode* A_in( SysNode *first, StarSystem *cur );
-static SysNode* A_lowest( SysNode *first );
-static void A_freeList( SysNode *first );
+static void A_reset (void);
+static SysNode* A_node( int id );
+static int A_less( int a, int b );
+static void A_swap( int a, int b );
+static void A_up( int i );
+static void A_down( int i );
+static void A_push( int id, int parent, int g );
+static int A_pop (void);
 static int map_decorator_parse( MapDecorator *temp, xmlNodePtr parent );
-/** @brief Creates a new node link to star system. */
-static SysNode* A_newNode( StarSystem* sys )
+/** @brief Starts a new search, invalidating all the nodes. */
+static void A_reset (void)
 {
-   SysNode* n;
-
-   n        = malloc(sizeof(SysNode));
-
-   n->next  = NULL;
-   n->sys   = sys;
-
-   n->gnext = A_gc;
-   A_gc     = n;
-
-   return n;
+   int n;
+
+   n = array_size( systems_stack );
+   if (array_size( A_nodes ) != n) {
+      array_free( A_nodes );
+      A_nodes  = array_create_size( SysNode, n );
+      array_resize( &A_nodes, n );
+      A_search = 0;
+   }
+   if (A_open == NULL)
+      A_open = array_create_size( int, n );
+   array_resize( &A_open, 0 );
+
+   /* Nodes of older searches are stale, unless the counter wrapped. */
+   A_search++;
+   if (A_search <= 1) {
+      memset( A_nodes, 0, n*sizeof(SysNode) );
+      A_search = 1;
+   }
+   A_order  = 0;
 }
-/** @brief Gets the g from a node. */
-static int A_g( SysNode* n )
+/** @brief Gets the node of a system if it was reached by the current search. */
+static SysNode* A_node( int id )
 {
-   return n->g;
+   if (A_nodes[id].search != A_search)
+      return NULL;
+   return &A_nodes[id];
 }
-/** @brief Adds a node to the linked list. */
-static SysNode* A_add( SysNode *first, SysNode *cur )
+/** @brief Compares two open heap entries, lowest g first, then first opened. */
+static int A_less( int a, int b )
 {
-   SysNode *n;
-
-   if (first == NULL)
-      return cur;
-
-   n = first;
-   while (n->next != NULL)
-      n = n->next;
-   n->next = cur;
-
-   return first;
+   SysNode *na, *nb;
+   na = &A_nodes[ A_open[a] ];
+   nb = &A_nodes[ A_open[b] ];
+   if (na->g != nb->g)
+      return na->g < nb->g;
+   return na->order < nb->order;
 }
-/* @brief Removes a node from a linked list. */
-static SysNode* A_rm( SysNode *first, StarSystem *cur )
+/** @brief Swaps two open heap entries. */
+static void A_swap( int a, int b )
 {
-   SysNode *n, *p;
-
-   if (first->sys == cur) {
-      n = first->next;
-      first->next = NULL;
-      return n;
+   int t;
+   t         = A_open[a];
+   A_open[a] = A_open[b];
+   A_open[b] = t;
+   A_nodes[ A_open[a] ].heap = a;
+   A_nodes[ A_open[b] ].heap = b;
+}
+/** @brief Moves an open heap entry up to its place. */
+static void A_up( int i )
+{
+   while ((i > 0) && A_less( i, (i-1)/2 )) {
+      A_swap( i, (i-1)/2 );
+      i = (i-1)/2;
    }
+}
+/** @brief Moves an open heap entry down to its place. */
+static void A_down( int i )
+{
+   int c, n;
 
-   p = first;
-   n = p->next;
-   do {
-      if (n->sys == cur) {
-         n->next = NULL;
-         p->next = n->next;
+   n = array_size( A_open );
+   while ((c = 2*i+1) < n) {
+      if ((c+1 < n) && A_less( c+1, c ))
+         c++;
+      if (!A_less( c, i ))
          break;
-      }
-      p = n;
-   } while ((n=n->next) != NULL);
-
-   return first;
+      A_swap( i, c );
+      i = c;
+   }
 }
-/** @brief Checks to see if node is in linked list. */
-static SysNode* A_in( SysNode *first, StarSystem *cur )
+/** @brief Opens a node, or updates it if it's already open. */
+static void A_push( int id, int parent, int g )
 {
    SysNode *n;
 
-   if (first == NULL)
-      return NULL;
-
-   n = first;
-   do {
-      if (n->sys == cur)
-         return n;
-   } while ((n=n->next) != NULL);
-   return NULL;
+   n = &A_nodes[id];
+   if ((n->search != A_search) || (n->heap < 0)) {
+      n->search = A_search;
+      n->heap   = array_size( A_open );
+      array_push_back( &A_open, id );
+   }
+   n->parent = parent;
+   n->g      = g;
+   n->order  = A_order++;
+   /* The cost can only go down. */
+   A_up( n->heap );
 }
-/** @brief Returns the lowest ranking node from a linked list of nodes. */
-static SysNode* A_lowest( SysNode *first )
+/** @brief Closes the lowest ranking open node. */
+static int A_pop (void)
 {
-   SysNode *lowest, *n;
-
-   if (first == NULL)
-      return NULL;
-
-   n = first;
-   lowest = n;
-   do {
-      if (n->g < lowest->g)
-         lowest = n;
-   } while ((n=n->next) != NULL);
-   return lowest;
+   int id, n;
+
+   id = A_open[0];
+   n  = array_size( A_open ) - 1;
+   if (n > 0)
+      A_swap( 0, n );
+   array_erase( &A_open, &A_open[n], array_end(A_open) );
+   A_nodes[id].heap = -1;
+   A_down( 0 );
+   return id;
 }
-/** @brief Frees a linked list. */
-static void A_freeList( SysNode *first )
+/** @brief Frees the pathfinding pools. */
+static void A_free (void)
 {
-   SysNode *p, *n;
-
-   if (first == NULL)
-      return;
-
-   p = NULL;
-   n = first;
-   do {
-      free(p);
-      p = n;
-   } while ((n=n->gnext) != NULL);
-   free(p);
+   array_free( A_nodes );
+   A_nodes = NULL;
+   array_free( A_open );
+   A_open = NULL;
 }
 
 /** @brief Sets map_zoom to zoom and recreates the faction disk texture. */
@@ -2415,16 +2429,13 @@ void map_setZoom(double zoom)
 StarSystem** map_getJumpPath( const char* sysstart, const char* sysend,
     int ignore_known, int show_hidden, StarSystem** old_data )
 {
-   int i, j, cost, njumps, ojumps;
+   int i, j, cost, njumps, ojumps, cur, found;
 
-   StarSystem *sys, *ssys, *esys, **res;
+   StarSystem *sys, *ssys, *esys, *csys, **res;
    JumpPoint *jp;
 
-   SysNode *cur,   *neighbour;
-   SysNode *open,  *closed;
-   SysNode *ocost, *ccost;
+   SysNode *node;
 
-   A_gc = NULL;
    res = old_data;
    ojumps = array_size( old_data );
 
@@ -2449,18 +2460,19 @@ StarSystem** map_getJumpPath( const char* sysstart, const char* sysend,
       return NULL;
    }
 
-   /* start the linked lists */
-   open     = closed = NULL;
-   cur      = A_newNode( ssys );
-   cur->parent = NULL;
-   cur->g   = 0;
-   open     = A_add( open, cur ); /* Initial open node is the start system */
+   /* Initial open node is the start system. */
+   A_reset();
+   A_push( ssys->id, -1, 0 );
 
    j = 0;
-   while ((cur = A_lowest(open))) {
+   found = 0;
+   while (array_size(A_open) > 0) {
       /* End condition. */
-      if (cur->sys == esys)
+      cur = A_open[0];
+      if (cur == esys->id) {
+         found = 1;
          break;
+      }
 
       /* Break if infinite loop. */
       j++;
@@ -2468,12 +2480,12 @@ StarSystem** map_getJumpPath( const char* sysstart, const char* sysend,
          break;
 
       /* Get best from open and toss to closed */
-      open   = A_rm( open, cur->sys );
-      closed = A_add( closed, cur );
-      cost   = A_g(cur) + 1; /* Base unit is jump and always increases by 1. */
+      A_pop();
+      csys = system_getIndex( cur );
+      cost = A_nodes[cur].g + 1; /* Base unit is jump and always increases by 1. */
 
-      for (i=0; i<array_size(cur->sys->jumps); i++) {
-         jp  = &cur->sys->jumps[i];
+      for (i=0; i<array_size(csys->jumps); i++) {
+         jp  = &csys->jumps[i];
          sys = jp->target;
 
          /* Make sure it's reachable */
@@ -2490,44 +2502,27 @@ StarSystem** map_getJumpPath( const char* sysstart, const char* sysend,
          if (!show_hidden && jp_isFlag( jp, JP_HIDDEN ))
             continue;
 
-         /* Check to see if it's already in the closed set. */
-         ccost = A_in(closed, sys);
-         if ((ccost != NULL) && (cost >= A_g(ccost)))
+         /* Ignore if it's already open or closed with a path as good. */
+         node = A_node( sys->id );
+         if ((node != NULL) && (cost >= node->g))
             continue;
-            //closed = A_rm( closed, sys );
-
-         /* Remove if it exists and current is better. */
-         ocost = A_in(open, sys);
-         if (ocost != NULL) {
-            if (cost < A_g(ocost))
-               open = A_rm( open, sys ); /* New path is better */
-            else
-               continue; /* This node is worse, so ignore it. */
-         }
 
-         /* Create the node. */
-         neighbour         = A_newNode( sys );
-         neighbour->parent = cur;
-         neighbour->g      = cost;
-         open              = A_add( open, neighbour );
+         /* Open the node, or update it if the new path is better. */
+         A_push( sys->id, cur, cost );
       }
-
-      /* Safety check in case not linked. */
-      if (open == NULL)
-         break;
    }
 
    /* Build path backwards if not broken from loop. */
-   if ( cur != NULL && esys == cur->sys ) {
-      njumps = A_g(cur) + ojumps;
+   if (found) {
+      njumps = A_nodes[cur].g + ojumps;
       assert( njumps > ojumps );
       if (res == NULL)
          res = array_create_size( StarSystem*, njumps );
       array_resize( &res, njumps );
       /* Build path. */
       for (i=0; i<njumps-ojumps; i++) {
-         res[njumps-i-1] = cur->sys;
-         cur = cur->parent;
+         res[njumps-i-1] = system_getIndex( cur );
+         cur = A_nodes[cur].parent;
       }
    }
    else {
@@ -2535,8 +2530,6 @@ StarSystem** map_getJumpPath( const char* sysstart, const char* sysend,
       array_free( old_data );
    }
 
-   /* free the linked lists */
-   A_freeList(A_gc);
    return res;
 }
 
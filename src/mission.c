@@ -156,6 +156,7 @@ MissionData* mission_getFromName( const char* name )
 static int mission_init( Mission* mission, MissionData* misn, int genid, int create, unsigned int *id )
 {
    int ret;
+   char envname[STRMAX_SHORT];
 
    /* clear the mission */
    memset( mission, 0, sizeof(Mission) );
@@ -173,6 +174,8 @@ static int mission_init( Mission* mission, MissionData* misn, int genid, int cre
 
    /* init Lua */
    mission->env = nlua_newEnv(1);
+   snprintf( envname, sizeof(envname), "mission/%s", misn->name );
+   nlua_nameEnv( mission->env, envname );
 
    misn_loadLibs( mission->env ); /* load our custom libraries */
 
@@ -269,7 +272,7 @@ static int mission_meetReq( int mission, int faction,
 
    /* Must meet Lua condition. */
    if (misn->avail.cond != NULL) {
-      c = cond_check(misn->avail.cond);
+      c = cond_checkRef(misn->avail.cond_ref);
       if (c < 0) {
          WARN(_("Conditional for mission '%s' failed to run"), misn->name);
          return 0;
@@ -574,6 +577,7 @@ static void mission_freeData( MissionData* mission )
    free(mission->avail.system);
    array_free(mission->avail.factions);
    free(mission->avail.cond);
+   cond_free(mission->avail.cond_ref);
    free(mission->avail.done);
 
    /* Clear the memory. */
@@ -764,6 +768,7 @@ static int mission_parseXML( MissionData *temp, const xmlNodePtr parent )
 
    /* Defaults. */
    temp->avail.priority = 5;
+   temp->avail.cond_ref = LUA_NOREF;
 
    /* get the name */
    xmlr_attr_strd(parent,"name",temp->name);
@@ -824,6 +829,10 @@ static int mission_parseXML( MissionData *temp, const xmlNodePtr parent )
    MELEMENT((temp->avail.loc!=MIS_AVAIL_NONE) && (temp->avail.chance==0),"chance");
 #undef MELEMENT
 
+   /* Compile the condition once instead of on every check. */
+   if (temp->avail.cond != NULL)
+      temp->avail.cond_ref = cond_compile( temp->avail.cond );
+
    return 0;
 }
 
@@ -28,7 +28,9 @@
 /** @endcond */
 
 #include "ai.h"
+#include "array.h"
 #include "background.h"
+#include "bench.h"
 #include "camera.h"
 #include "cond.h"
 #include "conf.h"
@@ -71,6 +73,7 @@
 #include "physics.h"
 #include "pilot.h"
 #include "player.h"
+#include "profile.h"
 #include "render.h"
 #include "rng.h"
 #include "safelanes.h"
@@ -125,6 +128,7 @@ static void print_SDLversion (void);
 static void loadscreen_load (void);
 static void loadscreen_unload (void);
 static void load_all (void);
+static void load_prefetch (void);
 static void unload_all (void);
 static void window_caption (void);
 /* update */
@@ -165,6 +169,7 @@ int naev_isQuit (void)
 int main( int argc, char** argv )
 {
    char conf_file_path[PATH_MAX], **search_path, **p;
+   int bench_ret = 0;
 
 #ifdef DEBUGGING
    /* Set Debugging flags. */
@@ -248,6 +253,14 @@ int main( int argc, char** argv )
    conf_loadConfig(conf_file_path); /* Lua to parse the configuration file */
    conf_parseCLI( argc, argv ); /* parse CLI arguments */
 
+   /* Benchmarks are silent. */
+   if (conf.bench != NULL)
+      conf.nosound = 1;
+
+   /* Profile Lua from the start so loading is accounted for. */
+   if (conf.lua_profile != NULL)
+      nlua_profileEnable( 1 );
+
    /* Set up I/O. */
    ndata_setupWriteDir();
    log_redirect();
@@ -362,13 +375,20 @@ int main( int argc, char** argv )
    /* Unload load screen. */
    loadscreen_unload();
 
-   /* Start menu. */
-   menu_main();
+   /* Benchmarks run instead of the game. */
+   if (conf.bench != NULL) {
+      bench_ret = bench_run( conf.bench, conf.bench_ticks, conf.bench_bolts, conf.bench_out );
+      quit = 1;
+   }
+   else {
+      /* Start menu. */
+      menu_main();
 
-   LOG( _( "Reached main menu" ) );
+      LOG( _( "Reached main menu" ) );
+   }
 
    /* Force a minimum delay with loading screen */
-   if ((SDL_GetTicks() - time_ms) < NAEV_INIT_DELAY)
+   if (!quit && ((SDL_GetTicks() - time_ms) < NAEV_INIT_DELAY))
       SDL_Delay( NAEV_INIT_DELAY - (SDL_GetTicks() - time_ms) );
    fps_init(); /* initializes the time_ms */
 
@@ -382,7 +402,7 @@ int main( int argc, char** argv )
    while (SDL_PollEvent(&event));
 
    /* Incomplete game note (shows every time version number changes). */
-   if ( conf.lastversion == NULL || naev_versionCompare(conf.lastversion) != 0 ) {
+   if ( !quit && (conf.lastversion == NULL || naev_versionCompare(conf.lastversion) != 0) ) {
       free( conf.lastversion );
       conf.lastversion = strdup( naev_version(0) );
       dialogue_msg(
@@ -425,7 +445,8 @@ int main( int argc, char** argv )
    }
 
    /* Save configuration. */
-   conf_saveConfig(conf_file_path);
+   if (conf.bench == NULL)
+      conf_saveConfig(conf_file_path);
 
    /* data unloading */
    unload_all();
@@ -447,6 +468,8 @@ int main( int argc, char** argv )
    joystick_exit(); /* Releases joystick */
    input_exit(); /* Cleans up keybindings */
    nebu_exit(); /* Destroys the nebula */
+   if (conf.lua_profile != NULL)
+      nlua_profileDump( conf.lua_profile );
    lua_exit(); /* Closes Lua state. */
    render_exit(); /* Cleans up post-processing. */
    gl_exit(); /* Kills video output */
@@ -475,7 +498,7 @@ int main( int argc, char** argv )
    PHYSFS_deinit();
 
    /* all is well */
-   exit(EXIT_SUCCESS);
+   exit((bench_ret == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
 }
 
 
@@ -627,6 +650,35 @@ static void loadscreen_unload (void)
 }
 
 
+/**
+ * @brief Reads and parses the bulk of the data files on the threadpool.
+ *
+ * Only the files are read ahead, all the cross-referencing is still done by
+ * the loaders in load_all() on the main thread.
+ */
+static void load_prefetch (void)
+{
+   const char *dirs[] = { OUTFIT_DATA_PATH, SHIP_DATA_PATH, EVENT_DATA_PATH,
+      MISSION_DATA_PATH, PLANET_DATA_PATH, SYSTEM_DATA_PATH };
+   char **paths, **files;
+   int i, j;
+
+   paths = array_create( char* );
+   for (i=0; i<(int)(sizeof(dirs)/sizeof(dirs[0])); i++) {
+      files = ndata_listRecursive( dirs[i] );
+      for (j=0; j<array_size(files); j++)
+         array_push_back( &paths, files[j] );
+      array_free( files );
+   }
+
+   xml_prefetch( paths );
+
+   for (i=0; i<array_size(paths); i++)
+      free( paths[i] );
+   array_free( paths );
+}
+
+
 /**
  * @brief Loads all the data, makes main() simpler.
  */
@@ -636,6 +688,10 @@ void load_all (void)
    /* We can do fast stuff here. */
    sp_load();
 
+   /* Read the data files in parallel, they get picked up by the loaders. */
+   loadscreen_render( 0., _("Reading Data...") );
+   load_prefetch();
+
    /* order is very important as they're interdependent */
    loadscreen_render( 1./LOADING_STAGES, _("Loading Commodities...") );
    commodity_load(); /* dep for space */
@@ -689,6 +745,7 @@ void load_all (void)
    pilots_init();
    weapon_init();
    player_init(); /* Initialize player stuff. */
+   ndata_prefetchFree(); /* Anything the loaders didn't pick up. */
    loadscreen_render( 1., _("Loading Completed!") );
 }
 /**
@@ -734,14 +791,20 @@ void main_loop( int update )
     * Control FPS.
     */
    fps_control(); /* everyone loves fps control */
+   profile_frame();
 
    /*
     * Handle update.
     */
+   profile_begin( PROFILE_INPUT );
    input_update( real_dt ); /* handle key repeats. */
-   sound_update( real_dt ); /* Update sounds. */
    if (toolkit_isOpen())
       toolkit_update(); /* to simulate key repetition */
+   profile_end( PROFILE_INPUT );
+   profile_begin( PROFILE_SOUND );
+   sound_update( real_dt ); /* Update sounds. */
+   profile_end( PROFILE_SOUND );
+   profile_begin( PROFILE_UPDATE );
    if (!paused && update) {
       /* Important that we pass real_dt here otherwise we get a dt feedback loop which isn't pretty. */
       player_updateAutonav( real_dt );
@@ -751,9 +814,12 @@ void main_loop( int update )
       /* We run the exclusion end here to handle any hooks that are potentially manually triggered by hook.trigger. */
       hook_exclusionEnd( 0. );
    }
+   profile_end( PROFILE_UPDATE );
 
    /* Safe hook should be run every frame regardless of whether game is paused or not. */
+   profile_begin( PROFILE_HOOKS );
    hooks_run( "safe" );
+   profile_end( PROFILE_HOOKS );
 
    /* Checks to see if we want to land. */
    space_checkLand();
@@ -762,9 +828,13 @@ void main_loop( int update )
     * Handle render.
     */
    /* Clear buffer. */
+   profile_begin( PROFILE_RENDER );
    render_all( game_dt, real_dt );
+   profile_end( PROFILE_RENDER );
    /* Draw buffer. */
+   profile_begin( PROFILE_SWAP );
    SDL_GL_SwapWindow( gl_screen.window );
+   profile_end( PROFILE_SWAP );
 }
 
 
@@ -921,6 +991,7 @@ void display_fps( const double dt )
 {
    double x,y;
    double dt_mod_base = 1.;
+   int draws, sprites;
 
    fps_dt  += dt;
    fps_cur += 1.;
@@ -931,9 +1002,15 @@ void display_fps( const double dt )
 
    x = fps_x;
    y = fps_y;
+   /* Sprite statistics are per frame. */
+   gl_batchStats( &draws, &sprites );
    if (conf.fps_show) {
       gl_print( NULL, x, y, NULL, "%3.2f", fps );
       y -= gl_defFont.h + 5.;
+#ifdef DEBUGGING
+      gl_print( NULL, x, y, NULL, "%d/%d", draws, sprites );
+      y -= gl_defFont.h + 5.;
+#endif /* DEBUGGING */
    }
 
    if ((player.p != NULL) && !player_isFlag(PLAYER_DESTROYED) &&
@@ -1005,6 +1082,8 @@ static void update_all (void)
  */
 void update_routine( double dt, int enter_sys )
 {
+   int i, n;
+   double microdt;
    HookParam h[3];
 
    if (!enter_sys) {
@@ -1015,15 +1094,29 @@ void update_routine( double dt, int enter_sys )
    }
 
    /* Update engine stuff. */
+   profile_begin( PROFILE_SPACE );
    space_update(dt);
-   weapons_update(dt);
-   spfx_update(dt, real_dt);
-   pilots_update(dt);
-
-   /* Update camera. */
-   cam_update( dt );
+   profile_end( PROFILE_SPACE );
+   /* Entering a system may use a coarse step, but physics still needs fps_min. */
+   n = ((enter_sys) && (dt > fps_min)) ? (int) ceil( dt / fps_min ) : 1;
+   microdt = dt / (double) n;
+   for (i=0; i<n; i++) {
+      profile_begin( PROFILE_WEAPONS );
+      weapons_update(microdt);
+      profile_end( PROFILE_WEAPONS );
+      profile_begin( PROFILE_SPFX );
+      spfx_update(microdt, real_dt);
+      profile_end( PROFILE_SPFX );
+      profile_begin( PROFILE_PILOTS );
+      pilots_update(microdt);
+      profile_end( PROFILE_PILOTS );
+   }
 
    if (!enter_sys) {
+      /* Update camera. */
+      cam_update( dt );
+
+      profile_begin( PROFILE_HOOKS );
       hook_exclusionEnd( dt );
 
       /* Hook set up. */
@@ -1034,6 +1127,7 @@ void update_routine( double dt, int enter_sys )
       h[2].type = HOOK_PARAM_SENTINEL;
       /* Run the update hook. */
       hooks_runParam( "update", h );
+      profile_end( PROFILE_HOOKS );
    }
 }
 
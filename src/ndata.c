@@ -34,7 +34,29 @@
 #endif /* MACOS */
 #include "log.h"
 #include "nfile.h"
+#include "nhash.h"
 #include "nstring.h"
+#include "threadpool.h"
+
+
+/**
+ * @brief A file read ahead of time by ndata_prefetch().
+ */
+typedef struct NdataPrefetch_ {
+   char *path; /**< Path of the file. */
+   char *buf; /**< Contents of the file, NULL if parsed, taken or unreadable. */
+   size_t size; /**< Size of buf. */
+   void *data; /**< Parsed contents of the file, NULL if not parsed or taken. */
+} NdataPrefetch;
+
+
+/*
+ * Prefetch cache.
+ */
+static NdataPrefetch *ndata_prefetchList = NULL; /**< Prefetched files. */
+static NHash *ndata_prefetchIndex = NULL; /**< Maps paths to ndata_prefetchList. */
+static NdataParser ndata_prefetchParse = NULL; /**< Parser run on the prefetched files. */
+static void (*ndata_prefetchDiscard)( void *data ) = NULL; /**< Frees parsed data nobody took. */
 
 
 /*
@@ -43,6 +65,9 @@
 static void ndata_testVersion (void);
 static int ndata_found (void);
 static int ndata_enumerateCallback( void* data, const char* origdir, const char* fname );
+static void* ndata_readRaw( const char* path, size_t *filesize, int quiet );
+static int ndata_prefetchJob( void *data );
+static NdataPrefetch* ndata_prefetchFind( const char *path );
 
 
 /**
@@ -155,6 +180,32 @@ void ndata_setupReadDirs (void)
  *    @return The file data or NULL on error.
  */
 void* ndata_read( const char* path, size_t *filesize )
+{
+   NdataPrefetch *pf;
+   char *buf;
+
+   /* Hand over the prefetched copy if there is one. */
+   pf = ndata_prefetchFind( path );
+   if ((pf != NULL) && (pf->buf != NULL)) {
+      buf       = pf->buf;
+      pf->buf   = NULL;
+      *filesize = pf->size;
+      return buf;
+   }
+
+   return ndata_readRaw( path, filesize, 0 );
+}
+
+
+/**
+ * @brief Reads a file from the ndata, bypassing the prefetch cache.
+ *
+ *    @param path Path of the file to read.
+ *    @param[out] filesize Stores the size of the file.
+ *    @param quiet Whether or not to hold back warnings.
+ *    @return The file data or NULL on error.
+ */
+static void* ndata_readRaw( const char* path, size_t *filesize, int quiet )
 {
    char *buf;
    PHYSFS_file *file;
@@ -163,13 +214,15 @@ void* ndata_read( const char* path, size_t *filesize )
    PHYSFS_Stat path_stat;
 
    if (!PHYSFS_stat( path, &path_stat )) {
-      WARN( _( "Error occurred while opening '%s': %s" ), path,
-            PHYSFS_getErrorByCode( PHYSFS_getLastErrorCode() ) );
+      if (!quiet)
+         WARN( _( "Error occurred while opening '%s': %s" ), path,
+               PHYSFS_getErrorByCode( PHYSFS_getLastErrorCode() ) );
       *filesize = 0;
       return NULL;
    }
    if (path_stat.filetype != PHYSFS_FILETYPE_REGULAR) {
-      WARN( _( "Error occurred while opening '%s': It is not a regular file" ), path );
+      if (!quiet)
+         WARN( _( "Error occurred while opening '%s': It is not a regular file" ), path );
       *filesize = 0;
       return NULL;
    }
@@ -177,8 +230,9 @@ void* ndata_read( const char* path, size_t *filesize )
    /* Open file. */
    file = PHYSFS_openRead( path );
    if ( file == NULL ) {
-      WARN( _( "Error occurred while opening '%s': %s" ), path,
-            PHYSFS_getErrorByCode( PHYSFS_getLastErrorCode() ) );
+      if (!quiet)
+         WARN( _( "Error occurred while opening '%s': %s" ), path,
+               PHYSFS_getErrorByCode( PHYSFS_getLastErrorCode() ) );
       *filesize = 0;
       return NULL;
    }
@@ -186,8 +240,9 @@ void* ndata_read( const char* path, size_t *filesize )
    /* Get file size. TODO: Don't assume this is always possible? */
    len = PHYSFS_fileLength( file );
    if ( len == -1 ) {
-      WARN( _( "Error occurred while seeking '%s': %s" ), path,
-            PHYSFS_getErrorByCode( PHYSFS_getLastErrorCode() ) );
+      if (!quiet)
+         WARN( _( "Error occurred while seeking '%s': %s" ), path,
+               PHYSFS_getErrorByCode( PHYSFS_getLastErrorCode() ) );
       PHYSFS_close( file );
       *filesize = 0;
       return NULL;
@@ -196,7 +251,8 @@ void* ndata_read( const char* path, size_t *filesize )
    /* Allocate buffer. */
    buf = malloc( len+1 );
    if (buf == NULL) {
-      WARN(_("Out of Memory"));
+      if (!quiet)
+         WARN(_("Out of Memory"));
       PHYSFS_close( file );
       *filesize = 0;
       return NULL;
@@ -208,8 +264,9 @@ void* ndata_read( const char* path, size_t *filesize )
    while ( n < len ) {
       pos = PHYSFS_readBytes( file, &buf[ n ], len - n );
       if ( pos <= 0 ) {
-         WARN( _( "Error occurred while reading '%s': %s" ), path,
-            PHYSFS_getErrorByCode( PHYSFS_getLastErrorCode() ) );
+         if (!quiet)
+            WARN( _( "Error occurred while reading '%s': %s" ), path,
+                  PHYSFS_getErrorByCode( PHYSFS_getLastErrorCode() ) );
          PHYSFS_close( file );
          *filesize = 0;
          free(buf);
@@ -226,6 +283,133 @@ void* ndata_read( const char* path, size_t *filesize )
 }
 
 
+/**
+ * @brief Reads (and optionally parses) a set of files in parallel.
+ *
+ * The results are kept until they are taken by ndata_read() or
+ * ndata_prefetched(), or until ndata_prefetchFree() is called. Only the
+ * reading and parsing is done on the threadpool, so the parser must not touch
+ * any game state.
+ *
+ *    @param paths Array (array.h) of paths of the files to read.
+ *    @param parse Parser run on each file once read, may be NULL.
+ *    @param discard Frees parsed data that was never taken.
+ */
+void ndata_prefetch( char **paths, NdataParser parse, void (*discard)(void *data) )
+{
+   int i, n;
+   NdataPrefetch *pf;
+   ThreadQueue *queue;
+
+   /* Only one batch at a time. */
+   ndata_prefetchFree();
+
+   n = array_size( paths );
+   ndata_prefetchList  = array_create_size( NdataPrefetch, n );
+   ndata_prefetchIndex = nhash_create( n );
+   ndata_prefetchParse = parse;
+   ndata_prefetchDiscard = discard;
+   for (i=0; i<n; i++) {
+      if (nhash_insert( ndata_prefetchIndex, paths[i], array_size(ndata_prefetchList) ))
+         continue;
+      pf = &array_grow( &ndata_prefetchList );
+      memset( pf, 0, sizeof(NdataPrefetch) );
+      pf->path = strdup( paths[i] );
+   }
+
+   /* List doesn't move anymore. */
+   queue = vpool_create();
+   for (i=0; i<array_size(ndata_prefetchList); i++)
+      vpool_enqueue( queue, ndata_prefetchJob, &ndata_prefetchList[i] );
+   vpool_wait( queue );
+}
+
+
+/**
+ * @brief Threadpool job reading and parsing a single prefetched file.
+ *
+ * Errors are left silent, the file is just read again on demand and the
+ * warnings come from there.
+ */
+static int ndata_prefetchJob( void *data )
+{
+   NdataPrefetch *pf = (NdataPrefetch*) data;
+
+   pf->buf = ndata_readRaw( pf->path, &pf->size, 1 );
+   if ((pf->buf == NULL) || (ndata_prefetchParse == NULL))
+      return 0;
+
+   /* Parsed files don't need the raw data anymore. */
+   pf->data = ndata_prefetchParse( pf->path, pf->buf, pf->size );
+   if (pf->data != NULL) {
+      free( pf->buf );
+      pf->buf  = NULL;
+      pf->size = 0;
+   }
+   return 0;
+}
+
+
+/**
+ * @brief Finds a prefetched file.
+ *
+ *    @param path Path of the file to find.
+ *    @return The prefetched file or NULL if it wasn't prefetched.
+ */
+static NdataPrefetch* ndata_prefetchFind( const char *path )
+{
+   int i;
+   i = nhash_get( ndata_prefetchIndex, path );
+   if (i < 0)
+      return NULL;
+   return &ndata_prefetchList[i];
+}
+
+
+/**
+ * @brief Takes the parsed contents of a prefetched file.
+ *
+ *    @param path Path of the file.
+ *    @param[out] data Parsed contents of the file, now owned by the caller.
+ *    @return 1 if the parsed contents were available, 0 otherwise.
+ */
+int ndata_prefetched( const char *path, void **data )
+{
+   NdataPrefetch *pf;
+
+   pf = ndata_prefetchFind( path );
+   if ((pf == NULL) || (pf->data == NULL))
+      return 0;
+   *data    = pf->data;
+   pf->data = NULL;
+   return 1;
+}
+
+
+/**
+ * @brief Frees all the prefetched files that weren't taken.
+ */
+void ndata_prefetchFree (void)
+{
+   int i;
+   NdataPrefetch *pf;
+
+   for (i=0; i<array_size(ndata_prefetchList); i++) {
+      pf = &ndata_prefetchList[i];
+      free( pf->path );
+      free( pf->buf );
+      if ((pf->data != NULL) && (ndata_prefetchDiscard != NULL))
+         ndata_prefetchDiscard( pf->data );
+   }
+   array_free( ndata_prefetchList );
+   ndata_prefetchList = NULL;
+   nhash_free( ndata_prefetchIndex );
+   ndata_prefetchIndex = NULL;
+   ndata_prefetchParse = NULL;
+   ndata_prefetchDiscard = NULL;
+}
+
+
 /**
  * @brief Lists all the visible files in a directory, at any depth.
  *
@@ -75,10 +75,24 @@
 #define INTRO_PATH               "intro"
 #define RESCUE_PATH              "rescue.lua"
 
+/**
+ * @brief Parses a prefetched file, run from the threadpool.
+ *
+ *    @param path Path of the file.
+ *    @param buf Contents of the file.
+ *    @param size Size of buf.
+ *    @return The parsed data, or NULL to keep the raw contents instead.
+ */
+typedef void* (*NdataParser)( const char *path, const char *buf, size_t size );
+
+
 void ndata_setupWriteDir (void);
 void ndata_setupReadDirs (void);
 void* ndata_read( const char* filename, size_t *filesize );
 char** ndata_listRecursive( const char *path );
+void ndata_prefetch( char **paths, NdataParser parse, void (*discard)(void *data) );
+int ndata_prefetched( const char *path, void **data );
+void ndata_prefetchFree (void);
 int ndata_backupIfExists( const char *path );
 int ndata_copyIfExists( const char *path1, const char *path2 );
 int ndata_matchExt( const char *path, const char *ext );
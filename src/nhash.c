@@ -0,0 +1,224 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+/**
+ * @file nhash.c
+ *
+ * @brief Open addressing hash table from strings to indices.
+ *
+ * Used to index the name of things stored in arrays so they can be looked up
+ *  by name without having to go over the whole array. Keys are copied so the
+ *  table stays valid if the indexed names are freed, only insertion is
+ *  supported and the table is meant to be cleared and rebuilt if entries are
+ *  removed or renamed.
+ */
+
+
+/** @cond */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "naev.h"
+/** @endcond */
+
+#include "nhash.h"
+
+
+#define NHASH_MIN    64 /**< Minimum amount of slots. */
+
+
+/**
+ * @brief A slot in the hash table.
+ */
+typedef struct NHashSlot_ {
+   char *key; /**< Key of the slot, NULL if empty. */
+   uint32_t hash; /**< Hash of the key. */
+   int value; /**< Value stored. */
+} NHashSlot;
+
+
+/**
+ * @brief The hash table.
+ */
+struct NHash_ {
+   NHashSlot *slots; /**< Slots, amount is always a power of two. */
+   int nslots; /**< Amount of slots. */
+   int n; /**< Amount of used slots. */
+};
+
+
+/*
+ * Prototypes.
+ */
+static uint32_t nhash_hash( const char *key );
+static int nhash_find( const NHash *h, const char *key, uint32_t hash );
+static void nhash_grow( NHash *h );
+
+
+/**
+ * @brief Hashes a string (FNV-1a).
+ */
+static uint32_t nhash_hash( const char *key )
+{
+   uint32_t hash;
+   const unsigned char *c;
+
+   hash = 2166136261u;
+   for (c=(const unsigned char*)key; *c != '\0'; c++) {
+      hash ^= *c;
+      hash *= 16777619u;
+   }
+   return hash;
+}
+
+
+/**
+ * @brief Finds the slot a key is in or would go into.
+ */
+static int nhash_find( const NHash *h, const char *key, uint32_t hash )
+{
+   int i, mask;
+   const NHashSlot *s;
+
+   mask = h->nslots-1;
+   for (i=hash & mask; ; i=(i+1) & mask) {
+      s = &h->slots[i];
+      if (s->key == NULL)
+         return i;
+      if ((s->hash == hash) && (strcmp(s->key, key)==0))
+         return i;
+   }
+}
+
+
+/**
+ * @brief Doubles the amount of slots of a hash table.
+ */
+static void nhash_grow( NHash *h )
+{
+   int i, j, nold;
+   NHashSlot *old;
+
+   old         = h->slots;
+   nold        = h->nslots;
+   h->nslots  *= 2;
+   h->slots    = calloc( h->nslots, sizeof(NHashSlot) );
+
+   for (i=0; i<nold; i++) {
+      if (old[i].key == NULL)
+         continue;
+      j = nhash_find( h, old[i].key, old[i].hash );
+      h->slots[j] = old[i];
+   }
+   free(old);
+}
+
+
+/**
+ * @brief Creates a hash table.
+ *
+ *    @param size Amount of keys expected.
+ *    @return The newly created hash table.
+ */
+NHash* nhash_create( int size )
+{
+   NHash *h;
+
+   h = calloc( 1, sizeof(NHash) );
+   h->nslots = NHASH_MIN;
+   while (h->nslots < 2*size)
+      h->nslots *= 2;
+   h->slots = calloc( h->nslots, sizeof(NHashSlot) );
+   return h;
+}
+
+
+/**
+ * @brief Frees a hash table.
+ *
+ *    @param h Hash table to free.
+ */
+void nhash_free( NHash *h )
+{
+   if (h == NULL)
+      return;
+   nhash_clear( h );
+   free( h->slots );
+   free( h );
+}
+
+
+/**
+ * @brief Removes all the keys from a hash table.
+ *
+ *    @param h Hash table to clear.
+ */
+void nhash_clear( NHash *h )
+{
+   int i;
+   for (i=0; i<h->nslots; i++)
+      free( h->slots[i].key );
+   memset( h->slots, 0, h->nslots*sizeof(NHashSlot) );
+   h->n = 0;
+}
+
+
+/**
+ * @brief Inserts a key into a hash table.
+ *
+ * If the key is already there it keeps its old value, so inserting the
+ *  elements of an array in order gives the same result as a linear search.
+ *
+ *    @param h Hash table to insert into.
+ *    @param key Key to insert (NULL is ignored).
+ *    @param value Value of the key.
+ *    @return 0 if inserted, 1 if the key was already there.
+ */
+int nhash_insert( NHash *h, const char *key, int value )
+{
+   int i;
+   uint32_t hash;
+   NHashSlot *s;
+
+   if (key == NULL)
+      return 1;
+
+   /* Keep the load factor under one half. */
+   if (2*(h->n+1) > h->nslots)
+      nhash_grow( h );
+
+   hash = nhash_hash( key );
+   i    = nhash_find( h, key, hash );
+   s    = &h->slots[i];
+   if (s->key != NULL)
+      return 1;
+
+   s->key   = strdup( key );
+   s->hash  = hash;
+   s->value = value;
+   h->n++;
+   return 0;
+}
+
+
+/**
+ * @brief Gets the value of a key.
+ *
+ *    @param h Hash table to look in.
+ *    @param key Key to look for.
+ *    @return The value of the key or -1 if not found.
+ */
+int nhash_get( const NHash *h, const char *key )
+{
+   int i;
+
+   if ((h == NULL) || (key == NULL))
+      return -1;
+
+   i = nhash_find( h, key, nhash_hash( key ) );
+   if (h->slots[i].key == NULL)
+      return -1;
+   return h->slots[i].value;
+}
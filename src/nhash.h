@@ -0,0 +1,30 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+#ifndef NHASH_H
+#  define NHASH_H
+
+
+/**
+ * @brief Hash table mapping strings to non-negative indices.
+ */
+typedef struct NHash_ NHash;
+
+
+/*
+ * Create/destroy.
+ */
+NHash* nhash_create( int size );
+void nhash_free( NHash *h );
+void nhash_clear( NHash *h );
+
+/*
+ * Access.
+ */
+int nhash_insert( NHash *h, const char *key, int value );
+int nhash_get( const NHash *h, const char *key );
+
+
+#endif /* NHASH_H */
@@ -9,6 +9,10 @@
  */
 
 /** @cond */
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include "physfs.h"
 
 #include "naev.h"
@@ -16,10 +20,12 @@
 
 #include "nlua.h"
 
+#include "array.h"
 #include "log.h"
 #include "lutf8lib.h"
 #include "ndata.h"
 #include "nfile.h"
+#include "nhash.h"
 #include "nlua_cli.h"
 #include "nlua_commodity.h"
 #include "nlua_data.h"
@@ -49,12 +55,50 @@ lua_State *naevL = NULL;
 nlua_env __NLUA_CURENV = LUA_NOREF;
 
 
+/**
+ * @brief Compiled chunk kept by nlua_loadbuffer().
+ */
+typedef struct LuaChunk_ {
+   char *key; /**< Name the chunk was loaded as followed by the hash of its source. */
+   char *code; /**< Array (array.h): Dumped bytecode. */
+} LuaChunk;
+static LuaChunk *nlua_chunks = NULL; /**< Array (array.h): Compiled chunks. */
+static NHash *nlua_chunkIndex = NULL; /**< Maps chunk keys to nlua_chunks. */
+
+
+/**
+ * @brief A profiled call in progress.
+ */
+typedef struct LuaProfCall_ {
+   int prof; /**< Index in nlua_prof. */
+   Uint64 start; /**< When the call started. */
+   Uint64 child; /**< Time spent in nested calls. */
+   double mem; /**< Lua memory when the call started (KiB). */
+   double childmem; /**< Memory growth of nested calls (KiB). */
+} LuaProfCall;
+static int nlua_profOn           = 0; /**< Whether calls are being profiled. */
+static double nlua_profFreq      = 1.; /**< Performance counter frequency in ticks per ms. */
+static NLuaProfile *nlua_prof    = NULL; /**< Array (array.h): Statistics per environment name. */
+static NHash *nlua_profIndex     = NULL; /**< Maps environment names to nlua_prof. */
+static LuaProfCall nlua_profStack[NLUA_PROFILE_DEPTH]; /**< Calls in progress. */
+static int nlua_profDepth        = 0; /**< Number of calls in progress. */
+
+
 /*
  * prototypes
  */
 static int nlua_require( lua_State* L );
 static lua_State *nlua_newState (void); /* creates a new state */
 static int nlua_loadBasic( lua_State* L );
+static uint64_t nlua_hash( const char *buf, size_t sz );
+static int nlua_dumpWriter( lua_State *L, const void *p, size_t sz, void *ud );
+static void nlua_freeChunks (void);
+static double nlua_profileMem (void);
+static int nlua_profileFind( nlua_env env );
+static int nlua_profileBegin( nlua_env env );
+static void nlua_profileEnd( int slot );
+static int nlua_profileCompare( const void *p1, const void *p2 );
+static void nlua_profileFree (void);
 /* gettext */
 static int nlua_gettext( lua_State *L );
 static int nlua_ngettext( lua_State *L );
@@ -135,6 +179,103 @@ void lua_init(void) {
 void lua_exit(void) {
    lua_close(naevL);
    naevL = NULL;
+   nlua_freeChunks();
+   nlua_profileFree();
+}
+
+
+/**
+ * @brief Loads a chunk of Lua, reusing its bytecode if it was compiled before.
+ *
+ * Chunks are keyed by name and a hash of the source, so the same script loaded
+ * into many environments only gets compiled once.
+ *
+ *    @param L Lua state to load into.
+ *    @param buf Source code of the chunk.
+ *    @param sz Size of buf.
+ *    @param name Name of the chunk, usually the path of the script.
+ *    @return 0 on success, a Lua error code otherwise (as luaL_loadbuffer).
+ */
+int nlua_loadbuffer( lua_State *L, const char *buf, size_t sz, const char *name )
+{
+   int i, ret;
+   char *key;
+   LuaChunk *c;
+
+   /* Generic names such as "string" are shared by different sources, so the
+    * source hash is part of the key. */
+   asprintf( &key, "%s#%016llx", name,
+         (unsigned long long) nlua_hash( buf, sz ) );
+   i = nhash_get( nlua_chunkIndex, key );
+   if (i >= 0) {
+      free( key );
+      return luaL_loadbuffer( L, nlua_chunks[i].code,
+            array_size(nlua_chunks[i].code), name );
+   }
+
+   /* Compile it and keep the bytecode around. */
+   ret = luaL_loadbuffer( L, buf, sz, name );
+   if (ret != 0) {
+      free( key );
+      return ret;
+   }
+
+   if (nlua_chunkIndex == NULL) {
+      nlua_chunks     = array_create( LuaChunk );
+      nlua_chunkIndex = nhash_create( 256 );
+   }
+   nhash_insert( nlua_chunkIndex, key, array_size(nlua_chunks) );
+   c = &array_grow( &nlua_chunks );
+   c->key  = key;
+   c->code = array_create( char );
+   lua_dump( L, nlua_dumpWriter, &c->code );
+   return 0;
+}
+
+
+/**
+ * @brief Hashes Lua source code (FNV-1a).
+ */
+static uint64_t nlua_hash( const char *buf, size_t sz )
+{
+   size_t i;
+   uint64_t h = 14695981039346656037ULL;
+   for (i=0; i<sz; i++) {
+      h ^= (unsigned char) buf[i];
+      h *= 1099511628211ULL;
+   }
+   return h;
+}
+
+
+/**
+ * @brief Appends dumped bytecode to a chunk.
+ */
+static int nlua_dumpWriter( lua_State *L, const void *p, size_t sz, void *ud )
+{
+   char **code = (char**) ud;
+   int n = array_size( *code );
+   (void) L;
+   array_resize( code, n+sz );
+   memcpy( &(*code)[n], p, sz );
+   return 0;
+}
+
+
+/**
+ * @brief Frees the compiled chunks.
+ */
+static void nlua_freeChunks (void)
+{
+   int i;
+   for (i=0; i<array_size(nlua_chunks); i++) {
+      free( nlua_chunks[i].key );
+      array_free( nlua_chunks[i].code );
+   }
+   array_free( nlua_chunks );
+   nlua_chunks = NULL;
+   nhash_free( nlua_chunkIndex );
+   nlua_chunkIndex = NULL;
 }
 
 
@@ -150,9 +291,17 @@ int nlua_dobufenv(nlua_env env,
                   const char *buff,
                   size_t sz,
                   const char *name) {
-   if (luaL_loadbuffer(naevL, buff, sz, name) != 0)
+   if (nlua_loadbuffer(naevL, buff, sz, name) != 0)
       return -1;
    nlua_pushenv(env);
+   /* Environments are named after the first script run in them by default. */
+   lua_pushstring(naevL, "__name");
+   lua_rawget(naevL, -2);
+   if (lua_isnil(naevL, -1)) {
+      lua_pushstring(naevL, name);
+      lua_setfield(naevL, -3, "__name");
+   }
+   lua_pop(naevL, 1);
    lua_setfenv(naevL, -2);
    if (nlua_pcall(env, 0, LUA_MULTRET) != 0)
       return -1;
@@ -248,6 +397,26 @@ void nlua_freeEnv(nlua_env env) {
 }
 
 
+/**
+ * @brief Names an environment, calls into it are profiled under that name.
+ *
+ * Environments sharing a name share their statistics. If not named, an
+ *  environment is named after the first script run in it with nlua_dobufenv().
+ *
+ *    @param env Environment.
+ *    @param name Name to give it.
+ */
+void nlua_nameEnv( nlua_env env, const char *name )
+{
+   nlua_pushenv(env);
+   lua_pushstring(naevL, name);
+   lua_setfield(naevL, -2, "__name");
+   lua_pushnil(naevL);
+   lua_setfield(naevL, -2, "__prof");
+   lua_pop(naevL, 1);
+}
+
+
 /*
  * @brief Push environment table to stack
  *
@@ -502,7 +671,7 @@ static int nlua_require( lua_State* L )
    }
 
    /* Try to process the Lua. */
-   if (luaL_loadbuffer(L, buf, bufsize, path_filename) != 0) {
+   if (nlua_loadbuffer(L, buf, bufsize, path_filename) != 0) {
       lua_error(L);
       return 1;
    }
@@ -635,7 +804,7 @@ int nlua_errTrace( lua_State *L )
  *    @param nresults Number of return values to take.
  */
 int nlua_pcall( nlua_env env, int nargs, int nresults ) {
-   int errf, ret, prev_env;
+   int errf, ret, prev_env, prof;
 
 #if DEBUGGING
    int top = lua_gettop(naevL);
@@ -649,7 +818,10 @@ int nlua_pcall( nlua_env env, int nargs, int nresults ) {
    prev_env = __NLUA_CURENV;
    __NLUA_CURENV = env;
 
+   prof = nlua_profOn ? nlua_profileBegin( env ) : -1;
    ret = lua_pcall(naevL, nargs, nresults, errf);
+   if (prof >= 0)
+      nlua_profileEnd( prof );
 
    __NLUA_CURENV = prev_env;
 
@@ -694,3 +866,241 @@ int nlua_refenvtype( nlua_env env, const char *name, int type )
    lua_pop(naevL, 1);
    return LUA_NOREF;
 }
+
+
+/**
+ * @brief Enables or disables profiling of calls made with nlua_pcall().
+ *
+ * Enabling the profiler when it was disabled clears the statistics.
+ *
+ *    @param enable Whether to enable it.
+ */
+void nlua_profileEnable( int enable )
+{
+   int i;
+   if (enable && !nlua_profOn) {
+      nlua_profFreq  = (double)SDL_GetPerformanceFrequency() / 1000.;
+      nlua_profDepth = 0;
+      for (i=0; i<array_size(nlua_prof); i++) {
+         nlua_prof[i].calls = 0;
+         nlua_prof[i].total = 0.;
+         nlua_prof[i].self  = 0.;
+         nlua_prof[i].max   = 0.;
+         nlua_prof[i].mem   = 0.;
+      }
+   }
+   nlua_profOn = enable;
+}
+
+
+/**
+ * @brief Checks to see if calls are being profiled.
+ */
+int nlua_profileIsEnabled (void)
+{
+   return nlua_profOn;
+}
+
+
+/**
+ * @brief Gets the profiling statistics.
+ *
+ *    @return Array (array.h): Statistics per environment name, may be NULL.
+ */
+const NLuaProfile *nlua_profileGet (void)
+{
+   return nlua_prof;
+}
+
+
+/**
+ * @brief Gets the memory in use by Lua in KiB.
+ */
+static double nlua_profileMem (void)
+{
+   return (double)lua_gc(naevL, LUA_GCCOUNT, 0) +
+         (double)lua_gc(naevL, LUA_GCCOUNTB, 0) / 1024.;
+}
+
+
+/**
+ * @brief Gets the statistics of an environment, creating them if needed.
+ *
+ * The index is cached in the environment so the name only has to be looked
+ *  up on the first call.
+ *
+ *    @param env Environment.
+ *    @return Index in nlua_prof.
+ */
+static int nlua_profileFind( nlua_env env )
+{
+   int id;
+   const char *name;
+   NLuaProfile *p;
+
+   nlua_pushenv(env);                  /* env */
+   lua_pushstring(naevL, "__prof");    /* env, k */
+   lua_rawget(naevL, -2);              /* env, prof */
+   if (lua_isnumber(naevL, -1)) {
+      id = lua_tointeger(naevL, -1);
+      lua_pop(naevL, 2);
+      return id;
+   }
+   lua_pop(naevL, 1);                  /* env */
+
+   lua_pushstring(naevL, "__name");    /* env, k */
+   lua_rawget(naevL, -2);              /* env, name */
+   name = lua_isstring(naevL, -1) ? lua_tostring(naevL, -1) : "unnamed";
+
+   if (nlua_profIndex == NULL)
+      nlua_profIndex = nhash_create( 128 );
+   id = nhash_get( nlua_profIndex, name );
+   if (id < 0) {
+      if (nlua_prof == NULL)
+         nlua_prof = array_create( NLuaProfile );
+      id = array_size( nlua_prof );
+      p  = &array_grow( &nlua_prof );
+      memset( p, 0, sizeof(NLuaProfile) );
+      p->name = strdup( name );
+      nhash_insert( nlua_profIndex, name, id );
+   }
+   lua_pop(naevL, 1);                  /* env */
+
+   lua_pushinteger(naevL, id);         /* env, prof */
+   lua_setfield(naevL, -2, "__prof");  /* env */
+   lua_pop(naevL, 1);
+   return id;
+}
+
+
+/**
+ * @brief Starts timing a call.
+ *
+ *    @param env Environment being called into.
+ *    @return Slot of the call to pass to nlua_profileEnd(), -1 if not timed.
+ */
+static int nlua_profileBegin( nlua_env env )
+{
+   LuaProfCall *c;
+
+   /* Calls nested too deeply count towards their parents. */
+   if (nlua_profDepth >= NLUA_PROFILE_DEPTH)
+      return -1;
+
+   c = &nlua_profStack[ nlua_profDepth ];
+   c->prof     = nlua_profileFind( env );
+   c->child    = 0;
+   c->childmem = 0.;
+   c->mem      = nlua_profileMem();
+   c->start    = SDL_GetPerformanceCounter();
+   return nlua_profDepth++;
+}
+
+
+/**
+ * @brief Stops timing a call.
+ *
+ *    @param slot Slot returned by nlua_profileBegin().
+ */
+static void nlua_profileEnd( int slot )
+{
+   Uint64 dur;
+   double mem;
+   LuaProfCall *c;
+   NLuaProfile *p;
+
+   /* Profiler was restarted during the call. */
+   if (slot != nlua_profDepth-1)
+      return;
+
+   c   = &nlua_profStack[ --nlua_profDepth ];
+   dur = SDL_GetPerformanceCounter() - c->start;
+   mem = nlua_profileMem() - c->mem;
+
+   p = &nlua_prof[ c->prof ];
+   p->calls++;
+   p->total += (double)dur / nlua_profFreq;
+   p->self  += (double)(dur - c->child) / nlua_profFreq;
+   p->max    = MAX( p->max, (double)dur / nlua_profFreq );
+   p->mem   += mem - c->childmem;
+
+   if (nlua_profDepth > 0) {
+      nlua_profStack[ nlua_profDepth-1 ].child    += dur;
+      nlua_profStack[ nlua_profDepth-1 ].childmem += mem;
+   }
+}
+
+
+/**
+ * @brief Sorts profiling statistics by decreasing self time.
+ */
+static int nlua_profileCompare( const void *p1, const void *p2 )
+{
+   const NLuaProfile *a = *(const NLuaProfile**) p1;
+   const NLuaProfile *b = *(const NLuaProfile**) p2;
+   if (a->self > b->self)
+      return -1;
+   else if (a->self < b->self)
+      return +1;
+   return strcmp( a->name, b->name );
+}
+
+
+/**
+ * @brief Writes the profiling statistics as CSV, sorted by self time.
+ *
+ *    @param path Path relative to the write directory.
+ *    @return 0 on success.
+ */
+int nlua_profileDump( const char *path )
+{
+   int i, n;
+   char file[PATH_MAX];
+   const NLuaProfile **sorted;
+   const NLuaProfile *p;
+   FILE *f;
+
+   snprintf( file, sizeof(file), "%s/%s", PHYSFS_getWriteDir(), path );
+   f = fopen( file, "w" );
+   if (f == NULL) {
+      WARN(_("Unable to open '%s' for writing: %s"), file, strerror(errno));
+      return -1;
+   }
+
+   n      = array_size( nlua_prof );
+   sorted = malloc( MAX(n,1) * sizeof(NLuaProfile*) );
+   for (i=0; i<n; i++)
+      sorted[i] = &nlua_prof[i];
+   qsort( sorted, n, sizeof(NLuaProfile*), nlua_profileCompare );
+
+   fprintf( f, "name,calls,total_ms,self_ms,mean_us,max_ms,mem_kib\n" );
+   for (i=0; i<n; i++) {
+      p = sorted[i];
+      if (p->calls == 0)
+         continue;
+      fprintf( f, "\"%s\",%lu,%.3f,%.3f,%.3f,%.3f,%.1f\n", p->name, p->calls,
+            p->total, p->self, 1e3 * p->total / (double)p->calls, p->max, p->mem );
+   }
+
+   free( sorted );
+   fclose( f );
+   LOG(_("Lua profiling data written to '%s'."), file);
+   return 0;
+}
+
+
+/**
+ * @brief Frees the profiling statistics.
+ */
+static void nlua_profileFree (void)
+{
+   int i;
+   for (i=0; i<array_size(nlua_prof); i++)
+      free( nlua_prof[i].name );
+   array_free( nlua_prof );
+   nlua_prof = NULL;
+   nhash_free( nlua_profIndex );
+   nlua_profIndex = NULL;
+   nlua_profOn    = 0;
+   nlua_profDepth = 0;
+}
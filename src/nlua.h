@@ -22,7 +22,24 @@
    (lua_isnoneornil(L,ind) ? (def) : checkfunc(L,ind))
 
 
+#define NLUA_PROFILE_DEPTH 32 /**< Maximum nesting of profiled calls. */
+
+
 typedef int nlua_env;
+
+
+/**
+ * @brief Execution statistics of the environments sharing a name.
+ */
+typedef struct NLuaProfile_ {
+   char *name; /**< Name of the environments (see nlua_nameEnv()). */
+   unsigned long calls; /**< Number of calls into the environments. */
+   double total; /**< Wall time spent in calls including nested calls (ms). */
+   double self; /**< Wall time spent in calls excluding nested calls (ms). */
+   double max; /**< Longest call including nested calls (ms). */
+   double mem; /**< Net Lua memory growth excluding nested calls (KiB). */
+} NLuaProfile;
+
 extern lua_State *naevL;
 extern nlua_env __NLUA_CURENV;
 
@@ -33,6 +50,7 @@ void lua_init(void);
 void lua_exit(void);
 nlua_env nlua_newEnv(int rw);
 void nlua_freeEnv(nlua_env env);
+void nlua_nameEnv( nlua_env env, const char *name );
 void nlua_pushenv(nlua_env env);
 void nlua_setenv(nlua_env env, const char *name);
 void nlua_getenv(nlua_env env, const char *name);
@@ -43,11 +61,20 @@ int nlua_dobufenv(nlua_env env,
                   size_t sz,
                   const char *name);
 int nlua_dofileenv(nlua_env env, const char *filename);
+int nlua_loadbuffer( lua_State *L, const char *buf, size_t sz, const char *name );
 int nlua_loadStandard( nlua_env env );
 int nlua_errTrace( lua_State *L );
 int nlua_pcall( nlua_env env, int nargs, int nresults );
 int nlua_refenv( nlua_env env, const char *name );
 int nlua_refenvtype( nlua_env env, const char *name, int type );
 
+/*
+ * profiling
+ */
+void nlua_profileEnable( int enable );
+int nlua_profileIsEnabled (void);
+const NLuaProfile *nlua_profileGet (void);
+int nlua_profileDump( const char *path );
+
 
 #endif /* NLUA_H */
@@ -16,6 +16,7 @@
 
 #include "nlua_naev.h"
 
+#include "array.h"
 #include "input.h"
 #include "land.h"
 #include "log.h"
@@ -24,6 +25,7 @@
 #include "nluadef.h"
 #include "nstring.h"
 #include "player.h"
+#include "profile.h"
 
 
 static int cache_table = LUA_NOREF; /* No reference. */
@@ -41,6 +43,11 @@ static int naev_eventStart( lua_State *L );
 static int naev_missionStart( lua_State *L );
 static int naevL_conf( lua_State *L );
 static int naevL_cache( lua_State *L );
+static int naevL_profile( lua_State *L );
+static int naevL_profileDump( lua_State *L );
+static int naevL_luaProfile( lua_State *L );
+static int naevL_luaProfileStats( lua_State *L );
+static int naevL_luaProfileDump( lua_State *L );
 static const luaL_Reg naev_methods[] = {
    { "version", naev_Lversion },
    { "lastplayed", naev_lastplayed },
@@ -53,6 +60,11 @@ static const luaL_Reg naev_methods[] = {
    { "missionStart", naev_missionStart },
    { "conf", naevL_conf },
    { "cache", naevL_cache },
+   { "profile", naevL_profile },
+   { "profileDump", naevL_profileDump },
+   { "luaProfile", naevL_luaProfile },
+   { "luaProfileStats", naevL_luaProfileStats },
+   { "luaProfileDump", naevL_luaProfileDump },
    {0,0}
 }; /**< Naev Lua methods. */
 
@@ -365,3 +377,123 @@ static int naevL_cache( lua_State *L )
    lua_rawgeti( L, LUA_REGISTRYINDEX, cache_table );
    return 1;
 }
+
+
+/**
+ * @brief Enables, disables or toggles the frame profiler.
+ *
+ * @usage naev.profile() -- Toggles the profiler
+ * @usage naev.profile( true ) -- Enables the profiler
+ *
+ *    @luatparam[opt] boolean enable Whether to enable the profiler, toggles if omitted.
+ *    @luatreturn boolean Whether the profiler is now enabled.
+ * @luafunc profile
+ */
+static int naevL_profile( lua_State *L )
+{
+   if (lua_isnoneornil(L,1))
+      profile_enable( !profile_isEnabled() );
+   else
+      profile_enable( lua_toboolean(L,1) );
+   lua_pushboolean( L, profile_isEnabled() );
+   return 1;
+}
+
+
+/**
+ * @brief Dumps the frame profiler data to a file in the write directory.
+ *
+ * Files ending in ".json" are written as a Chrome trace, anything else as CSV.
+ *
+ * @usage naev.profileDump( "profile.json" )
+ *
+ *    @luatparam string path Path of the file relative to the write directory.
+ *    @luatreturn boolean true on success.
+ * @luafunc profileDump
+ */
+static int naevL_profileDump( lua_State *L )
+{
+   const char *path = luaL_checkstring(L,1);
+   lua_pushboolean( L, !profile_dump( path ) );
+   return 1;
+}
+
+
+/**
+ * @brief Enables, disables or toggles profiling of Lua calls.
+ *
+ * Calls are accounted to the AI profile, mission, event, outfit or script
+ *  that owns the environment called into. Enabling clears the statistics.
+ *
+ * @usage naev.luaProfile( true )
+ *
+ *    @luatparam[opt] boolean enable Whether to enable profiling, toggles if omitted.
+ *    @luatreturn boolean Whether Lua is now being profiled.
+ * @luafunc luaProfile
+ */
+static int naevL_luaProfile( lua_State *L )
+{
+   if (lua_isnoneornil(L,1))
+      nlua_profileEnable( !nlua_profileIsEnabled() );
+   else
+      nlua_profileEnable( lua_toboolean(L,1) );
+   lua_pushboolean( L, nlua_profileIsEnabled() );
+   return 1;
+}
+
+
+/**
+ * @brief Gets the Lua profiling statistics.
+ *
+ * Each entry has the fields "name", "calls", "total" (ms), "self" (ms),
+ *  "max" (ms) and "mem" (KiB of net Lua memory growth).
+ *
+ * @usage for k,v in ipairs(naev.luaProfileStats()) do print(v.name, v.self) end
+ *
+ *    @luatreturn table Table of statistics per environment name.
+ * @luafunc luaProfileStats
+ */
+static int naevL_luaProfileStats( lua_State *L )
+{
+   int i, n;
+   const NLuaProfile *prof = nlua_profileGet();
+
+   lua_newtable(L);
+   n = 0;
+   for (i=0; i<array_size(prof); i++) {
+      if (prof[i].calls == 0)
+         continue;
+      lua_newtable(L);
+      lua_pushstring(L, prof[i].name);
+      lua_setfield(L, -2, "name");
+      lua_pushnumber(L, prof[i].calls);
+      lua_setfield(L, -2, "calls");
+      lua_pushnumber(L, prof[i].total);
+      lua_setfield(L, -2, "total");
+      lua_pushnumber(L, prof[i].self);
+      lua_setfield(L, -2, "self");
+      lua_pushnumber(L, prof[i].max);
+      lua_setfield(L, -2, "max");
+      lua_pushnumber(L, prof[i].mem);
+      lua_setfield(L, -2, "mem");
+      lua_rawseti(L, -2, ++n);
+   }
+   return 1;
+}
+
+
+/**
+ * @brief Writes the Lua profiling statistics as CSV to a file in the write directory.
+ *
+ * @usage naev.luaProfileDump( "lua_profile.csv" )
+ *
+ *    @luatparam string path Path of the file relative to the write directory.
+ *    @luatreturn boolean true on success.
+ * @luafunc luaProfileDump
+ */
+static int naevL_luaProfileDump( lua_State *L )
+{
+   const char *path = luaL_checkstring(L,1);
+   lua_pushboolean( L, !nlua_profileDump( path ) );
+   return 1;
+}
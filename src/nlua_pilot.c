@@ -812,8 +812,9 @@ static int pilotL_toggleSpawn( lua_State *L )
  */
 static int pilotL_getPilots( lua_State *L )
 {
-   int i, j, k, d;
+   int i, j, k, d, f, n;
    int *factions;
+   char *mask;
    Pilot *const* pilot_stack;
 
    /* Whether or not to get disabled. */
@@ -839,22 +840,31 @@ static int pilotL_getPilots( lua_State *L )
          }
       }
 
+      /* Mask of the factions to get. */
+      n = 0;
+      for (j=0; j<array_size(factions); j++)
+         n = MAX( n, factions[j]+1 );
+      mask = calloc( MAX( n, 1 ), sizeof(char) );
+      for (j=0; j<array_size(factions); j++)
+         if (factions[j] >= 0)
+            mask[ factions[j] ] = 1;
+
       /* Now put all the matching pilots in a table. */
       lua_newtable(L);
       k = 1;
       for (i=0; i<array_size(pilot_stack); i++) {
-         for (j=0; j<array_size(factions); j++) {
-            if ((pilot_stack[i]->faction == factions[j]) &&
-                  (d || !pilot_isDisabled(pilot_stack[i])) &&
-                  !pilot_isFlag(pilot_stack[i], PILOT_DELETE)) {
-               lua_pushnumber(L, k++); /* key */
-               lua_pushpilot(L, pilot_stack[i]->id); /* value */
-               lua_rawset(L,-3); /* table[key] = value */
-            }
+         f = pilot_stack[i]->faction;
+         if ((f >= 0) && (f < n) && mask[f] &&
+               (d || !pilot_isDisabled(pilot_stack[i])) &&
+               !pilot_isFlag(pilot_stack[i], PILOT_DELETE)) {
+            lua_pushnumber(L, k++); /* key */
+            lua_pushpilot(L, pilot_stack[i]->id); /* value */
+            lua_rawset(L,-3); /* table[key] = value */
          }
       }
 
       /* clean up. */
+      free( mask );
       array_free( factions );
    }
    else if ((lua_isnil(L,1)) || (lua_gettop(L) == 0)) {
@@ -889,20 +899,26 @@ static int pilotL_getPilots( lua_State *L )
  */
 static int pilotL_getHostiles( lua_State *L )
 {
-   int i, k, dd;
+   int i, j, k, n;
+   int *idx;
    Pilot *p = luaL_validpilot(L,1);
    double dist = luaL_optnumber(L,2,-1.);
    int dis = lua_toboolean(L,3);
    Pilot *const* pilot_stack;
 
+   /* Only look at the pilots in range when there is one. */
+   pilot_stack = pilot_getAll();
+   idx = NULL;
    if (dist >= 0.)
-      dd = dist*dist;
+      n = pilot_gridRadius( &idx, p->solid->pos.x, p->solid->pos.y, dist );
+   else
+      n = array_size(pilot_stack);
 
    /* Now put all the matching pilots in a table. */
-   pilot_stack = pilot_getAll();
    lua_newtable(L);
    k = 1;
-   for (i=0; i<array_size(pilot_stack); i++) {
+   for (j=0; j<n; j++) {
+      i = (idx != NULL) ? idx[j] : j;
       /* Check if dead. */
       if (pilot_isFlag(pilot_stack[i], PILOT_DELETE))
          continue;
@@ -914,16 +930,13 @@ static int pilotL_getHostiles( lua_State *L )
       /* Check if disabled. */
       if (dis && pilot_isDisabled(pilot_stack[i]))
          continue;
-      /* Check distance if necessary. */
-      if (dist >= 0. &&
-            vect_dist2(&pilot_stack[i]->solid->pos, &p->solid->pos) > dd)
-         continue;
 
       lua_pushnumber(L, k++); /* key */
       lua_pushpilot(L, pilot_stack[i]->id); /* value */
       lua_rawset(L,-3); /* table[key] = value */
    }
 
+   array_free( idx );
    return 1;
 }
 
@@ -1965,6 +1978,7 @@ static int pilotL_setPosition( lua_State *L )
 
    /* Warp pilot to new position. */
    p->solid->pos = *vec;
+   pilot_gridInvalidate();
 
    /* Update if necessary. */
    if (pilot_isPlayer(p))
@@ -19,6 +19,13 @@
 #include "nstring.h"
 
 
+/*
+ * Prototypes.
+ */
+static void* xml_prefetchParse( const char *path, const char *buf, size_t size );
+static void xml_prefetchDiscard( void *data );
+
+
 /**
  * @brief Parses a texture handling the sx and sy elements.
  *
@@ -81,6 +88,10 @@ xmlDocPtr xml_parsePhysFS( const char* filename )
    size_t bufsize;
    xmlDocPtr doc;
 
+   /* Already parsed by xml_prefetch(). */
+   if (ndata_prefetched( filename, (void**)&doc ))
+      return doc;
+
    /* @TODO: Don't slurp?
     * Can we directly create an InputStream backed by PHYSFS_*, or use SAX? */
    buf = ndata_read( filename, &bufsize );
@@ -95,6 +106,42 @@ xmlDocPtr xml_parsePhysFS( const char* filename )
    return doc;
 }
 
+/**
+ * @brief Reads and parses a set of files in parallel ahead of time.
+ *
+ * XML files are parsed and later handed over by xml_parsePhysFS(), other files
+ * are kept raw and handed over by ndata_read(). Unused files are freed with
+ * ndata_prefetchFree().
+ *
+ *    @param paths Array (array.h) of paths of the files to read.
+ */
+void xml_prefetch( char **paths )
+{
+   ndata_prefetch( paths, xml_prefetchParse, xml_prefetchDiscard );
+}
+
+
+/**
+ * @brief Parses the XML files for xml_prefetch().
+ */
+static void* xml_prefetchParse( const char *path, const char *buf, size_t size )
+{
+   if (!ndata_matchExt( path, "xml" ))
+      return NULL;
+   /* Documents that fail to parse are parsed again to get the warnings. */
+   return xmlParseMemory( buf, size );
+}
+
+
+/**
+ * @brief Frees documents prefetched by xml_prefetch() that weren't used.
+ */
+static void xml_prefetchDiscard( void *data )
+{
+   xmlFreeDoc( (xmlDocPtr) data );
+}
+
+
 int xmlw_saveTime( xmlTextWriterPtr writer, const char *name, time_t t )
 {
    xmlw_elem( writer, name, "%lu", t );
@@ -152,6 +152,7 @@ do {if (xmlTextWriterEndDocument(w) < 0) { \
  * Functions for generic complex reading.
  */
 xmlDocPtr xml_parsePhysFS( const char* filename );
+void xml_prefetch( char **paths );
 glTexture* xml_parseTexture( xmlNodePtr node,
       const char *path, int defsx, int defsy,
       const unsigned int flags );
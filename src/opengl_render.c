@@ -42,6 +42,8 @@
 
 
 #define OPENGL_RENDER_VBO_SIZE      256 /**< Size of VBO. */
+#define OPENGL_BATCH_QUADS          1024 /**< Maximum amount of quads in a sprite batch. */
+#define OPENGL_BATCH_VERTEX         9 /**< Floats per batched vertex (position, texture coords, colour, interpolation). */
 
 
 static gl_vbo *gl_renderVBO = 0; /**< VBO for rendering stuff. */
@@ -54,12 +56,26 @@ static gl_vbo *gl_triangleVBO = 0;
 static int gl_renderVBOtexOffset = 0; /**< VBO texture offset. */
 static int gl_renderVBOcolOffset = 0; /**< VBO colour offset. */
 
+static gl_vbo *gl_batchVBO = NULL; /**< Streaming VBO for sprite batches. */
+static GLfloat *gl_batchData = NULL; /**< Vertex data of the current sprite batch. */
+static int gl_batchActive = 0; /**< Nesting depth of gl_batchBegin(). */
+static int gl_batchN = 0; /**< Quads in the current sprite batch. */
+static GLuint gl_batchTexA = 0; /**< First texture of the current sprite batch. */
+static GLuint gl_batchTexB = 0; /**< Second texture of the current sprite batch. */
+static int gl_batchDraws = 0; /**< Sprite draw calls since the last gl_batchStats(). */
+static int gl_batchSprites = 0; /**< Sprites drawn since the last gl_batchStats(). */
+
 /*
  * prototypes
  */
+static void gl_batchQuad( GLuint ta, GLuint tb, double inter,
+      double x, double y, double w, double h, double angle,
+      double tx, double ty, double tw, double th, int vflip, const glColour *c );
+
 
 void gl_beginSolidProgram(gl_Matrix4 projection, const glColour *c)
 {
+   gl_batchFlush();
    glUseProgram(shaders.solid.program);
    glEnableVertexAttribArray(shaders.solid.vertex);
    gl_uniformColor(shaders.solid.color, c);
@@ -76,6 +92,7 @@ void gl_endSolidProgram (void)
 
 void gl_beginSmoothProgram(gl_Matrix4 projection)
 {
+   gl_batchFlush();
    glUseProgram(shaders.smooth.program);
    glEnableVertexAttribArray(shaders.smooth.vertex);
    glEnableVertexAttribArray(shaders.smooth.vertex_color);
@@ -172,6 +189,7 @@ void gl_renderStatus( double x, double y, double w, double h, int ok )
    projection = gl_Matrix4_Translate( projection, x + w/2, y + h/2, 0 );
    projection = gl_Matrix4_Scale( projection, w/2, h/2, 1 );
 
+   gl_batchFlush();
    glUseProgram( shaders.status.program );
    gl_Matrix4_Uniform( shaders.status.projection, projection );
    glUniform1f( shaders.status.ok, ok );
@@ -257,15 +275,23 @@ void gl_blitTexture(  const glTexture* texture,
    double hw, hh;
    gl_Matrix4 projection, tex_mat;
 
+   /* Must have colour for now. */
+   if (c == NULL)
+      c = &cWhite;
+
+   /* Defer to the current batch if there is one. */
+   if (gl_batchActive) {
+      gl_batchQuad( texture->texture, texture->texture, 1.,
+            x, y, w, h, angle, tx, ty, tw, th,
+            texture->flags & OPENGL_TEX_VFLIP, c );
+      return;
+   }
+
    glUseProgram(shaders.texture.program);
 
    /* Bind the texture. */
    glBindTexture( GL_TEXTURE_2D, texture->texture);
 
-   /* Must have colour for now. */
-   if (c == NULL)
-      c = &cWhite;
-
    hw = w/2.;
    hh = h/2.;
 
@@ -296,6 +322,8 @@ void gl_blitTexture(  const glTexture* texture,
 
    /* Draw. */
    glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
+   gl_batchDraws++;
+   gl_batchSprites++;
 
    /* Clear state. */
    glDisableVertexAttribArray( shaders.texture.vertex );
@@ -338,6 +366,19 @@ void gl_blitTextureInterpolate(  const glTexture* ta,
       return;
    }
 
+   /* Must have colour for now. */
+   if (c == NULL)
+      c = &cWhite;
+
+   /* Defer to the current batch if there is one, keeping the texture pair
+    * even in the corner cases so sprites of the same kind stay together. */
+   if (gl_batchActive) {
+      gl_batchQuad( ta->texture, tb->texture, inter,
+            x, y, w, h, 0., tx, ty, tw, th,
+            ta->flags & OPENGL_TEX_VFLIP, c );
+      return;
+   }
+
    /* Corner cases. */
    if (inter == 1.) {
       gl_blitTexture( ta, x, y, w, h, tx, ty, tw, th, c, 0. );
@@ -358,10 +399,6 @@ void gl_blitTextureInterpolate(  const glTexture* ta,
    glActiveTexture( GL_TEXTURE1 );
    glBindTexture( GL_TEXTURE_2D, tb->texture);
 
-   /* Must have colour for now. */
-   if (c == NULL)
-      c = &cWhite;
-
    /* Set the vertex. */
    projection = gl_view_matrix;
    projection = gl_Matrix4_Translate(projection, x, y, 0);
@@ -384,6 +421,8 @@ void gl_blitTextureInterpolate(  const glTexture* ta,
 
    /* Draw. */
    glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
+   gl_batchDraws++;
+   gl_batchSprites++;
 
    /* Clear state. */
    glDisableVertexAttribArray( shaders.texture_interpolate.vertex );
@@ -396,6 +435,169 @@ void gl_blitTextureInterpolate(  const glTexture* ta,
 }
 
 
+/**
+ * @brief Starts batching sprites.
+ *
+ * Until the matching gl_batchEnd(), texture blits are accumulated and drawn
+ *  together in as few draw calls as possible. Anything else drawn through this
+ *  file flushes the batch first so the drawing order is kept, other rendering
+ *  code has to call gl_batchFlush() itself.
+ */
+void gl_batchBegin (void)
+{
+   gl_batchActive++;
+}
+
+
+/**
+ * @brief Stops batching sprites, drawing what is left in the batch.
+ */
+void gl_batchEnd (void)
+{
+   if (gl_batchActive <= 0) {
+      WARN(_("Sprite batch ended without being started!"));
+      return;
+   }
+   gl_batchActive--;
+   if (gl_batchActive == 0)
+      gl_batchFlush();
+}
+
+
+/**
+ * @brief Draws all the sprites accumulated in the current batch.
+ */
+void gl_batchFlush (void)
+{
+   GLsizei stride;
+
+   if (gl_batchN <= 0)
+      return;
+
+   /* Upload the vertex data. */
+   gl_vboData( gl_batchVBO, sizeof(GLfloat) * gl_batchN*6*OPENGL_BATCH_VERTEX,
+         gl_batchData );
+
+   glUseProgram(shaders.texture_batch.program);
+
+   /* Bind the textures. */
+   glActiveTexture( GL_TEXTURE0 );
+   glBindTexture( GL_TEXTURE_2D, gl_batchTexA );
+   glActiveTexture( GL_TEXTURE1 );
+   glBindTexture( GL_TEXTURE_2D, gl_batchTexB );
+   glActiveTexture( GL_TEXTURE0 );
+
+   /* Set the vertex. */
+   stride = sizeof(GLfloat) * OPENGL_BATCH_VERTEX;
+   glEnableVertexAttribArray( shaders.texture_batch.vertex );
+   glEnableVertexAttribArray( shaders.texture_batch.vertex_tex );
+   glEnableVertexAttribArray( shaders.texture_batch.vertex_color );
+   glEnableVertexAttribArray( shaders.texture_batch.vertex_inter );
+   gl_vboActivateAttribOffset( gl_batchVBO, shaders.texture_batch.vertex,
+         0, 2, GL_FLOAT, stride );
+   gl_vboActivateAttribOffset( gl_batchVBO, shaders.texture_batch.vertex_tex,
+         sizeof(GLfloat) * 2, 2, GL_FLOAT, stride );
+   gl_vboActivateAttribOffset( gl_batchVBO, shaders.texture_batch.vertex_color,
+         sizeof(GLfloat) * 4, 4, GL_FLOAT, stride );
+   gl_vboActivateAttribOffset( gl_batchVBO, shaders.texture_batch.vertex_inter,
+         sizeof(GLfloat) * 8, 1, GL_FLOAT, stride );
+
+   /* Set shader uniforms. */
+   glUniform1i( shaders.texture_batch.sampler1, 0 );
+   glUniform1i( shaders.texture_batch.sampler2, 1 );
+   gl_Matrix4_Uniform( shaders.texture_batch.projection, gl_view_matrix );
+
+   /* Draw. */
+   glDrawArrays( GL_TRIANGLES, 0, gl_batchN*6 );
+   gl_batchDraws++;
+   gl_batchN = 0;
+
+   /* Clear state. */
+   glDisableVertexAttribArray( shaders.texture_batch.vertex );
+   glDisableVertexAttribArray( shaders.texture_batch.vertex_tex );
+   glDisableVertexAttribArray( shaders.texture_batch.vertex_color );
+   glDisableVertexAttribArray( shaders.texture_batch.vertex_inter );
+
+   /* anything failed? */
+   gl_checkErr();
+
+   glUseProgram(0);
+}
+
+
+/**
+ * @brief Gets the sprite rendering statistics and resets them.
+ *
+ *    @param[out] draws Draw calls used to render sprites.
+ *    @param[out] sprites Sprites rendered.
+ */
+void gl_batchStats( int *draws, int *sprites )
+{
+   *draws   = gl_batchDraws;
+   *sprites = gl_batchSprites;
+   gl_batchDraws   = 0;
+   gl_batchSprites = 0;
+}
+
+
+/**
+ * @brief Adds a textured quad to the current batch.
+ *
+ * Same parameters as gl_blitTextureInterpolate(), with the rotation of
+ *  gl_blitTexture() and whether or not the texture is vertically flipped.
+ */
+static void gl_batchQuad( GLuint ta, GLuint tb, double inter,
+      double x, double y, double w, double h, double angle,
+      double tx, double ty, double tw, double th, int vflip, const glColour *c )
+{
+   /* Corners of the quad as two triangles. */
+   static const GLfloat qx[6] = { 0., 1., 0., 0., 1., 1. };
+   static const GLfloat qy[6] = { 0., 0., 1., 1., 0., 1. };
+   int i;
+   GLfloat *v;
+   double hw, hh, ca, sa, px, py;
+
+   /* Texture change or full batch. */
+   if ((gl_batchN > 0) && ((gl_batchN >= OPENGL_BATCH_QUADS) ||
+            (gl_batchTexA != ta) || (gl_batchTexB != tb)))
+      gl_batchFlush();
+   gl_batchTexA = ta;
+   gl_batchTexB = tb;
+
+   hw = w/2.;
+   hh = h/2.;
+   if (angle == 0.) {
+      ca = 1.;
+      sa = 0.;
+   }
+   else {
+      ca = cos(angle);
+      sa = sin(angle);
+   }
+
+   /* Rotate around the center like gl_blitTexture(). */
+   v = &gl_batchData[ gl_batchN*6*OPENGL_BATCH_VERTEX ];
+   for (i=0; i<6; i++) {
+      px = qx[i]*w - hw;
+      py = qy[i]*h - hh;
+      v[0] = x + hw + ca*px - sa*py;
+      v[1] = y + hh + sa*px + ca*py;
+      v[2] = tx + qx[i]*tw;
+      v[3] = ty + qy[i]*th;
+      if (vflip)
+         v[3] = 1. - v[3];
+      v[4] = c->r;
+      v[5] = c->g;
+      v[6] = c->b;
+      v[7] = c->a;
+      v[8] = inter;
+      v += OPENGL_BATCH_VERTEX;
+   }
+   gl_batchN++;
+   gl_batchSprites++;
+}
+
+
 /**
  * @brief Converts in-game coordinates to screen coordinates.
  *
@@ -734,6 +936,7 @@ void gl_drawCircleH( const gl_Matrix4 *H, const glColour *c, int filled )
    // TODO handle shearing and different x/y scaling
    GLfloat r = H->m[0][0] / gl_view_matrix.m[0][0];
 
+   gl_batchFlush();
    if (filled) {
       glUseProgram( shaders.circle_filled.program );
 
@@ -816,6 +1019,7 @@ void gl_drawCirclePartialH( const gl_Matrix4 *H, const glColour *c, double angle
    GLfloat r = H->m[0][0] / gl_view_matrix.m[0][0];
 
    /* Draw. */
+   gl_batchFlush();
    glUseProgram( shaders.circle_partial.program );
 
    glEnableVertexAttribArray( shaders.circle_partial.vertex );
@@ -886,6 +1090,7 @@ void gl_clipRect( int x, int y, int w, int h )
    ry = (y + gl_screen.y) / gl_screen.myscale;
    rw = w / gl_screen.mxscale;
    rh = h / gl_screen.myscale;
+   gl_batchFlush();
    glScissor( rx, ry, rw, rh );
    glEnable( GL_SCISSOR_TEST );
 }
@@ -896,6 +1101,7 @@ void gl_clipRect( int x, int y, int w, int h )
  */
 void gl_unclipRect (void)
 {
+   gl_batchFlush();
    glDisable( GL_SCISSOR_TEST );
    glScissor( 0, 0, gl_screen.rw, gl_screen.rh );
 }
@@ -916,6 +1122,13 @@ int gl_initRender (void)
    gl_renderVBOtexOffset = sizeof(GLfloat) * OPENGL_RENDER_VBO_SIZE*2;
    gl_renderVBOcolOffset = sizeof(GLfloat) * OPENGL_RENDER_VBO_SIZE*(2+2);
 
+   /* Initialize the sprite batch. */
+   gl_batchData = malloc( sizeof(GLfloat) * OPENGL_BATCH_QUADS*6*OPENGL_BATCH_VERTEX );
+   gl_batchVBO = gl_vboCreateStream( sizeof(GLfloat) *
+         OPENGL_BATCH_QUADS*6*OPENGL_BATCH_VERTEX, NULL );
+   gl_batchActive = 0;
+   gl_batchN = 0;
+
    vertex[0] = 0.;
    vertex[1] = 0.;
    vertex[2] = 1.;
@@ -993,5 +1206,9 @@ void gl_exitRender (void)
    gl_vboDestroy( gl_crossVBO );
    gl_vboDestroy( gl_lineVBO );
    gl_vboDestroy( gl_triangleVBO );
+   gl_vboDestroy( gl_batchVBO );
    gl_renderVBO = NULL;
+   gl_batchVBO = NULL;
+   free( gl_batchData );
+   gl_batchData = NULL;
 }
@@ -75,6 +75,12 @@ void gl_blitScaleAspect( const glTexture* texture,
 void gl_blitStatic( const glTexture* texture,
       const double bx, const double by, const glColour *c );
 
+/* Sprite batching. */
+void gl_batchBegin (void);
+void gl_batchEnd (void);
+void gl_batchFlush (void);
+void gl_batchStats( int *draws, int *sprites );
+
 
 extern gl_vbo *gl_squareVBO;
 extern gl_vbo *gl_circleVBO;
@@ -31,13 +31,17 @@
 /*
  * graphic list
  */
+#define TEX_BUCKETS     512 /**< Number of texture hash buckets, must be a power of two. */
+#define TEX_UNUSED_MAX  256 /**< Maximum number of unused textures kept loaded. */
 /**
  * @brief Represents a node in the texture list.
  */
 typedef struct glTexList_ {
-   struct glTexList_ *next; /**< Next in linked list */
+   struct glTexList_ *next; /**< Next in the hash bucket. */
+   struct glTexList_ *uprev; /**< More recently released unused texture. */
+   struct glTexList_ *unext; /**< Less recently released unused texture. */
    glTexture *tex; /**< associated texture */
-   int used; /**< counts how many times texture is being used */
+   int used; /**< counts how many times texture is being used, 0 if in the unused list */
    /* TODO We currently treat images with different number of sprites as
     * different images, i.e., they get reloaded and use more memory. However,
     * it should be possible to do something fancier and share the texture to
@@ -45,7 +49,10 @@ typedef struct glTexList_ {
    int sx; /**< X sprites */
    int sy; /**< Y sprites */
 } glTexList;
-static glTexList* texture_list = NULL; /**< Texture list. */
+static glTexList* texture_list[TEX_BUCKETS]; /**< Texture hash table, bucketed by path. */
+static glTexList* texture_unused = NULL; /**< Most recently released unused texture. */
+static glTexList* texture_unusedLast = NULL; /**< Least recently released unused texture. */
+static int texture_nunused = 0; /**< Number of unused textures kept. */
 
 
 /*
@@ -61,8 +68,14 @@ static GLuint gl_loadSurface( SDL_Surface* surface, unsigned int flags, int free
 static glTexture* gl_loadNewImage( const char* path, unsigned int flags );
 static glTexture* gl_loadNewImageRWops( const char *path, SDL_RWops *rw, unsigned int flags );
 /* List. */
+static unsigned int gl_texBucket( const char* path );
+static glTexList* gl_texFind( const glTexture *tex );
 static glTexture* gl_texExists( const char* path, int sx, int sy );
 static int gl_texAdd( glTexture *tex, int sx, int sy );
+static void gl_texUse( glTexList *cur );
+static void gl_texRelease( glTexList *cur );
+static void gl_texEvict( glTexList *cur );
+static void gl_texFree( glTexture *texture );
 
 
 /**
@@ -508,6 +521,42 @@ glTexture* gl_loadImage( SDL_Surface* surface, unsigned int flags )
 }
 
 
+/**
+ * @brief Gets the hash bucket of a texture path (FNV-1a).
+ */
+static unsigned int gl_texBucket( const char* path )
+{
+   unsigned int h = 2166136261u;
+   for (; *path != '\0'; path++) {
+      h ^= (unsigned char) *path;
+      h *= 16777619u;
+   }
+   return h & (TEX_BUCKETS-1);
+}
+
+
+/**
+ * @brief Gets the list node of a texture.
+ *
+ *    @param tex Texture to find.
+ *    @return The node, or NULL if the texture is not in the list.
+ */
+static glTexList* gl_texFind( const glTexture *tex )
+{
+   glTexList *cur;
+
+   /* Only named textures are in the list. */
+   if (tex->name == NULL)
+      return NULL;
+
+   for (cur=texture_list[ gl_texBucket(tex->name) ]; cur!=NULL; cur=cur->next)
+      if (cur->tex == tex)
+         return cur;
+
+   return NULL;
+}
+
+
 /**
  * @brief Check to see if a texture matching a path already exists.
  *
@@ -525,13 +574,11 @@ static glTexture* gl_texExists( const char* path, int sx, int sy )
       return NULL;
 
    /* check to see if it already exists */
-   if (texture_list != NULL) {
-      for (cur=texture_list; cur!=NULL; cur=cur->next) {
-         if ((strcmp(path,cur->tex->name)==0) &&
-               (cur->sx==sx) && (cur->sy==sy)) {
-            cur->used += 1;
-            return cur->tex;
-         }
+   for (cur=texture_list[ gl_texBucket(path) ]; cur!=NULL; cur=cur->next) {
+      if ((cur->sx==sx) && (cur->sy==sy) &&
+            (strcmp(path,cur->tex->name)==0)) {
+         gl_texUse( cur );
+         return cur->tex;
       }
    }
 
@@ -544,26 +591,118 @@ static glTexture* gl_texExists( const char* path, int sx, int sy )
  */
 static int gl_texAdd( glTexture *tex, int sx, int sy )
 {
-   glTexList *new, *last = texture_list;
+   glTexList *new, *cur, *next;
+   unsigned int b;
+
+   b = gl_texBucket( tex->name );
+
+   /* Unused textures under the same name are outdated now. */
+   for (cur=texture_list[b]; cur!=NULL; cur=next) {
+      next = cur->next;
+      if ((cur->used == 0) && (cur->sx==sx) && (cur->sy==sy) &&
+            (strcmp(tex->name,cur->tex->name)==0))
+         gl_texEvict( cur );
+   }
 
    /* Create the new node */
-   new = malloc( sizeof(glTexList) );
-   new->next = NULL;
+   new = calloc( 1, sizeof(glTexList) );
    new->used = 1;
    new->tex  = tex;
    new->sx   = sx;
    new->sy   = sy;
 
-   if (texture_list == NULL) /* special condition - creating new list */
-      texture_list = new;
-   else {
-      while (last->next != NULL)
-         last = last->next;
+   new->next = texture_list[b];
+   texture_list[b] = new;
+
+   return 0;
+}
+
 
-      last->next = new;
+/**
+ * @brief Marks a texture as used once more, taking it out of the unused list if needed.
+ */
+static void gl_texUse( glTexList *cur )
+{
+   if (cur->used == 0) {
+      if (cur->uprev == NULL)
+         texture_unused = cur->unext;
+      else
+         cur->uprev->unext = cur->unext;
+      if (cur->unext == NULL)
+         texture_unusedLast = cur->uprev;
+      else
+         cur->unext->uprev = cur->uprev;
+      cur->uprev = NULL;
+      cur->unext = NULL;
+      texture_nunused--;
    }
+   cur->used++;
+}
 
-   return 0;
+
+/**
+ * @brief Releases a use of a texture.
+ *
+ * Textures that are no longer used are kept loaded in case they get requested
+ *  again (as when going back to a system), until too many pile up.
+ */
+static void gl_texRelease( glTexList *cur )
+{
+   cur->used--;
+   if (cur->used > 0)
+      return;
+
+   /* Put at the front of the unused list. */
+   cur->used  = 0;
+   cur->uprev = NULL;
+   cur->unext = texture_unused;
+   if (texture_unused != NULL)
+      texture_unused->uprev = cur;
+   else
+      texture_unusedLast = cur;
+   texture_unused = cur;
+   texture_nunused++;
+
+   /* Get rid of the ones that have been unused the longest. */
+   while (texture_nunused > TEX_UNUSED_MAX)
+      gl_texEvict( texture_unusedLast );
+}
+
+
+/**
+ * @brief Frees an unused texture and removes it from the list.
+ */
+static void gl_texEvict( glTexList *cur )
+{
+   glTexList **prev;
+
+   /* Take out of the unused list. */
+   gl_texUse( cur );
+
+   /* Take out of the hash bucket. */
+   for (prev=&texture_list[ gl_texBucket(cur->tex->name) ]; *prev!=NULL; prev=&(*prev)->next) {
+      if (*prev == cur) {
+         *prev = cur->next;
+         break;
+      }
+   }
+
+   gl_texFree( cur->tex );
+   free( cur );
+}
+
+
+/**
+ * @brief Frees the data of a texture.
+ */
+static void gl_texFree( glTexture *texture )
+{
+   glDeleteTextures( 1, &texture->texture );
+   free(texture->trans);
+   free(texture->name);
+   free(texture);
+
+   gl_checkErr();
 }
 
 
@@ -751,37 +890,16 @@ glTexture* gl_newSpriteRWops( const char* path, SDL_RWops *rw,
  */
 void gl_freeTexture( glTexture* texture )
 {
-   glTexList *cur, *last;
+   glTexList *cur;
 
    if (texture == NULL)
       return;
 
    /* see if we can find it in stack */
-   last = NULL;
-   for (cur=texture_list; cur!=NULL; cur=cur->next) {
-      if (cur->tex == texture) { /* found it */
-         cur->used--;
-         if (cur->used <= 0) { /* not used anymore */
-            /* free the texture */
-            glDeleteTextures( 1, &texture->texture );
-            free(texture->trans);
-            free(texture->name);
-            free(texture);
-
-            /* free the list node */
-            if (last == NULL) { /* case there's no texture before it */
-               if (cur->next != NULL)
-                  texture_list = cur->next;
-               else /* case it's the last texture */
-                  texture_list = NULL;
-            }
-            else
-               last->next = cur->next;
-            free(cur);
-         }
-         return; /* we already found it so we can exit */
-      }
-      last = cur;
+   cur = gl_texFind( texture );
+   if (cur != NULL) {
+      gl_texRelease( cur );
+      return;
    }
 
    /* Not found */
@@ -789,12 +907,7 @@ void gl_freeTexture( glTexture* texture )
       WARN(_("Attempting to free texture '%s' not found in stack!"), texture->name);
 
    /* Free anyways */
-   glDeleteTextures( 1, &texture->texture );
-   free(texture->trans);
-   free(texture->name);
-   free(texture);
-
-   gl_checkErr();
+   gl_texFree( texture );
 }
 
 
@@ -813,13 +926,10 @@ glTexture* gl_dupTexture( glTexture *texture )
       return NULL;
 
    /* check to see if it already exists */
-   if (texture_list != NULL) {
-      for (cur=texture_list; cur!=NULL; cur=cur->next) {
-         if (texture == cur->tex) {
-            cur->used += 1;
-            return cur->tex;
-         }
-      }
+   cur = gl_texFind( texture );
+   if (cur != NULL) {
+      gl_texUse( cur );
+      return cur->tex;
    }
 
    /* Invalid texture. */
@@ -927,13 +1037,22 @@ int gl_initTextures (void)
  */
 void gl_exitTextures (void)
 {
+   int i, leak;
    glTexList *tex;
 
+   /* Free the textures nobody uses anymore. */
+   while (texture_unusedLast != NULL)
+      gl_texEvict( texture_unusedLast );
+
    /* Make sure there's no texture leak */
-   if (texture_list != NULL) {
-      DEBUG(_("Texture leak detected!"));
-      for (tex=texture_list; tex!=NULL; tex=tex->next)
+   leak = 0;
+   for (i=0; i<TEX_BUCKETS; i++) {
+      for (tex=texture_list[i]; tex!=NULL; tex=tex->next) {
+         if (!leak)
+            DEBUG(_("Texture leak detected!"));
+         leak = 1;
          DEBUG( n_( "   '%s' opened %d time", "   '%s' opened %d times", tex->used ), tex->tex->name, tex->used );
+      }
    }
 }
 
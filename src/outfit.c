@@ -30,6 +30,7 @@
 #include "mapData.h"
 #include "ndata.h"
 #include "nfile.h"
+#include "nhash.h"
 #include "nlua.h"
 #include "nlua_gfx.h"
 #include "nlua_pilotoutfit.h"
@@ -55,6 +56,7 @@
  * the stack
  */
 static Outfit* outfit_stack = NULL; /**< Stack of outfits. */
+static NHash *outfit_names = NULL; /**< Index of the outfit stack by name. */
 
 
 /*
@@ -103,9 +105,9 @@ Outfit* outfit_get( const char* name )
 {
    int i;
 
-   for (i=0; i<array_size(outfit_stack); i++)
-      if (strcmp(name,outfit_stack[i].name)==0)
-         return &outfit_stack[i];
+   i = nhash_get( outfit_names, name );
+   if (i >= 0)
+      return &outfit_stack[i];
 
    WARN(_("Outfit '%s' not found in stack."), name);
    return NULL;
@@ -121,9 +123,9 @@ Outfit* outfit_get( const char* name )
 Outfit* outfit_getW( const char* name )
 {
    int i;
-   for (i=0; i<array_size(outfit_stack); i++)
-      if (strcmp(name,outfit_stack[i].name)==0)
-         return &outfit_stack[i];
+   i = nhash_get( outfit_names, name );
+   if (i >= 0)
+      return &outfit_stack[i];
    return NULL;
 }
 
@@ -1749,6 +1751,7 @@ static void outfit_parseSMod( Outfit* temp, const xmlNodePtr parent )
       if (xml_isNode(node,"lua")) {
          nlua_env env;
          size_t sz;
+         char envname[STRMAX_SHORT];
          char *dat = ndata_read( xml_get(node), &sz );
          if (dat==NULL) {
             WARN(_("Outfit '%s' failed to read Lua '%s'!"), temp->name, xml_get(node) );
@@ -1757,6 +1760,8 @@ static void outfit_parseSMod( Outfit* temp, const xmlNodePtr parent )
 
          env = nlua_newEnv(1);
          temp->u.mod.lua_env = env;
+         snprintf( envname, sizeof(envname), "outfit/%s", temp->name );
+         nlua_nameEnv( env, envname );
          /* TODO limit libraries here. */
          nlua_loadStandard( env );
          nlua_loadGFX( env );
@@ -2482,6 +2487,12 @@ int outfit_load (void)
    array_shrink(&outfit_stack);
    noutfits = array_size(outfit_stack);
 
+   /* Index by name. */
+   nhash_free( outfit_names );
+   outfit_names = nhash_create( noutfits );
+   for (i=0; i<noutfits; i++)
+      nhash_insert( outfit_names, outfit_stack[i].name, i );
+
    /* Second pass, sets up ammunition relationships. */
    for (i=0; i<noutfits; i++) {
       o = &outfit_stack[i];
@@ -2732,5 +2743,7 @@ void outfit_free (void)
    }
 
    array_free(outfit_stack);
+   nhash_free( outfit_names );
+   outfit_names = NULL;
 }
 
@@ -46,12 +46,63 @@
 #include "pause.h"
 #include "player.h"
 #include "player_autonav.h"
+#include "profile.h"
 #include "rng.h"
+#include "threadpool.h"
 #include "weapon.h"
 
 
 #define PILOT_SIZE_MIN 128 /**< Minimum chunks to increment pilot_stack by */
 
+#define PILOT_INTEGRATE_CHUNK 16 /**< Pilots integrated by a single threadpool job. */
+#define PILOT_INTEGRATE_MIN   64 /**< Minimum number of pilots to integrate with the threadpool. */
+
+#define PILOT_MOVE_NONE       0 /**< Pilot does not move. */
+#define PILOT_MOVE_DISABLED   1 /**< Pilot drifts as if disabled. */
+#define PILOT_MOVE_NORMAL     2 /**< Pilot moves normally. */
+
+
+/**
+ * @brief Work left on a pilot once the serial part of its update is done.
+ */
+typedef struct PilotUpdate_ {
+   unsigned int id;  /**< ID of the pilot being updated. */
+   Pilot *p;         /**< Pilot, only valid while integrating. */
+   double dt;        /**< Delta tick already modified by the time speedup. */
+   int heat;         /**< Whether or not to do heat conduction. */
+   int regen;        /**< Whether or not to regenerate armour and shield. */
+   int move;         /**< How the pilot moves, one of PILOT_MOVE_*. */
+} PilotUpdate;
+
+/**
+ * @brief Parameters of the nearest enemy searches.
+ */
+typedef struct PilotEnemyQuery_ {
+   const Pilot *p;         /**< Pilot looking for enemies. */
+   double mass_LB;         /**< Lower bound of the target mass. */
+   double mass_UB;         /**< Upper bound of the target mass. */
+   double mass_factor;     /**< Heuristic target mass parameter. */
+   double health_factor;   /**< Heuristic target health parameter. */
+   double damage_factor;   /**< Heuristic target damage parameter. */
+   double range_factor;    /**< Heuristic range weighting. */
+} PilotEnemyQuery;
+
+/**
+ * @brief Parameters of the nearest pilot search.
+ */
+typedef struct PilotNearestQuery_ {
+   const Pilot *p;         /**< Pilot looking for a target. */
+   int disabled;           /**< Whether to return disabled pilots. */
+} PilotNearestQuery;
+
+/**
+ * @brief Chunk of pilots integrated by a threadpool job.
+ */
+typedef struct PilotIntegrateJob_ {
+   PilotUpdate *u;   /**< First pilot of the chunk. */
+   int n;            /**< Number of pilots in the chunk. */
+} PilotIntegrateJob;
+
 /* ID Generators. */
 static unsigned int pilot_id = PLAYER_ID; /**< Stack of pilot ids to assure uniqueness */
 
@@ -60,6 +111,12 @@ static unsigned int pilot_id = PLAYER_ID; /**< Stack of pilot ids to assure uniq
 static Pilot** pilot_stack = NULL; /**< All the pilots in space. (Player may have other Pilot objects, e.g. backup ships.) */
 
 
+/* Neighbour queries. */
+static int *pilot_nearest = NULL; /**< Array (array.h): Results of the last neighbour query. */
+static signed char *pilot_enemyMask = NULL; /**< Array (array.h): Cached hostility of each faction towards pilot_enemyFaction, -1 if not known yet. */
+static int pilot_enemyFaction = -1; /**< Faction pilot_enemyMask is for. */
+
+
 /* misc */
 static const double pilot_commTimeout  = 15.; /**< Time for text above pilot to time out. */
 static const double pilot_commFade     = 5.; /**< Time for text above pilot to fade out. */
@@ -74,12 +131,23 @@ static void pilot_init( Pilot* dest, Ship* ship, const char* name, int faction,
       const double dir, const Vector2d* pos, const Vector2d* vel,
       const PilotFlags flags, unsigned int dockpilot, int dockslot );
 /* Update. */
+static void pilot_updatePre( Pilot* pilot, double dt, PilotUpdate *u );
+static void pilot_integrate( PilotUpdate *u );
+static int pilot_integrateJob( void *data );
+static void pilot_updatePost( Pilot* pilot, const PilotUpdate *u );
 static void pilot_hyperspace( Pilot* pilot, double dt );
 static void pilot_refuel( Pilot *p, double dt );
 /* Clean up. */
 static void pilot_dead( Pilot* p, unsigned int killer );
 /* Targeting. */
+static void pilot_enemyMaskSet( int faction );
+static int pilot_enemyMaskGet( int faction );
 static int pilot_validEnemy( const Pilot* p, const Pilot* target );
+static int pilot_scoreEnemy( const Pilot *t, double d2, void *data, double *score );
+static int pilot_scoreEnemySize( const Pilot *t, double d2, void *data, double *score );
+static int pilot_scoreEnemyHeuristic( const Pilot *t, double d2, void *data, double *score );
+static int pilot_validNearest( const Pilot *p, const Pilot *t, int disabled );
+static int pilot_scoreNearest( const Pilot *t, double d2, void *data, double *score );
 /* Misc. */
 static void pilot_setCommMsg( Pilot *p, const char *s );
 static int pilot_getStackPos( const unsigned int id );
@@ -273,9 +341,53 @@ int pilot_canTarget( const Pilot* p )
 }
 
 
+/**
+ * @brief Sets the faction the enemy mask is for.
+ *
+ * Hostility towards the other factions is looked up lazily and kept until the
+ *  next call, so pilot_validEnemy() only does a single lookup per faction.
+ *
+ *    @param faction Faction to get the enemies of.
+ */
+static void pilot_enemyMaskSet( int faction )
+{
+   if (pilot_enemyMask == NULL)
+      pilot_enemyMask = array_create( signed char );
+   pilot_enemyFaction = faction;
+   if (array_size(pilot_enemyMask) > 0)
+      memset( pilot_enemyMask, -1, array_size(pilot_enemyMask) );
+}
+
+
+/**
+ * @brief Checks to see if a faction is hostile to the enemy mask faction.
+ *
+ *    @param faction Faction to check.
+ *    @return 1 if they are enemies, 0 otherwise.
+ */
+static int pilot_enemyMaskGet( int faction )
+{
+   int n;
+
+   if (faction < 0)
+      return 0;
+
+   n = array_size(pilot_enemyMask);
+   if (faction >= n) {
+      array_resize( &pilot_enemyMask, faction+1 );
+      memset( &pilot_enemyMask[n], -1, faction+1-n );
+   }
+   if (pilot_enemyMask[faction] < 0)
+      pilot_enemyMask[faction] = areEnemies( pilot_enemyFaction, faction );
+   return pilot_enemyMask[faction];
+}
+
+
 /**
  * @brief Checks to see if a pilot is a valid enemy for another pilot.
  *
+ * The enemy mask must be set to the faction of the reference pilot.
+ *
  *    @param p Reference pilot.
  *    @param target Pilot to see if is a valid enemy of the reference.
  *    @return 1 if it is valid, 0 otherwise.
@@ -283,7 +395,7 @@ int pilot_canTarget( const Pilot* p )
 static int pilot_validEnemy( const Pilot* p, const Pilot* target )
 {
    /* Should either be hostile by faction or by player. */
-   if ( !( areEnemies( p->faction, target->faction )
+   if ( !( pilot_enemyMaskGet( target->faction )
             || ( ( target->id == PLAYER_ID )
                && pilot_isHostile( p ) ) ) )
       return 0;
@@ -309,6 +421,57 @@ static int pilot_validEnemy( const Pilot* p, const Pilot* target )
 }
 
 
+/**
+ * @brief Scores enemies by distance.
+ */
+static int pilot_scoreEnemy( const Pilot *t, double d2, void *data, double *score )
+{
+   const PilotEnemyQuery *q = data;
+
+   if (!pilot_validEnemy( q->p, t ))
+      return 0;
+
+   *score = d2;
+   return 1;
+}
+
+
+/**
+ * @brief Scores enemies within a mass range by distance.
+ */
+static int pilot_scoreEnemySize( const Pilot *t, double d2, void *data, double *score )
+{
+   const PilotEnemyQuery *q = data;
+
+   if (t->solid->mass < q->mass_LB || t->solid->mass > q->mass_UB)
+      return 0;
+
+   if (!pilot_validEnemy( q->p, t ))
+      return 0;
+
+   *score = d2;
+   return 1;
+}
+
+
+/**
+ * @brief Scores enemies by distance and how good of a match they are.
+ */
+static int pilot_scoreEnemyHeuristic( const Pilot *t, double d2, void *data, double *score )
+{
+   const PilotEnemyQuery *q = data;
+
+   if (!pilot_validEnemy( q->p, t ))
+      return 0;
+
+   *score = q->range_factor * d2
+         + FABS( pilot_relsize( q->p, t ) - q->mass_factor )
+         + FABS( pilot_relhp(   q->p, t ) - q->health_factor )
+         + FABS( pilot_reldps(  q->p, t ) - q->damage_factor );
+   return 1;
+}
+
+
 /**
  * @brief Gets the nearest enemy to the pilot.
  *
@@ -317,25 +480,14 @@ static int pilot_validEnemy( const Pilot* p, const Pilot* target )
  */
 unsigned int pilot_getNearestEnemy( const Pilot* p )
 {
-   unsigned int tp;
-   int i;
-   double d, td;
-
-   tp = 0;
-   d  = 0.;
-   for (i=0; i<array_size(pilot_stack); i++) {
+   PilotEnemyQuery q;
 
-      if (!pilot_validEnemy( p, pilot_stack[i] ))
-         continue;
-
-      /* Check distance. */
-      td = vect_dist2(&pilot_stack[i]->solid->pos, &p->solid->pos);
-      if (!tp || (td < d)) {
-         d  = td;
-         tp = pilot_stack[i]->id;
-      }
-   }
-   return tp;
+   q.p = p;
+   pilot_enemyMaskSet( p->faction );
+   if (pilot_gridNearest( &pilot_nearest, p->solid->pos.x, p->solid->pos.y,
+            1, 1., pilot_scoreEnemy, &q ) == 0)
+      return 0;
+   return pilot_stack[ pilot_nearest[0] ]->id;
 }
 
 /**
@@ -348,29 +500,16 @@ unsigned int pilot_getNearestEnemy( const Pilot* p )
  */
 unsigned int pilot_getNearestEnemy_size( const Pilot* p, double target_mass_LB, double target_mass_UB )
 {
-   unsigned int tp;
-   int i;
-   double d, td;
+   PilotEnemyQuery q;
 
-   tp = 0;
-   d  = 0.;
-   for (i=0; i<array_size(pilot_stack); i++) {
-
-      if (!pilot_validEnemy( p, pilot_stack[i] ))
-         continue;
-
-      if (pilot_stack[i]->solid->mass < target_mass_LB || pilot_stack[i]->solid->mass > target_mass_UB)
-         continue;
-
-      /* Check distance. */
-      td = vect_dist2(&pilot_stack[i]->solid->pos, &p->solid->pos);
-      if (!tp || (td < d)) {
-         d = td;
-         tp = pilot_stack[i]->id;
-      }
-   }
-
-   return tp;
+   q.p       = p;
+   q.mass_LB = target_mass_LB;
+   q.mass_UB = target_mass_UB;
+   pilot_enemyMaskSet( p->faction );
+   if (pilot_gridNearest( &pilot_nearest, p->solid->pos.x, p->solid->pos.y,
+            1, 1., pilot_scoreEnemySize, &q ) == 0)
+      return 0;
+   return pilot_stack[ pilot_nearest[0] ]->id;
 }
 
 /**
@@ -387,34 +526,19 @@ unsigned int pilot_getNearestEnemy_heuristic( const Pilot* p,
       double mass_factor, double health_factor,
       double damage_factor, double range_factor )
 {
-   unsigned int tp;
-   int i;
-   double temp, current_heuristic_value;
-   Pilot *target;
-
-   current_heuristic_value = 10000.;
-
-   tp = 0;
-   for (i=0; i<array_size(pilot_stack); i++) {
-      target = pilot_stack[i];
-
-      if (!pilot_validEnemy( p, target ))
-         continue;
-
-      /* Check distance. */
-      temp = range_factor *
-               vect_dist2( &target->solid->pos, &p->solid->pos )
-            + FABS( pilot_relsize( p, target ) - mass_factor )
-            + FABS( pilot_relhp(   p, target ) - health_factor )
-            + FABS( pilot_reldps(  p, target ) - damage_factor );
-
-      if ((tp == 0) || (temp < current_heuristic_value)) {
-         current_heuristic_value = temp;
-         tp = target->id;
-      }
-   }
-
-   return tp;
+   PilotEnemyQuery q;
+
+   q.p             = p;
+   q.mass_factor   = mass_factor;
+   q.health_factor = health_factor;
+   q.damage_factor = damage_factor;
+   q.range_factor  = range_factor;
+   pilot_enemyMaskSet( p->faction );
+   /* The other terms are never negative, so range bounds the score. */
+   if (pilot_gridNearest( &pilot_nearest, p->solid->pos.x, p->solid->pos.y,
+            1, range_factor, pilot_scoreEnemyHeuristic, &q ) == 0)
+      return 0;
+   return pilot_stack[ pilot_nearest[0] ]->id;
 }
 
 /**
@@ -499,6 +623,56 @@ unsigned int pilot_getBoss( const Pilot* p )
    return t;
 }
 
+/**
+ * @brief Checks if a pilot can be selected by pilot_getNearestPos().
+ *
+ *    @param p Pilot selecting.
+ *    @param t Pilot to check.
+ *    @param disabled Whether to return disabled pilots.
+ *    @return 1 if the pilot can be selected, 0 otherwise.
+ */
+static int pilot_validNearest( const Pilot *p, const Pilot *t, int disabled )
+{
+   /* Must not be self. */
+   if (t == p)
+      return 0;
+
+   /* Player doesn't select escorts (unless disabled is active). */
+   if (!disabled && (p->faction == FACTION_PLAYER) &&
+         (t->faction == FACTION_PLAYER))
+      return 0;
+
+   /* Shouldn't be disabled. */
+   if (!disabled && pilot_isDisabled(t))
+      return 0;
+
+   /* Must be a valid target. */
+   if (!pilot_validTarget( p, t ))
+      return 0;
+
+   return 1;
+}
+
+
+/**
+ * @brief Scores pilots by distance for pilot_getNearestPos().
+ *
+ * The player is left out, it's only picked when there is nothing else.
+ */
+static int pilot_scoreNearest( const Pilot *t, double d2, void *data, double *score )
+{
+   const PilotNearestQuery *q = data;
+
+   if (t->id == PLAYER_ID)
+      return 0;
+   if (!pilot_validNearest( q->p, t, q->disabled ))
+      return 0;
+
+   *score = d2;
+   return 1;
+}
+
+
 /**
  * @brief Get the nearest pilot to a pilot from a certain position.
  *
@@ -511,38 +685,23 @@ unsigned int pilot_getBoss( const Pilot* p )
  */
 double pilot_getNearestPos( const Pilot *p, unsigned int *tp, double x, double y, int disabled )
 {
-   int i;
-   double d, td;
-
-   *tp = PLAYER_ID;
-   d  = 0;
-   for (i=0; i<array_size(pilot_stack); i++) {
-
-      /* Must not be self. */
-      if (pilot_stack[i] == p)
-         continue;
-
-      /* Player doesn't select escorts (unless disabled is active). */
-      if (!disabled && (p->faction == FACTION_PLAYER) &&
-            (pilot_stack[i]->faction == FACTION_PLAYER))
-         continue;
-
-      /* Shouldn't be disabled. */
-      if (!disabled && pilot_isDisabled(pilot_stack[i]))
-         continue;
-
-      /* Must be a valid target. */
-      if (!pilot_validTarget( p, pilot_stack[i] ))
-         continue;
+   Pilot *t;
+   PilotNearestQuery q;
 
-      /* Minimum distance. */
-      td = pow2(x-pilot_stack[i]->solid->pos.x) + pow2(y-pilot_stack[i]->solid->pos.y);
-      if (((*tp==PLAYER_ID) || (td < d))) {
-         d = td;
-         *tp = pilot_stack[i]->id;
-      }
+   q.p        = p;
+   q.disabled = disabled;
+   if (pilot_gridNearest( &pilot_nearest, x, y, 1, 1., pilot_scoreNearest, &q ) > 0) {
+      t   = pilot_stack[ pilot_nearest[0] ];
+      *tp = t->id;
+      return pow2(x-t->solid->pos.x) + pow2(y-t->solid->pos.y);
    }
-   return d;
+
+   /* Fall back to the player. */
+   *tp = PLAYER_ID;
+   t   = player.p;
+   if ((t == NULL) || !pilot_validNearest( p, t, disabled ))
+      return 0.;
+   return pow2(x-t->solid->pos.x) + pow2(y-t->solid->pos.y);
 }
 
 
@@ -1903,6 +2062,28 @@ void pilot_renderOverlay( Pilot* p, const double dt )
  *    @param dt Current delta tick.
  */
 void pilot_update( Pilot* pilot, double dt )
+{
+   PilotUpdate u;
+
+   pilot_updatePre( pilot, dt, &u );
+   u.p = pilot;
+   pilot_integrate( &u );
+   pilot_updatePost( pilot, &u );
+}
+
+
+/**
+ * @brief Does the serial part of the pilot update.
+ *
+ * Everything that may run Lua, play sounds, create effects or look at other
+ *  pilots is done here. The number crunching that only touches the pilot
+ *  itself is left for pilot_integrate().
+ *
+ *    @param pilot Pilot to update.
+ *    @param dt Current delta tick.
+ *    @param[out] u Work left to do on the pilot.
+ */
+static void pilot_updatePre( Pilot* pilot, double dt, PilotUpdate *u )
 {
    int i, cooling, nchg;
    int ammo_threshold;
@@ -1911,7 +2092,6 @@ void pilot_update( Pilot* pilot, double dt )
    double a, px,py, vx,vy;
    char buf[16];
    PilotOutfitSlot *o;
-   double Q;
    Damage dmg;
    double stress_falloff;
    double efficiency, thrust;
@@ -1920,6 +2100,14 @@ void pilot_update( Pilot* pilot, double dt )
    /* Modify the dt with speedup. */
    dt *= pilot->stats.time_speedup;
 
+   /* Nothing left to do by default. */
+   u->id    = pilot->id;
+   u->p     = NULL;
+   u->dt    = dt;
+   u->heat  = 0;
+   u->regen = 0;
+   u->move  = PILOT_MOVE_NONE;
+
    /* Check target validity. */
    if (pilot->target != pilot->id) {
       target = pilot_get(pilot->target);
@@ -1949,9 +2137,8 @@ void pilot_update( Pilot* pilot, double dt )
    for (i=0; i<MAX_AI_TIMERS; i++)
       if (pilot->timer[i] > 0.)
          pilot->timer[i] -= dt;
-   /* Update heat. */
+   /* Update outfits. */
    a = -1.;
-   Q = 0.;
    nchg = 0; /* Number of outfits that change state, processed at the end. */
    for (i=0; i<array_size(pilot->outfits); i++) {
       o = pilot->outfits[i];
@@ -2023,23 +2210,16 @@ void pilot_update( Pilot* pilot, double dt )
          }
       }
 
-      /* Handle heat. */
-      if (!cooling)
-         Q  += pilot_heatUpdateSlot( pilot, o, dt );
-
       /* Handle lockons. */
       pilot_lockUpdateSlot( pilot, o, target, &a, dt );
    }
 
-   /* Global heat. */
+   /* Heat conduction is done when integrating, active cooldown overrides it. */
    if (!cooling)
-      pilot_heatUpdateShip( pilot, Q, dt );
+      u->heat = 1;
    else
       pilot_heatUpdateCooldown( pilot );
 
-   /* Update electronic warfare. */
-   pilot_ewUpdateDynamic( pilot, dt );
-
    /* Update stress. */
    if (!pilot_isFlag(pilot, PILOT_DISABLED)) { /* Case pilot is not disabled. */
       stress_falloff = 0.3*sqrt(pilot->solid->mass); /* Should be about 38 seconds for a 300 mass ship with 200 armour, and 172 seconds for a 6000 mass ship with 4000 armour. */
@@ -2160,6 +2340,7 @@ void pilot_update( Pilot* pilot, double dt )
              */
             pilot->solid->speed_max = 0.;
             pilot->solid->update( pilot->solid, dt );
+            pilot_gridInvalidate();
 
             if (VMOD(pilot->solid->vel) < 1e-1) {
                vectnull( &pilot->solid->vel ); /* Forcibly zero velocity. */
@@ -2171,20 +2352,8 @@ void pilot_update( Pilot* pilot, double dt )
 
    /* Healing and energy usage is only done if not disabled. */
    if (!pilot_isDisabled(pilot)) {
-      pilot_ewUpdateStealth(pilot, dt);
-
-      /* Pilot is still alive */
-      pilot->armour += pilot->armour_regen * dt;
-      if (pilot->armour > pilot->armour_max)
-         pilot->armour = pilot->armour_max;
-
-      /* Regen shield */
-      if (pilot->stimer <= 0.) {
-         pilot->shield += pilot->shield_regen * dt;
-         if (pilot->sbonus > 0.)
-            pilot->shield += dt * (pilot->shield_regen * (pilot->sbonus / 1.5));
-         pilot->shield = CLAMP( 0., pilot->shield_max, pilot->shield );
-      }
+      /* Pilot is still alive, armour and shield regen when integrating. */
+      u->regen = 1;
 
       /*
       * Using RC circuit energy loading.
@@ -2224,11 +2393,6 @@ void pilot_update( Pilot* pilot, double dt )
       pilot_setThrust( pilot, 0. );
       pilot_setTurn( pilot, 0. );
 
-      /* update the solid */
-      pilot->solid->update( pilot->solid, dt );
-      gl_getSpriteFromDir( &pilot->tsx, &pilot->tsy,
-            pilot->ship->gfx_space, pilot->solid->dir );
-
       /* Engine glow decay. */
       if (pilot->engine_glow > 0.) {
          pilot->engine_glow -= pilot->speed / pilot->thrust * dt * pilot->solid->mass;
@@ -2236,9 +2400,8 @@ void pilot_update( Pilot* pilot, double dt )
             pilot->engine_glow = 0.;
       }
 
-      /* Update the trail. */
-      pilot_sample_trails( pilot, 0 );
-
+      /* Drift when integrating. */
+      u->move = PILOT_MOVE_DISABLED;
       return;
    }
 
@@ -2316,20 +2479,115 @@ void pilot_update( Pilot* pilot, double dt )
          pilot->engine_glow = 0.;
    }
 
-   /* Update the solid, must be run after limit_speed. */
-   pilot->solid->update( pilot->solid, dt );
-   gl_getSpriteFromDir( &pilot->tsx, &pilot->tsy,
-         pilot->ship->gfx_space, pilot->solid->dir );
+   /* Update the solid when integrating, must be run after limit_speed. */
+   u->move = PILOT_MOVE_NORMAL;
+}
+
+
+/**
+ * @brief Does the number crunching part of the pilot update.
+ *
+ * Only touches the pilot being updated so that pilots can be integrated in
+ *  parallel. Does nothing if the pilot went away during the serial part.
+ *
+ *    @param u Work left to do on the pilot.
+ */
+static void pilot_integrate( PilotUpdate *u )
+{
+   int i;
+   double Q, dt;
+   Pilot *pilot;
+   PilotOutfitSlot *o;
+
+   pilot = u->p;
+   if (pilot == NULL)
+      return;
+   dt = u->dt;
+
+   /* Update heat. */
+   if (u->heat) {
+      Q = 0.;
+      for (i=0; i<array_size(pilot->outfits); i++) {
+         o = pilot->outfits[i];
+         if (o->outfit == NULL)
+            continue;
+         if (!o->active)
+            continue;
+         Q += pilot_heatUpdateSlot( pilot, o, dt );
+      }
+      pilot_heatUpdateShip( pilot, Q, dt );
+   }
+
+   /* Update electronic warfare. */
+   pilot_ewUpdateDynamic( pilot, dt );
+
+   if (u->regen) {
+      /* Regen armour. */
+      pilot->armour += pilot->armour_regen * dt;
+      if (pilot->armour > pilot->armour_max)
+         pilot->armour = pilot->armour_max;
+
+      /* Regen shield */
+      if (pilot->stimer <= 0.) {
+         pilot->shield += pilot->shield_regen * dt;
+         if (pilot->sbonus > 0.)
+            pilot->shield += dt * (pilot->shield_regen * (pilot->sbonus / 1.5));
+         pilot->shield = CLAMP( 0., pilot->shield_max, pilot->shield );
+      }
+   }
+
+   /* Update the solid. */
+   if (u->move != PILOT_MOVE_NONE) {
+      pilot->solid->update( pilot->solid, dt );
+      gl_getSpriteFromDir( &pilot->tsx, &pilot->tsy,
+            pilot->ship->gfx_space, pilot->solid->dir );
+   }
+}
+
+
+/**
+ * @brief Threadpool job integrating a chunk of pilots.
+ *
+ *    @param data Chunk to integrate (PilotIntegrateJob).
+ *    @return 0 always.
+ */
+static int pilot_integrateJob( void *data )
+{
+   int i;
+   PilotIntegrateJob *job = (PilotIntegrateJob*) data;
+   for (i=0; i<job->n; i++)
+      pilot_integrate( &job->u[i] );
+   return 0;
+}
+
+
+/**
+ * @brief Does the serial part of the pilot update that needs the pilots moved.
+ *
+ *    @param pilot Pilot to update.
+ *    @param u Work that was done on the pilot.
+ */
+static void pilot_updatePost( Pilot* pilot, const PilotUpdate *u )
+{
+   /* Update scanning, the target has to be up to date. */
+   pilot_ewUpdateScan( pilot, u->dt );
+
+   if (u->move == PILOT_MOVE_NONE)
+      return;
 
    /* See if there is commodities to gather. */
-   if (!pilot_isDisabled(pilot))
+   if ((u->move == PILOT_MOVE_NORMAL) && !pilot_isDisabled(pilot))
       gatherable_gather( pilot->id );
 
-   /* Update the trail. */
-   pilot_sample_trails( pilot, 0 );
+   /* Update the trail, unless nobody will see it. */
+   if (!space_isSimulation())
+      pilot_sample_trails( pilot, 0 );
+
+   if (u->move != PILOT_MOVE_NORMAL)
+      return;
 
    /* Update outfits if necessary. */
-   pilot->otimer += dt;
+   pilot->otimer += u->dt;
    while (pilot->otimer > PILOT_OUTFIT_LUA_UPDATE_DT) {
       pilot_outfitLUpdate( pilot, PILOT_OUTFIT_LUA_UPDATE_DT );
       pilot->otimer -= PILOT_OUTFIT_LUA_UPDATE_DT;
@@ -2949,6 +3207,7 @@ unsigned int pilot_create( Ship* ship, const char* name, int faction, const char
    /* Set the pilot in the stack -- must be there before initializing */
    p = &array_grow( &pilot_stack );
    *p = dyn;
+   pilot_gridInvalidate();
 
    /* Initialize the pilot. */
    pilot_init( dyn, ship, name, faction, ai, dir, pos, vel, flags, dockpilot, dockslot );
@@ -3000,6 +3259,7 @@ Pilot* pilot_replacePlayer( Pilot* after )
       spfx_trail_remove( pilot_stack[i]->trail[j] );
    array_erase( &pilot_stack[i]->trail, array_begin(pilot_stack[i]->trail), array_end(pilot_stack[i]->trail) );
    pilot_stack[i] = after;
+   pilot_gridInvalidate();
    pilot_init_trails( after );
    /* Run Lua stuff. */
    pilot_outfitLInitAll( after );
@@ -3183,6 +3443,7 @@ void pilot_destroy(Pilot* p)
    /* pilot is eliminated */
    pilot_free(p);
    array_erase( &pilot_stack, &pilot_stack[i], &pilot_stack[i+1] );
+   pilot_gridInvalidate();
 }
 
 
@@ -3218,6 +3479,11 @@ void pilots_free (void)
    array_free(pilot_stack);
    pilot_stack = NULL;
    player.p = NULL;
+   pilot_gridFree();
+   array_free( pilot_nearest );
+   pilot_nearest = NULL;
+   array_free( pilot_enemyMask );
+   pilot_enemyMask = NULL;
 }
 
 
@@ -3269,6 +3535,7 @@ void pilots_clean( int persist )
          pilot_free(pilot_stack[i]);
    }
    array_erase( &pilot_stack, &pilot_stack[persist_count], array_end(pilot_stack) );
+   pilot_gridInvalidate();
 
    /* Clear global hooks. */
    pilots_clearGlobalHooks();
@@ -3310,6 +3577,7 @@ void pilots_cleanAll (void)
       player.p = NULL;
    }
    array_erase( &pilot_stack, array_begin(pilot_stack), array_end(pilot_stack) );
+   pilot_gridInvalidate();
 }
 
 
@@ -3320,10 +3588,15 @@ void pilots_cleanAll (void)
  */
 void pilots_update( double dt )
 {
-   int i;
+   int i, n;
+   double interval;
    Pilot *p;
+   PilotUpdate *updates, *u;
+   PilotIntegrateJob *jobs, *job;
+   ThreadQueue *queue;
 
    /* Now update all the pilots. */
+   profile_begin( PROFILE_AI );
    for (i=0; i<array_size(pilot_stack); i++) {
       p = pilot_stack[i];
 
@@ -3363,11 +3636,29 @@ void pilots_update( double dt )
             !pilot_isFlag(p, PILOT_REFUELBOARDING) &&
             /* Must not be landing nor taking off. */
             !pilot_isFlag(p, PILOT_LANDING) &&
-            !pilot_isFlag(p, PILOT_TAKEOFF))
+            !pilot_isFlag(p, PILOT_TAKEOFF)) {
+         /* Far away pilots think less often, thrust and turn are held in between. */
+         p->tthink -= dt;
+         if (p->tthink > 0.)
+            continue;
          p->think(p, dt);
+         interval  = ai_thinkInterval( p );
+         /* Jittered so throttled pilots think on different updates. */
+         p->tthink = (interval > 0.) ? interval * (0.5 + ai_jitter(p)) : 0.;
+      }
    }
+   profile_end( PROFILE_AI );
 
-   /* Now update all the pilots. */
+   /*
+    * Now update all the pilots. This is done in three passes:
+    *  1) serial pass that may run Lua and touch other pilots,
+    *  2) integration pass that only touches each pilot itself,
+    *  3) serial pass for the rest that needs the pilots moved.
+    * The work list is local since Lua may end up recursing into here.
+    * Stealth is done beforehand for all the pilots at once.
+    */
+   pilot_ewUpdateStealthAll( dt );
+   updates = array_create_size( PilotUpdate, array_size(pilot_stack) );
    for (i=0; i<array_size(pilot_stack); i++) {
       p = pilot_stack[i];
 
@@ -3379,10 +3670,52 @@ void pilots_update( double dt )
       if (pilot_isFlag(p, PILOT_HIDE))
          continue;
 
-      /* Just update the pilot. */
-      if (p->update) /* update */
+      /* Normal pilots get split up, special updates (player) are done at once. */
+      if (p->update == pilot_update)
+         pilot_updatePre( p, dt, &array_grow( &updates ) );
+      else if (p->update) { /* update */
          p->update( p, dt );
+         pilot_gridInvalidate();
+      }
+   }
+
+   /* Pilots may have gone away while running Lua. */
+   n = array_size(updates);
+   for (i=0; i<n; i++)
+      updates[i].p = pilot_get( updates[i].id );
+
+   /* Integrate, using the threadpool when it's worth it. */
+   if (n >= PILOT_INTEGRATE_MIN) {
+      jobs  = array_create_size( PilotIntegrateJob, n / PILOT_INTEGRATE_CHUNK + 1 );
+      queue = vpool_create();
+      for (i=0; i<n; i+=PILOT_INTEGRATE_CHUNK) {
+         job    = &array_grow( &jobs );
+         job->u = &updates[i];
+         job->n = MIN( PILOT_INTEGRATE_CHUNK, n-i );
+      }
+      /* Jobs array doesn't move anymore. */
+      for (i=0; i<array_size(jobs); i++)
+         vpool_enqueue( queue, pilot_integrateJob, &jobs[i] );
+      vpool_wait( queue );
+      array_free( jobs );
+   }
+   else {
+      for (i=0; i<n; i++)
+         pilot_integrate( &updates[i] );
+   }
+
+   /* Pilots moved so the collision grid is out of date, the post pass may
+    * already run Lua that searches it. */
+   pilot_gridInvalidate();
+
+   /* Finish the update in stack order. */
+   for (i=0; i<n; i++) {
+      u = &updates[i];
+      p = pilot_get( u->id );
+      if (p != NULL)
+         pilot_updatePost( p, u );
    }
+   array_free( updates );
 }
 
 
@@ -3394,6 +3727,7 @@ void pilots_update( double dt )
 void pilots_render( double dt )
 {
    int i;
+   gl_batchBegin();
    for (i=0; i<array_size(pilot_stack); i++) {
 
       /* Invisible, not doing anything. */
@@ -3403,6 +3737,7 @@ void pilots_render( double dt )
       if (pilot_stack[i]->render != NULL) /* render */
          pilot_stack[i]->render(pilot_stack[i], dt);
    }
+   gl_batchEnd();
 }
 
 
@@ -3441,6 +3776,7 @@ void pilot_clearTimers( Pilot *pilot )
 
    pilot->ptimer     = 0.; /* Pilot timer. */
    pilot->tcontrol   = 0.; /* AI control timer. */
+   pilot->tthink     = 0.; /* AI think timer. */
    pilot->stimer     = 0.; /* Shield timer. */
    pilot->dtimer     = 0.; /* Disable timer. */
    pilot->otimer     = 0.; /* Outfit timer. */
@@ -345,6 +345,8 @@ typedef struct Pilot_ {
    /* AI */
    AI_Profile* ai;   /**< AI personality profile */
    double tcontrol;  /**< timer for control tick */
+   double tthink;    /**< timer until the AI thinks again, see ai_thinkInterval() */
+   unsigned int njitter; /**< number of jitter values drawn, see ai_jitter() */
    double timer[MAX_AI_TIMERS]; /**< timers for AI */
    Task* task;       /**< current action */
    unsigned int shoot_indicator; /**< Indicator to inform the AI if a seeker has been shot recently. */
@@ -381,6 +383,7 @@ typedef struct Pilot_ {
 #include "pilot_outfit.h"
 #include "pilot_weapon.h"
 #include "pilot_ew.h"
+#include "pilot_grid.h"
 
 
 /*
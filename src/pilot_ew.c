@@ -40,7 +40,11 @@ static double ew_interference = 1.; /**< Interference factor. */
 static void pilot_ewUpdate( Pilot *p );
 static double pilot_ewMass( double mass );
 static double pilot_ewAsteroid( Pilot *p );
-static int pilot_ewStealthGetNearby( const Pilot *p, double *mod, int *close, int *isplayer );
+static int pilot_ewStealthDetector( const Pilot *t );
+static double pilot_ewStealthDetectMax (void);
+static int pilot_ewStealthGetNearby( const Pilot *p, double detect,
+      double *mod, int *close, int *isplayer );
+static void pilot_ewUpdateStealth( Pilot *p, double dt, double detect );
 
 
 /**
@@ -124,17 +128,34 @@ void pilot_ewUpdateStatic( Pilot *p )
 /**
  * @brief Updates the pilot's dynamic electronic warfare properties.
  *
+ * Only touches the pilot itself so it is safe to run from the threadpool.
+ *
  *    @param p Pilot to update.
  *    @param dt Delta time increment (seconds).
  */
 void pilot_ewUpdateDynamic( Pilot *p, double dt )
 {
-   double d;
-   const Pilot *t;
+   (void) dt;
 
    /* Electronic warfare values. */
    p->ew_asteroid = pilot_ewAsteroid( p );
    pilot_ewUpdate( p );
+}
+
+
+/**
+ * @brief Updates the pilot's scan of its target.
+ *
+ * Depends on the target's electronic warfare values and position, so it must
+ *  be run after all the pilots have been updated.
+ *
+ *    @param p Pilot to update.
+ *    @param dt Delta time increment (seconds).
+ */
+void pilot_ewUpdateScan( Pilot *p, double dt )
+{
+   double d;
+   const Pilot *t;
 
    /* Scanning values. */
    if (p->target == p->id)
@@ -406,12 +427,70 @@ double pilot_ewWeaponTrack( const Pilot *p, const Pilot *t, double trackmin, dou
 }
 
 
-static int pilot_ewStealthGetNearby( const Pilot *p, double *mod, int *close, int *isplayer )
+/**
+ * @brief Checks to see if a pilot can break the stealth of others at all.
+ *
+ * Only looks at the pilot itself, faction relationships are checked later.
+ */
+static int pilot_ewStealthDetector( const Pilot *t )
+{
+   if (pilot_isDisabled(t))
+      return 0;
+   if (!pilot_canTarget(t))
+      return 0;
+
+   /* Must not be landing nor taking off. */
+   if (pilot_isFlag(t, PILOT_LANDING) ||
+         pilot_isFlag(t, PILOT_TAKEOFF))
+      return 0;
+
+   /* Stealthed pilots don't reduce stealth. */
+   if (pilot_isFlag(t, PILOT_STEALTH))
+      return 0;
+
+   return 1;
+}
+
+
+/**
+ * @brief Gets the largest detection modifier of the pilots that can break stealth.
+ *
+ * Bounds how far pilot_ewStealthGetNearby() has to look.
+ */
+static double pilot_ewStealthDetectMax (void)
+{
+   int i;
+   double detect;
+   Pilot *const* ps;
+
+   detect = 0.;
+   ps = pilot_getAll();
+   for (i=0; i<array_size(ps); i++)
+      if (pilot_ewStealthDetector( ps[i] ))
+         detect = MAX( detect, ps[i]->stats.ew_detect );
+   return detect;
+}
+
+
+/**
+ * @brief Gets the non-allied pilots that are breaking a pilot's stealth.
+ *
+ *    @param p Pilot to check.
+ *    @param detect Largest detection modifier of the pilots that can break
+ *                  stealth (see pilot_ewStealthDetectMax()).
+ *    @param[out] mod How much the stealth is being broken.
+ *    @param[out] close Number of pilots getting close to breaking the stealth.
+ *    @param[out] isplayer Whether or not the player is breaking the stealth.
+ *    @return Number of pilots breaking the stealth.
+ */
+static int pilot_ewStealthGetNearby( const Pilot *p, double detect,
+      double *mod, int *close, int *isplayer )
 {
    Pilot *t;
    Pilot *const* ps;
-   int i, n;
-   double dist;
+   int i, n, m;
+   int *idx;
+   double dist, r;
 
    /* Check nearby non-allies. */
    if (mod != NULL)
@@ -421,26 +500,22 @@ static int pilot_ewStealthGetNearby( const Pilot *p, double *mod, int *close, in
    if (isplayer != NULL)
       *isplayer = 0;
    n = 0;
+
+   /* Only pilots within reach of the best detector can matter. */
+   r = MAX( 0., p->ew_stealth * detect );
+   if (close != NULL)
+      r *= 1.5;
+   idx = NULL;
+   m  = pilot_gridRadius( &idx, p->solid->pos.x, p->solid->pos.y, r );
    ps = pilot_getAll();
-   for (i=0; i<array_size(ps); i++) {
-      t = ps[i];
+   for (i=0; i<m; i++) {
+      t = ps[ idx[i] ];
+      if (!pilot_ewStealthDetector( t ))
+         continue;
       if (areAllies( p->faction, t->faction ) ||
             ((p->faction == FACTION_PLAYER) && pilot_isFriendly(t)) ||
             ((t->faction == FACTION_PLAYER) && pilot_isFriendly(p)))
          continue;
-      if (pilot_isDisabled(t))
-         continue;
-      if (!pilot_canTarget(t))
-         continue;
-
-      /* Must not be landing nor taking off. */
-      if (pilot_isFlag(t, PILOT_LANDING) ||
-            pilot_isFlag(t, PILOT_TAKEOFF))
-         continue;
-
-      /* Stealthed pilots don't reduce stealth. */
-      if (pilot_isFlag(t, PILOT_STEALTH))
-         continue;
 
       /* Compute distance. */
       dist = vect_dist2( &p->solid->pos, &t->solid->pos );
@@ -458,6 +533,7 @@ static int pilot_ewStealthGetNearby( const Pilot *p, double *mod, int *close, in
       if ((isplayer != NULL) && pilot_isPlayer(t))
          *isplayer = 1;
    }
+   array_free( idx );
 
    return n;
 }
@@ -466,7 +542,7 @@ static int pilot_ewStealthGetNearby( const Pilot *p, double *mod, int *close, in
 /**
  * @brief Updates the stealth mode and checks to see if it is getting broken.
  */
-void pilot_ewUpdateStealth( Pilot *p, double dt )
+static void pilot_ewUpdateStealth( Pilot *p, double dt, double detect )
 {
    int n, close, isplayer;
    double mod;
@@ -476,9 +552,9 @@ void pilot_ewUpdateStealth( Pilot *p, double dt )
 
    /* Get nearby pilots. */
    if (pilot_isPlayer(p))
-      n = pilot_ewStealthGetNearby( p, &mod, &close, &isplayer );
+      n = pilot_ewStealthGetNearby( p, detect, &mod, &close, &isplayer );
    else
-      n = pilot_ewStealthGetNearby( p, &mod, NULL, &isplayer );
+      n = pilot_ewStealthGetNearby( p, detect, &mod, NULL, &isplayer );
 
    /* Stop autonav if pilots are nearby. */
    if (pilot_isPlayer(p) && (close>0))
@@ -504,6 +580,45 @@ void pilot_ewUpdateStealth( Pilot *p, double dt )
 }
 
 
+/**
+ * @brief Updates the stealth of all the pilots in a single sweep.
+ *
+ * The bound on detection is worked out once for the whole sweep, and each
+ *  stealthed pilot then only looks at the pilots in reach through the pilot
+ *  grid instead of at every other pilot.
+ *
+ *    @param dt Current delta tick.
+ */
+void pilot_ewUpdateStealthAll( double dt )
+{
+   int i;
+   unsigned int id;
+   double detect;
+   Pilot *p;
+   Pilot *const* ps;
+
+   detect = pilot_ewStealthDetectMax();
+
+   /* Hooks may change the stack, so it's fetched every time. */
+   for (i=0; i<array_size(pilot_getAll()); i++) {
+      ps = pilot_getAll();
+      p  = ps[i];
+      if (!pilot_isFlag( p, PILOT_STEALTH ))
+         continue;
+      if (pilot_isFlag( p, PILOT_DELETE ) || pilot_isFlag( p, PILOT_HIDE ) ||
+            pilot_isFlag( p, PILOT_DEAD ) || pilot_isDisabled( p ))
+         continue;
+      id = p->id;
+      pilot_ewUpdateStealth( p, dt * p->stats.time_speedup, detect );
+
+      /* Pilots uncovered can now break the stealth of the others. */
+      p = pilot_get( id );
+      if ((p != NULL) && pilot_ewStealthDetector( p ))
+         detect = MAX( detect, p->stats.ew_detect );
+   }
+}
+
+
 /**
  * @brief Stealths a pilot.
  */
@@ -520,7 +635,7 @@ int pilot_stealth( Pilot *p )
 
    /* Can't stealth if pilots nearby. */
    pilot_setFlag( p, PILOT_STEALTH );
-   n = pilot_ewStealthGetNearby( p, NULL, NULL, NULL );
+   n = pilot_ewStealthGetNearby( p, pilot_ewStealthDetectMax(), NULL, NULL, NULL );
    if (n>0) {
       pilot_rmFlag( p, PILOT_STEALTH );
       return 0;
@@ -35,11 +35,12 @@ double pilot_ewScanTime( const Pilot *p );
 void pilot_ewScanStart( Pilot *p );
 void pilot_ewUpdateStatic( Pilot *p );
 void pilot_ewUpdateDynamic( Pilot *p, double dt );
+void pilot_ewUpdateScan( Pilot *p, double dt );
 
 /*
  * Stealth.
  */
-void pilot_ewUpdateStealth( Pilot *p, double dt );
+void pilot_ewUpdateStealthAll( double dt );
 int pilot_stealth( Pilot *p );
 void pilot_destealth( Pilot *p );
 
@@ -0,0 +1,448 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+/**
+ * @file pilot_grid.c
+ *
+ * @brief Spatial hash of the pilot stack used as a collision broadphase.
+ *
+ * Space is split into square cells of PILOT_GRID_CELL pixels which are hashed
+ *  into a fixed number of buckets, so there are no bounds on the system size.
+ *  Each pilot is inserted into every cell overlapped by its sprite. The grid
+ *  only stores positions in the pilot stack and is rebuilt lazily on the first
+ *  query after it has been invalidated, which happens whenever the pilots
+ *  move or the stack changes.
+ *
+ * Besides bounding box queries used for collisions, it also answers radius
+ *  and k-nearest queries by walking rings of cells outwards from the query
+ *  point until nothing closer can be found.
+ */
+
+
+/** @cond */
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "naev.h"
+/** @endcond */
+
+#include "pilot_grid.h"
+
+#include "array.h"
+
+
+static int pilot_grid_dirty = 1; /**< Grid must be rebuilt before being queried. */
+static int pilot_grid_start[PILOT_GRID_BUCKETS+1]; /**< Start of each bucket in pilot_grid_items. */
+static int pilot_grid_fill[PILOT_GRID_BUCKETS]; /**< Fill cursor used while building. */
+static int *pilot_grid_items = NULL; /**< Array (array.h): Pilot stack positions sorted by bucket. */
+static unsigned int *pilot_grid_mark = NULL; /**< Array (array.h): Last query each pilot was reported by. */
+static unsigned int pilot_grid_stamp = 0; /**< Current query stamp. */
+static int pilot_grid_x1 = 0; /**< Minimum X cell with pilots. */
+static int pilot_grid_y1 = 0; /**< Minimum Y cell with pilots. */
+static int pilot_grid_x2 = -1; /**< Maximum X cell with pilots. */
+static int pilot_grid_y2 = -1; /**< Maximum Y cell with pilots. */
+
+
+/**
+ * @brief Candidate of a k-nearest query.
+ */
+typedef struct PilotGridHit_ {
+   int i;         /**< Position in the pilot stack. */
+   double score;  /**< Score of the pilot, lower is better. */
+} PilotGridHit;
+static PilotGridHit *pilot_grid_hits = NULL; /**< Array (array.h): Best candidates of the current k-nearest query. */
+
+
+/*
+ * Prototypes.
+ */
+static int pilot_gridHash( int cx, int cy );
+static void pilot_gridCells( const Pilot *p, int *x1, int *y1, int *x2, int *y2 );
+static void pilot_gridBuild (void);
+static void pilot_gridScan( int **idx, int b );
+static int pilot_gridCmp( const void *a, const void *b );
+static void pilot_gridStamp (void);
+static void pilot_gridConsider( int i, double x, double y, int k,
+      PilotGridScore score, void *data );
+static void pilot_gridConsiderCell( int cx, int cy, double x, double y, int k,
+      PilotGridScore score, void *data );
+
+
+/**
+ * @brief Hashes a cell into a bucket.
+ */
+static int pilot_gridHash( int cx, int cy )
+{
+   return (int)((((unsigned int)cx * 73856093u) ^ ((unsigned int)cy * 19349663u))
+         & (PILOT_GRID_BUCKETS-1));
+}
+
+
+/**
+ * @brief Gets the range of cells overlapped by a pilot's sprite.
+ */
+static void pilot_gridCells( const Pilot *p, int *x1, int *y1, int *x2, int *y2 )
+{
+   double r;
+   const glTexture *gfx = p->ship->gfx_space;
+
+   r   = MAX( gfx->sw, gfx->sh ) / 2.;
+   *x1 = (int)floor( (p->solid->pos.x - r) / PILOT_GRID_CELL );
+   *y1 = (int)floor( (p->solid->pos.y - r) / PILOT_GRID_CELL );
+   *x2 = (int)floor( (p->solid->pos.x + r) / PILOT_GRID_CELL );
+   *y2 = (int)floor( (p->solid->pos.y + r) / PILOT_GRID_CELL );
+}
+
+
+/**
+ * @brief Rebuilds the grid from the pilot stack.
+ *
+ * Uses a counting sort so that all the buckets end up contiguous in a single
+ *  array without any per-cell allocations.
+ */
+static void pilot_gridBuild (void)
+{
+   int i, n, b, cx, cy, x1, y1, x2, y2;
+   Pilot *const* pilot_stack;
+
+   pilot_stack = pilot_getAll();
+   n = array_size(pilot_stack);
+
+   if (pilot_grid_items == NULL) {
+      pilot_grid_items = array_create( int );
+      pilot_grid_mark  = array_create( unsigned int );
+   }
+
+   /* Count the entries of each bucket. */
+   memset( pilot_grid_start, 0, sizeof(pilot_grid_start) );
+   pilot_grid_x1 = pilot_grid_y1 = INT_MAX;
+   pilot_grid_x2 = pilot_grid_y2 = INT_MIN;
+   for (i=0; i<n; i++) {
+      pilot_gridCells( pilot_stack[i], &x1, &y1, &x2, &y2 );
+      pilot_grid_x1 = MIN( pilot_grid_x1, x1 );
+      pilot_grid_y1 = MIN( pilot_grid_y1, y1 );
+      pilot_grid_x2 = MAX( pilot_grid_x2, x2 );
+      pilot_grid_y2 = MAX( pilot_grid_y2, y2 );
+      for (cy=y1; cy<=y2; cy++)
+         for (cx=x1; cx<=x2; cx++)
+            pilot_grid_start[ pilot_gridHash(cx,cy)+1 ]++;
+   }
+   for (b=0; b<PILOT_GRID_BUCKETS; b++)
+      pilot_grid_start[b+1] += pilot_grid_start[b];
+
+   /* Fill the buckets. */
+   array_resize( &pilot_grid_items, pilot_grid_start[PILOT_GRID_BUCKETS] );
+   memcpy( pilot_grid_fill, pilot_grid_start, sizeof(pilot_grid_fill) );
+   for (i=0; i<n; i++) {
+      pilot_gridCells( pilot_stack[i], &x1, &y1, &x2, &y2 );
+      for (cy=y1; cy<=y2; cy++)
+         for (cx=x1; cx<=x2; cx++)
+            pilot_grid_items[ pilot_grid_fill[ pilot_gridHash(cx,cy) ]++ ] = i;
+   }
+
+   /* Reset the query marks. */
+   array_resize( &pilot_grid_mark, n );
+   if (n > 0)
+      memset( pilot_grid_mark, 0, sizeof(unsigned int)*n );
+   pilot_grid_stamp = 0;
+
+   pilot_grid_dirty = 0;
+}
+
+
+/**
+ * @brief Marks the grid as out of date.
+ *
+ * Must be called whenever pilots move or the pilot stack changes.
+ */
+void pilot_gridInvalidate (void)
+{
+   pilot_grid_dirty = 1;
+}
+
+
+/**
+ * @brief Frees the grid.
+ */
+void pilot_gridFree (void)
+{
+   array_free( pilot_grid_items );
+   pilot_grid_items = NULL;
+   array_free( pilot_grid_mark );
+   pilot_grid_mark = NULL;
+   array_free( pilot_grid_hits );
+   pilot_grid_hits = NULL;
+   pilot_grid_dirty = 1;
+}
+
+
+/**
+ * @brief Adds the pilots of a bucket not yet reported by the current query.
+ */
+static void pilot_gridScan( int **idx, int b )
+{
+   int i, k;
+   for (i=pilot_grid_start[b]; i<pilot_grid_start[b+1]; i++) {
+      k = pilot_grid_items[i];
+      if (pilot_grid_mark[k] == pilot_grid_stamp)
+         continue;
+      pilot_grid_mark[k] = pilot_grid_stamp;
+      array_push_back( idx, k );
+   }
+}
+
+
+/**
+ * @brief Starts a new query, handling the very unlikely wrap around.
+ */
+static void pilot_gridStamp (void)
+{
+   pilot_grid_stamp++;
+   if (pilot_grid_stamp == 0) {
+      memset( pilot_grid_mark, 0, sizeof(unsigned int)*array_size(pilot_grid_mark) );
+      pilot_grid_stamp = 1;
+   }
+}
+
+
+/**
+ * @brief Compares two pilot stack positions.
+ */
+static int pilot_gridCmp( const void *a, const void *b )
+{
+   return *(const int*)a - *(const int*)b;
+}
+
+
+/**
+ * @brief Gets the pilots that may overlap a bounding box.
+ *
+ * The results are a superset of the overlapping pilots: callers still have to
+ *  run the exact tests. Positions are returned in stack order so that callers
+ *  behave the same as if they had walked the whole stack.
+ *
+ *    @param[out] idx Array (array.h) to fill with pilot stack positions. Is
+ *                    created if NULL and cleared otherwise.
+ *    @param x1 Minimum X coordinate of the box.
+ *    @param y1 Minimum Y coordinate of the box.
+ *    @param x2 Maximum X coordinate of the box.
+ *    @param y2 Maximum Y coordinate of the box.
+ *    @return Number of pilots found.
+ */
+int pilot_gridQuery( int **idx, double x1, double y1, double x2, double y2 )
+{
+   int b, cx, cy, cx1, cy1, cx2, cy2;
+
+   if (*idx == NULL)
+      *idx = array_create( int );
+   else
+      array_erase( idx, array_begin(*idx), array_end(*idx) );
+
+   if (pilot_grid_dirty)
+      pilot_gridBuild();
+   if (array_size(pilot_grid_mark) == 0)
+      return 0;
+   pilot_gridStamp();
+
+   cx1 = (int)floor( x1 / PILOT_GRID_CELL );
+   cy1 = (int)floor( y1 / PILOT_GRID_CELL );
+   cx2 = (int)floor( x2 / PILOT_GRID_CELL );
+   cy2 = (int)floor( y2 / PILOT_GRID_CELL );
+
+   /* Huge boxes just go over every bucket once. */
+   if ((double)(cx2-cx1+1) * (double)(cy2-cy1+1) >= PILOT_GRID_BUCKETS) {
+      for (b=0; b<PILOT_GRID_BUCKETS; b++)
+         pilot_gridScan( idx, b );
+   }
+   else {
+      for (cy=cy1; cy<=cy2; cy++)
+         for (cx=cx1; cx<=cx2; cx++)
+            pilot_gridScan( idx, pilot_gridHash(cx,cy) );
+   }
+
+   qsort( *idx, array_size(*idx), sizeof(int), pilot_gridCmp );
+   return array_size(*idx);
+}
+
+
+/**
+ * @brief Gets the pilots with their centre within a radius of a point.
+ *
+ *    @param[out] idx Array (array.h) to fill with pilot stack positions in
+ *                    stack order. Is created if NULL and cleared otherwise.
+ *    @param x X coordinate of the centre.
+ *    @param y Y coordinate of the centre.
+ *    @param r Radius to look in.
+ *    @return Number of pilots found.
+ */
+int pilot_gridRadius( int **idx, double x, double y, double r )
+{
+   int i, j, n;
+   double r2;
+   Pilot *const* pilot_stack;
+
+   n  = pilot_gridQuery( idx, x-r, y-r, x+r, y+r );
+   r2 = pow2(r);
+   pilot_stack = pilot_getAll();
+   for (i=j=0; i<n; i++) {
+      if (pow2(pilot_stack[ (*idx)[i] ]->solid->pos.x - x) +
+            pow2(pilot_stack[ (*idx)[i] ]->solid->pos.y - y) > r2)
+         continue;
+      (*idx)[j++] = (*idx)[i];
+   }
+   array_resize( idx, j );
+   return j;
+}
+
+
+/**
+ * @brief Scores a pilot and keeps it if it is among the k best so far.
+ *
+ * Ties are broken by stack position so that the results are the same as a
+ *  linear walk over the stack.
+ */
+static void pilot_gridConsider( int i, double x, double y, int k,
+      PilotGridScore score, void *data )
+{
+   int j, n;
+   double s;
+   const Pilot *t;
+   PilotGridHit *h;
+
+   if (pilot_grid_mark[i] == pilot_grid_stamp)
+      return;
+   pilot_grid_mark[i] = pilot_grid_stamp;
+
+   t = pilot_getAll()[i];
+   if (!score( t, pow2(t->solid->pos.x - x) + pow2(t->solid->pos.y - y), data, &s ))
+      return;
+
+   /* Find where it goes. */
+   n = array_size(pilot_grid_hits);
+   for (j=n; j>0; j--) {
+      h = &pilot_grid_hits[j-1];
+      if ((h->score < s) || ((h->score == s) && (h->i < i)))
+         break;
+   }
+   if (j >= k)
+      return;
+
+   /* Insert it, dropping the worst if full. */
+   if (n < k)
+      array_resize( &pilot_grid_hits, n+1 );
+   else
+      n--;
+   memmove( &pilot_grid_hits[j+1], &pilot_grid_hits[j], sizeof(PilotGridHit)*(n-j) );
+   pilot_grid_hits[j].i     = i;
+   pilot_grid_hits[j].score = s;
+}
+
+
+/**
+ * @brief Considers all the pilots in a cell for a k-nearest query.
+ */
+static void pilot_gridConsiderCell( int cx, int cy, double x, double y, int k,
+      PilotGridScore score, void *data )
+{
+   int i, b;
+
+   if ((cx < pilot_grid_x1) || (cx > pilot_grid_x2) ||
+         (cy < pilot_grid_y1) || (cy > pilot_grid_y2))
+      return;
+
+   b = pilot_gridHash( cx, cy );
+   for (i=pilot_grid_start[b]; i<pilot_grid_start[b+1]; i++)
+      pilot_gridConsider( pilot_grid_items[i], x, y, k, score, data );
+}
+
+
+/**
+ * @brief Gets the k best pilots around a point.
+ *
+ * Pilots are scored by a callback that gets the squared distance to the point
+ *  and may also reject them. The search stops as soon as no pilot that has not
+ *  been looked at can beat the k-th best, which requires that scores are never
+ *  below scale times the squared distance. A scale of zero or less disables stopping early.
+ *
+ * Falls back to a plain walk over the stack when the rings of cells would
+ *  cost more than looking at all the pilots.
+ *
+ *    @param[out] idx Array (array.h) to fill with pilot stack positions, best
+ *                    first. Is created if NULL and cleared otherwise.
+ *    @param x X coordinate to search from.
+ *    @param y Y coordinate to search from.
+ *    @param k Maximum number of pilots to get.
+ *    @param scale Minimum factor between the score and the squared distance.
+ *    @param score Function scoring the pilots.
+ *    @param data Data passed to score.
+ *    @return Number of pilots found.
+ */
+int pilot_gridNearest( int **idx, double x, double y, int k, double scale,
+      PilotGridScore score, void *data )
+{
+   int i, n, r, rmax, cx, cy, cx0, cy0, cost;
+   double lb;
+
+   if (*idx == NULL)
+      *idx = array_create( int );
+   else
+      array_erase( idx, array_begin(*idx), array_end(*idx) );
+   if (pilot_grid_hits == NULL)
+      pilot_grid_hits = array_create( PilotGridHit );
+   else
+      array_erase( &pilot_grid_hits, array_begin(pilot_grid_hits), array_end(pilot_grid_hits) );
+
+   if (pilot_grid_dirty)
+      pilot_gridBuild();
+   n = array_size(pilot_grid_mark);
+   if ((n == 0) || (k <= 0))
+      return 0;
+   pilot_gridStamp();
+
+   /* Rings needed to cover every pilot. */
+   cx0  = (int)floor( x / PILOT_GRID_CELL );
+   cy0  = (int)floor( y / PILOT_GRID_CELL );
+   rmax = MAX( MAX( cx0 - pilot_grid_x1, pilot_grid_x2 - cx0 ),
+         MAX( cy0 - pilot_grid_y1, pilot_grid_y2 - cy0 ) );
+
+   cost = 0;
+   for (r=0; r<=rmax; r++) {
+      /* Too many cells, just look at the rest of the pilots. */
+      cost += MAX( 1, 8*r );
+      if (cost > n) {
+         for (i=0; i<n; i++)
+            pilot_gridConsider( i, x, y, k, score, data );
+         break;
+      }
+
+      /* Walk the ring. */
+      if (r == 0)
+         pilot_gridConsiderCell( cx0, cy0, x, y, k, score, data );
+      else {
+         for (cx=cx0-r; cx<=cx0+r; cx++) {
+            pilot_gridConsiderCell( cx, cy0-r, x, y, k, score, data );
+            pilot_gridConsiderCell( cx, cy0+r, x, y, k, score, data );
+         }
+         for (cy=cy0-r+1; cy<cy0+r; cy++) {
+            pilot_gridConsiderCell( cx0-r, cy, x, y, k, score, data );
+            pilot_gridConsiderCell( cx0+r, cy, x, y, k, score, data );
+         }
+      }
+
+      /* See if anything outside of the rings walked so far could do better. */
+      if ((scale <= 0.) || (array_size(pilot_grid_hits) < k))
+         continue;
+      lb = MIN( MIN( x - (cx0-r)*PILOT_GRID_CELL, (cx0+r+1)*PILOT_GRID_CELL - x ),
+            MIN( y - (cy0-r)*PILOT_GRID_CELL, (cy0+r+1)*PILOT_GRID_CELL - y ) );
+      if (pilot_grid_hits[k-1].score < scale * pow2(lb))
+         break;
+   }
+
+   for (i=0; i<array_size(pilot_grid_hits); i++)
+      array_push_back( idx, pilot_grid_hits[i].i );
+   return array_size(*idx);
+}
@@ -0,0 +1,44 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+#ifndef PILOT_GRID_H
+#  define PILOT_GRID_H
+
+
+#include "pilot.h"
+
+
+#define PILOT_GRID_CELL       256.  /**< Width and height of a grid cell. */
+#define PILOT_GRID_BUCKETS    1024  /**< Number of hash buckets, must be a power of two. */
+
+
+/**
+ * @brief Scores a pilot for pilot_gridNearest().
+ *
+ *    @param t Pilot being scored.
+ *    @param d2 Squared distance from the pilot to the point searched from.
+ *    @param data User data.
+ *    @param[out] score Score of the pilot, lower is better.
+ *    @return 1 if the pilot is wanted, 0 to reject it.
+ */
+typedef int (*PilotGridScore)( const Pilot *t, double d2, void *data, double *score );
+
+
+/*
+ * Maintenance.
+ */
+void pilot_gridInvalidate (void);
+void pilot_gridFree (void);
+
+/*
+ * Queries.
+ */
+int pilot_gridQuery( int **idx, double x1, double y1, double x2, double y2 );
+int pilot_gridRadius( int **idx, double x, double y, double r );
+int pilot_gridNearest( int **idx, double x, double y, int k, double scale,
+      PilotGridScore score, void *data );
+
+
+#endif /* PILOT_GRID_H */
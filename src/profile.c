@@ -0,0 +1,425 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+/**
+ * @file profile.c
+ *
+ * @brief Per-frame profiler.
+ *
+ * Stages of the frame are wrapped in profile_begin()/profile_end() pairs,
+ *  which may nest. Each frame keeps the time spent in each stage excluding
+ *  nested ones, which is drawn as a stacked graph. The individual scopes are
+ *  also kept in a ring buffer so they can be dumped as CSV or as a Chrome
+ *  trace (chrome://tracing). Code that runs too often for a scope each time
+ *  uses profile_counter()/profile_accumulate() instead, which only add up the
+ *  time and keep a single event per frame. Everything is a no-op while
+ *  disabled.
+ */
+
+
+/** @cond */
+#include <errno.h>
+#include <stdio.h>
+#include "physfs.h"
+#include "SDL.h"
+
+#include "naev.h"
+/** @endcond */
+
+#include "profile.h"
+
+#include "colour.h"
+#include "font.h"
+#include "log.h"
+#include "opengl.h"
+
+
+#define PROFILE_BAR_W      2.    /**< Width of a frame in the graph. */
+#define PROFILE_GRAPH_H    150.  /**< Height of the graph. */
+#define PROFILE_GRAPH_MS   (2000./60.) /**< Frame time at the top of the graph (ms). */
+
+
+/**
+ * @brief An open scope.
+ */
+typedef struct ProfileScope_ {
+   ProfileZone zone; /**< Zone being timed. */
+   Uint64 start; /**< When it was opened. */
+   Uint64 child; /**< Time spent in nested scopes. */
+} ProfileScope;
+
+
+/**
+ * @brief A closed scope.
+ */
+typedef struct ProfileEvent_ {
+   ProfileZone zone; /**< Zone that was timed. */
+   int depth; /**< Nesting depth, -1 for accumulated zones. */
+   unsigned int frame; /**< Frame it happened in. */
+   Uint64 start; /**< When it was opened. */
+   Uint64 end; /**< When it was closed. */
+} ProfileEvent;
+
+
+/**
+ * @brief Timings of a frame.
+ */
+typedef struct ProfileFrame_ {
+   Uint64 start; /**< Start of the frame. */
+   Uint64 end; /**< End of the frame, 0 if still running. */
+   Uint64 self[PROFILE_MAX]; /**< Time spent in each zone, excluding nested zones. */
+   Uint64 accum[PROFILE_MAX]; /**< Time accumulated with profile_accumulate(). */
+} ProfileFrame;
+
+
+static int profile_on                  = 0; /**< Whether the profiler is running. */
+static double profile_freq             = 1.; /**< Performance counter frequency. */
+static ProfileFrame profile_frames[PROFILE_FRAMES]; /**< Ring buffer of frames. */
+static unsigned int profile_nframes    = 0; /**< Number of frames started. */
+static ProfileEvent profile_events[PROFILE_EVENTS]; /**< Ring buffer of scopes. */
+static unsigned int profile_nevents    = 0; /**< Number of scopes closed. */
+static ProfileScope profile_stack[PROFILE_DEPTH]; /**< Open scopes. */
+static int profile_depth               = 0; /**< Number of open scopes. */
+static int profile_overflow            = 0; /**< Scopes opened past PROFILE_DEPTH. */
+
+/**
+ * @brief Names of the zones.
+ */
+static const char *profile_names[PROFILE_MAX] = {
+   "input", "sound", "update", "space", "weapons", "weapon layer", "collision",
+   "spfx", "pilots", "ai", "hooks", "render", "gui", "toolkit", "swap" };
+/**
+ * @brief Colours of the zones in the graph.
+ */
+static const glColour *profile_colours[PROFILE_MAX] = {
+   &cWhite, &cSilver, &cGrey50, &cBrown, &cOrange, &cRed, &cDarkRed,
+   &cPurple, &cGreen, &cYellow, &cCyan, &cBlue, &cLightBlue, &cAqua, &cGold };
+
+
+/*
+ * Prototypes.
+ */
+static void profile_pushEvent( ProfileZone zone, int depth, Uint64 start, Uint64 end );
+static void profile_dumpCSV( FILE *f, unsigned int first, Uint64 t0 );
+static void profile_dumpTrace( FILE *f, unsigned int first, Uint64 t0 );
+
+
+/**
+ * @brief Enables or disables the profiler.
+ *
+ *    @param enable Whether to enable it.
+ */
+void profile_enable( int enable )
+{
+   if (enable && !profile_on) {
+      profile_freq      = (double) SDL_GetPerformanceFrequency();
+      profile_nframes   = 0;
+      profile_nevents   = 0;
+      profile_depth     = 0;
+      profile_overflow  = 0;
+   }
+   profile_on = enable;
+}
+
+
+/**
+ * @brief Checks to see if the profiler is running.
+ */
+int profile_isEnabled (void)
+{
+   return profile_on;
+}
+
+
+/**
+ * @brief Starts a new frame.
+ */
+void profile_frame (void)
+{
+   int i;
+   Uint64 now;
+   ProfileFrame *f;
+
+   if (!profile_on)
+      return;
+
+   now = SDL_GetPerformanceCounter();
+   if (profile_nframes > 0) {
+      f = &profile_frames[ (profile_nframes-1) % PROFILE_FRAMES ];
+      f->end = now;
+      /* Accumulated zones get one event for the whole frame. */
+      for (i=0; i<PROFILE_MAX; i++)
+         if (f->accum[i] > 0)
+            profile_pushEvent( i, -1, f->start, f->start + f->accum[i] );
+   }
+
+   f = &profile_frames[ profile_nframes % PROFILE_FRAMES ];
+   memset( f, 0, sizeof(ProfileFrame) );
+   f->start = now;
+   profile_nframes++;
+
+   /* Scopes don't span frames. */
+   profile_depth    = 0;
+   profile_overflow = 0;
+}
+
+
+/**
+ * @brief Opens a timed scope.
+ *
+ *    @param zone Zone being timed.
+ */
+void profile_begin( ProfileZone zone )
+{
+   ProfileScope *s;
+
+   if (!profile_on || (profile_nframes == 0))
+      return;
+
+   if (profile_depth >= PROFILE_DEPTH) {
+      profile_overflow++;
+      return;
+   }
+
+   s = &profile_stack[ profile_depth++ ];
+   s->zone  = zone;
+   s->child = 0;
+   s->start = SDL_GetPerformanceCounter();
+}
+
+
+/**
+ * @brief Closes a timed scope.
+ *
+ *    @param zone Zone being timed, must match the last opened scope.
+ */
+void profile_end( ProfileZone zone )
+{
+   Uint64 now, dur;
+   ProfileScope *s;
+
+   if (!profile_on)
+      return;
+
+   if (profile_overflow > 0) {
+      profile_overflow--;
+      return;
+   }
+
+   /* Profiler was enabled inside the scope. */
+   if (profile_depth <= 0)
+      return;
+
+   now = SDL_GetPerformanceCounter();
+   s   = &profile_stack[ --profile_depth ];
+#ifdef DEBUGGING
+   if (s->zone != zone)
+      WARN(_("Profiler scope '%s' closed as '%s'!"), profile_names[s->zone], profile_names[zone]);
+#else /* DEBUGGING */
+   (void) zone;
+#endif /* DEBUGGING */
+   dur = now - s->start;
+
+   /* Frame totals. */
+   profile_frames[ (profile_nframes-1) % PROFILE_FRAMES ].self[ s->zone ] += dur - s->child;
+   if (profile_depth > 0)
+      profile_stack[ profile_depth-1 ].child += dur;
+
+   /* Keep the event. */
+   profile_pushEvent( s->zone, profile_depth, s->start, now );
+}
+
+
+/**
+ * @brief Gets the performance counter to pass to profile_accumulate().
+ *
+ *    @return The performance counter, 0 while disabled.
+ */
+Uint64 profile_counter (void)
+{
+   if (!profile_on)
+      return 0;
+   return SDL_GetPerformanceCounter();
+}
+
+
+/**
+ * @brief Adds the time since start to a zone without opening a scope.
+ *
+ * The time counts as nested in the open scope, but only one event is kept
+ *  per frame for the zone, so it can be used for very frequent code.
+ *
+ *    @param zone Zone to add the time to.
+ *    @param start Counter from profile_counter() when the timed code started.
+ */
+void profile_accumulate( ProfileZone zone, Uint64 start )
+{
+   Uint64 dur;
+   ProfileFrame *f;
+
+   if (!profile_on || (start == 0) || (profile_nframes == 0))
+      return;
+
+   dur = SDL_GetPerformanceCounter() - start;
+   f   = &profile_frames[ (profile_nframes-1) % PROFILE_FRAMES ];
+   f->self[ zone ]  += dur;
+   f->accum[ zone ] += dur;
+   if ((profile_depth > 0) && (profile_overflow == 0))
+      profile_stack[ profile_depth-1 ].child += dur;
+}
+
+
+/**
+ * @brief Adds an event to the ring buffer.
+ */
+static void profile_pushEvent( ProfileZone zone, int depth, Uint64 start, Uint64 end )
+{
+   ProfileEvent *e;
+
+   e = &profile_events[ profile_nevents % PROFILE_EVENTS ];
+   e->zone  = zone;
+   e->depth = depth;
+   e->frame = profile_nframes-1;
+   e->start = start;
+   e->end   = end;
+   profile_nevents++;
+}
+
+
+/**
+ * @brief Renders the frame time graph.
+ */
+void profile_render (void)
+{
+   unsigned int i, n, first;
+   int j;
+   double x, y, x0, y0, h, scale, w;
+   const ProfileFrame *f;
+   char buf[STRMAX_SHORT];
+
+   if (!profile_on || (profile_nframes < 2))
+      return;
+
+   /* Completed frames only. */
+   n     = MIN( profile_nframes-1, PROFILE_FRAMES-1 );
+   first = profile_nframes-1 - n;
+   w     = PROFILE_FRAMES * PROFILE_BAR_W;
+   x0    = SCREEN_W - w - 20.;
+   y0    = 20.;
+   scale = PROFILE_GRAPH_H / PROFILE_GRAPH_MS;
+
+   /* Background and 60 FPS line. */
+   gl_renderRect( x0-5., y0-5., w+10., PROFILE_GRAPH_H+10., &cBlackHilight );
+   gl_renderRect( x0, y0 + 1000./60.*scale, w, 1., &cGrey50 );
+
+   /* Stacked bars. */
+   for (i=0; i<n; i++) {
+      f = &profile_frames[ (first+i) % PROFILE_FRAMES ];
+      x = x0 + i*PROFILE_BAR_W;
+      y = y0;
+      for (j=0; j<PROFILE_MAX; j++) {
+         h = 1000. * (double)f->self[j] / profile_freq * scale;
+         if (h <= 0.)
+            continue;
+         h = MIN( h, y0 + PROFILE_GRAPH_H - y );
+         if (h <= 0.)
+            break;
+         gl_renderRect( x, y, PROFILE_BAR_W, h, profile_colours[j] );
+         y += h;
+      }
+   }
+
+   /* Legend. */
+   y = y0 + PROFILE_GRAPH_H - gl_smallFont.h;
+   for (j=0; j<PROFILE_MAX; j++) {
+      gl_printRaw( &gl_smallFont, x0 - 80., y, profile_colours[j], -1., profile_names[j] );
+      y -= gl_smallFont.h + 2.;
+   }
+
+   /* Last frame time. */
+   f = &profile_frames[ (profile_nframes-2) % PROFILE_FRAMES ];
+   snprintf( buf, sizeof(buf), "%.2f ms", 1000. * (double)(f->end - f->start) / profile_freq );
+   gl_printRaw( &gl_smallFont, x0, y0 + PROFILE_GRAPH_H + 10., &cWhite, -1., buf );
+}
+
+
+/**
+ * @brief Dumps the kept scopes to a file.
+ *
+ * Files ending in ".json" are written as a Chrome trace, anything else as CSV.
+ *
+ *    @param path Path relative to the write directory.
+ *    @return 0 on success.
+ */
+int profile_dump( const char *path )
+{
+   char file[PATH_MAX];
+   unsigned int first;
+   size_t len;
+   FILE *f;
+
+   if (profile_nevents == 0) {
+      WARN(_("No profiling data to dump!"));
+      return -1;
+   }
+
+   snprintf( file, sizeof(file), "%s/%s", PHYSFS_getWriteDir(), path );
+   f = fopen( file, "w" );
+   if (f == NULL) {
+      WARN(_("Unable to open '%s' for writing: %s"), file, strerror(errno));
+      return -1;
+   }
+
+   first = (profile_nevents > PROFILE_EVENTS) ? profile_nevents - PROFILE_EVENTS : 0;
+   len   = strlen( path );
+   if ((len > 5) && (strcmp( &path[len-5], ".json" ) == 0))
+      profile_dumpTrace( f, first, profile_events[ first % PROFILE_EVENTS ].start );
+   else
+      profile_dumpCSV( f, first, profile_events[ first % PROFILE_EVENTS ].start );
+
+   fclose( f );
+   LOG(_("Profiling data written to '%s'."), file);
+   return 0;
+}
+
+
+/**
+ * @brief Writes the scopes as CSV.
+ */
+static void profile_dumpCSV( FILE *f, unsigned int first, Uint64 t0 )
+{
+   unsigned int i;
+   const ProfileEvent *e;
+
+   fprintf( f, "frame,zone,depth,start_us,duration_us\n" );
+   for (i=first; i<profile_nevents; i++) {
+      e = &profile_events[ i % PROFILE_EVENTS ];
+      fprintf( f, "%u,%s,%d,%.3f,%.3f\n", e->frame, profile_names[e->zone], e->depth,
+            1e6 * (double)(e->start - t0) / profile_freq,
+            1e6 * (double)(e->end - e->start) / profile_freq );
+   }
+}
+
+
+/**
+ * @brief Writes the scopes as a Chrome trace.
+ */
+static void profile_dumpTrace( FILE *f, unsigned int first, Uint64 t0 )
+{
+   unsigned int i;
+   const ProfileEvent *e;
+
+   fprintf( f, "{\"traceEvents\":[\n" );
+   for (i=first; i<profile_nevents; i++) {
+      e = &profile_events[ i % PROFILE_EVENTS ];
+      /* Accumulated zones go on their own track since they don't nest. */
+      fprintf( f, "{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"frame\":%u}}%s\n",
+            profile_names[e->zone],
+            1e6 * (double)(e->start - t0) / profile_freq,
+            1e6 * (double)(e->end - e->start) / profile_freq,
+            (e->depth < 0) ? 2 : 1,
+            e->frame, (i+1 < profile_nevents) ? "," : "" );
+   }
+   fprintf( f, "]}\n" );
+}
@@ -0,0 +1,65 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+#ifndef PROFILE_H
+#  define PROFILE_H
+
+
+/** @cond */
+#include "SDL.h"
+/** @endcond */
+
+
+#define PROFILE_FRAMES  120   /**< Number of frames kept for the graph. */
+#define PROFILE_EVENTS  8192  /**< Number of timed scopes kept for dumping. */
+#define PROFILE_DEPTH   16    /**< Maximum nesting of timed scopes. */
+
+
+/**
+ * @brief Stages of a frame that get timed.
+ */
+typedef enum ProfileZone_ {
+   PROFILE_INPUT,    /**< Input handling. */
+   PROFILE_SOUND,    /**< Sound update. */
+   PROFILE_UPDATE,   /**< Game update. */
+   PROFILE_SPACE,    /**< space_update() */
+   PROFILE_WEAPONS,  /**< weapons_update() */
+   PROFILE_WEAPON_LAYER,/**< weapons_updateLayer() loop, including movement and collisions. */
+   PROFILE_COLLISION,/**< Weapon collision checks, accumulated over the frame. */
+   PROFILE_SPFX,     /**< spfx_update() */
+   PROFILE_PILOTS,   /**< pilots_update() */
+   PROFILE_AI,       /**< AI thinking. */
+   PROFILE_HOOKS,    /**< Running hooks. */
+   PROFILE_RENDER,   /**< render_all() */
+   PROFILE_GUI,      /**< GUI rendering. */
+   PROFILE_TOOLKIT,  /**< Toolkit rendering. */
+   PROFILE_SWAP,     /**< Buffer swap. */
+   PROFILE_MAX       /**< Sentinel. */
+} ProfileZone;
+
+
+/*
+ * Control.
+ */
+void profile_enable( int enable );
+int profile_isEnabled (void);
+
+/*
+ * Timing.
+ */
+void profile_frame (void);
+void profile_begin( ProfileZone zone );
+void profile_end( ProfileZone zone );
+Uint64 profile_counter (void);
+void profile_accumulate( ProfileZone zone, Uint64 start );
+
+/*
+ * Output.
+ */
+void profile_render (void);
+int profile_dump( const char *path );
+
+
+#endif /* PROFILE_H */
@@ -15,6 +15,7 @@
 #include "opengl.h"
 #include "pause.h"
 #include "player.h"
+#include "profile.h"
 #include "space.h"
 #include "spfx.h"
 #include "toolkit.h"
@@ -232,7 +233,9 @@ void render_all( double game_dt, double real_dt )
       render_fbo_list( dt, pp_shaders_list[PP_LAYER_GAME], &cur, !(pp_final || pp_gui) );
 
    /* GUi stuff. */
+   profile_begin( PROFILE_GUI );
    gui_render(dt);
+   profile_end( PROFILE_GUI );
 
    if (pp_gui)
       render_fbo_list( dt, pp_shaders_list[PP_LAYER_GUI], &cur, !pp_final );
@@ -240,7 +243,10 @@ void render_all( double game_dt, double real_dt )
    /* Top stuff. */
    ovr_render(dt);
    display_fps( real_dt ); /* Exception using real_dt. */
+   profile_render();
+   profile_begin( PROFILE_TOOLKIT );
    toolkit_render();
+   profile_end( PROFILE_TOOLKIT );
 
    /* Final post-processing. */
    if (pp_final)
@@ -89,6 +89,20 @@ void rng_init (void)
 }
 
 
+/**
+ * @brief Initializes the random subsystem with a fixed seed, for reproducible runs.
+ *
+ *    @param seed Seed to use.
+ */
+void rng_initSeed( unsigned int seed )
+{
+   int i;
+   mt_initArray( seed );
+   for (i=0; i<10; i++) /* generate numbers to get away from poor initial values */
+      mt_genArray();
+}
+
+
 /**
  * @fn static uint32_t rng_timeEntropy (void)
  *
@@ -6,21 +6,121 @@
  * @file safelanes.c
  *
  * @brief Handles factions' safe lanes through systems.
+ *
+ * The universe is modelled as an electrical network. Vertices are the
+ * planets and jump points of every system, every pair of vertices in a system
+ * is joined by a route, and matching jump points are joined by a hyperspace
+ * route. A route conducts poorly unless a faction patrols it as a lane.
+ *
+ * Each faction injects current at its planets and draws it evenly from all
+ * the planets. Solving the Laplacian of the network gives the potentials of
+ * the vertices, and the energy saved by lighting a route is proportional to
+ * the square of the potential drop over its length. Factions greedily light
+ * the most useful routes in the systems they have presence in until their
+ * budget runs out.
+ *
+ * The Laplacian is factorized once with CHOLMOD. Lighting or unlighting
+ * routes only changes it by rank one per route, so the factorization is
+ * updated or downdated instead of being recomputed. When the universe changes
+ * only the systems that changed and their neighbours get their lanes
+ * reconsidered.
  */
 
 /** @cond */
 #include <cholmod.h>
 #include <math.h>
+#include <string.h>
 
 #include "naev.h"
 /** @endcond */
 
 #include "safelanes.h"
 
+#include "array.h"
+#include "log.h"
+
+
+extern StarSystem *systems_stack; /**< Star system stack. */
+
+
+/*
+ * Parameters.
+ */
+#define SAFELANES_LENGTH_SCALE   1000. /**< Distance that counts as one unit of lane length. */
+#define SAFELANES_LENGTH_MIN     0.1   /**< Shortest route length considered, avoids huge conductances. */
+#define SAFELANES_COND_UNLIT     0.01  /**< Conductance of an unpatrolled route relative to a lane. */
+#define SAFELANES_COND_JUMP      1.    /**< Conductance of the hyperspace route between two jump points. */
+#define SAFELANES_GROUND         1e-6  /**< Conductance of every vertex to ground, keeps the Laplacian definite. */
+#define SAFELANES_BUDGET         0.25  /**< Lane length a faction can patrol per unit of presence. */
+#define SAFELANES_ROUNDS         32    /**< Maximum rounds of lane building per recalculation. */
+
+
+/**
+ * @brief A point lanes can end at.
+ */
+typedef struct Vertex_ {
+   int system; /**< ID of the system containing the vertex. */
+   SafeLaneLocType type; /**< Type of the vertex. */
+   int index; /**< Planet ID, or ID of the target system for jump points. */
+} Vertex;
+
+
+/**
+ * @brief A route between two vertices.
+ */
+typedef struct Edge_ {
+   int v[2]; /**< Vertices joined, v[0] < v[1]. */
+   double length; /**< Length of the route, in SAFELANES_LENGTH_SCALE units. */
+   int jump; /**< Whether the route is through hyperspace. */
+   int faction; /**< Faction patrolling the route, -1 if none. */
+} Edge;
+
+
+/**
+ * @brief A route a faction wants to patrol.
+ */
+typedef struct Candidate_ {
+   int edge; /**< Edge to light. */
+   int faction; /**< Index of the faction in safelanes_factions. */
+   double score; /**< Energy saved per unit of budget. */
+} Candidate;
+
+
 /*
  * Global state.
  */
-static cholmod_common C;
+static cholmod_common C; /**< CHOLMOD workspace and parameters. */
+static Vertex *vertex_stack = NULL; /**< Array (array.h): Vertices of the network. */
+static Edge *edge_stack = NULL; /**< Array (array.h): Edges, grouped by system, hyperspace routes last. */
+static int *sys_to_first_vertex = NULL; /**< Array (array.h): First vertex of each system, plus the total. */
+static int *sys_to_first_edge = NULL; /**< Array (array.h): First edge of each system, plus the first hyperspace route. */
+static unsigned int *sys_signature = NULL; /**< Array (array.h): State of each system when last computed. */
+static int *safelanes_factions = NULL; /**< Array (array.h): Factions owning planets, one column of potentials each. */
+static double *safelanes_budget = NULL; /**< Array (array.h): Remaining budget of each faction in each system. */
+static cholmod_factor *safelanes_L = NULL; /**< Factorization of the Laplacian of the network. */
+static int *safelanes_Pinv = NULL; /**< Array (array.h): Inverse of the fill-reducing permutation of the factorization. */
+static SafeLane **lane_cache = NULL; /**< Array (array.h): Lanes of each system. */
+
+
+/*
+ * Prototypes.
+ */
+static void safelanes_buildGraph( Vertex **vertices, Edge **edges, int **first_vertex, int **first_edge );
+static int safelanes_sameGraph( const Vertex *vertices, const Edge *edges );
+static const Vector2d* safelanes_vertexPos( const Vertex *v );
+static unsigned int safelanes_signature( const StarSystem *sys );
+static unsigned int safelanes_hash( unsigned int h, const void *data, size_t len );
+static double safelanes_conductance( const Edge *e );
+static int safelanes_factorize (void);
+static int safelanes_updown( const int *edges, const double *dc, int update );
+static void safelanes_initFactions (void);
+static cholmod_dense* safelanes_sources (void);
+static int safelanes_factionIndex( int faction );
+static void safelanes_initBudget( const char *mask );
+static void safelanes_optimize( const char *mask );
+static void safelanes_buildCache (void);
+static void safelanes_freeCache (void);
+static void safelanes_freeGraph (void);
 
 
 /**
@@ -29,6 +129,7 @@ static cholmod_common C;
 void safelanes_init (void)
 {
    cholmod_start( &C );
+   safelanes_recalculate();
 }
 
 
@@ -37,27 +138,727 @@ void safelanes_init (void)
  */
 void safelanes_destroy (void)
 {
+   safelanes_freeCache();
+   safelanes_freeGraph();
+   array_free( sys_signature );
+   sys_signature = NULL;
+   array_free( safelanes_Pinv );
+   safelanes_Pinv = NULL;
+   cholmod_free_factor( &safelanes_L, &C );
    cholmod_finish( &C );
 }
 
 
 /**
- * @brief Shuts down the safelanes system.
+ * @brief Gets the safe lanes of a system.
+ *
  *    @param faction ID of the faction whose lanes we want, or a negative value signifying "all of them".
  *    @param system Star system whose lanes we want.
  *    @return Array (array.h) of matching SafeLane structures. Caller frees.
  */
 SafeLane* safelanes_get (int faction, const StarSystem* system)
 {
-   (void)faction;
-   (void)system;
-   return NULL;
+   int i;
+   SafeLane *lanes, *out;
+
+   out = array_create( SafeLane );
+   if ((system == NULL) || (system->id >= array_size(lane_cache)))
+      return out;
+
+   lanes = lane_cache[ system->id ];
+   for (i=0; i<array_size(lanes); i++)
+      if ((faction < 0) || (lanes[i].faction == faction))
+         array_push_back( &out, lanes[i] );
+   return out;
 }
 
 
 /**
  * @brief Update the safe lane locations in response to the universe changing (e.g., diff applied).
+ *
+ * Only the systems that changed since the last computation and their
+ * neighbours get their lanes reconsidered, the rest are kept.
  */
 void safelanes_recalculate (void)
 {
+   int i, j, k, n, nsys, same, full;
+   Vertex *vertices;
+   Edge *edges;
+   int *first_vertex, *first_edge, *reset;
+   unsigned int *signature;
+   char *mask;
+   double *dc;
+   StarSystem *sys;
+
+   nsys = array_size( systems_stack );
+
+   /* Figure out which systems changed. */
+   signature = array_create_size( unsigned int, nsys );
+   for (i=0; i<nsys; i++)
+      array_push_back( &signature, safelanes_signature( &systems_stack[i] ) );
+   full = (array_size(sys_signature) != nsys) || (edge_stack == NULL);
+   mask = calloc( nsys, sizeof(char) );
+   for (i=0; i<nsys; i++) {
+      if (!full && (signature[i] == sys_signature[i]))
+         continue;
+      mask[i] = 1;
+      /* Neighbours see different flows. */
+      sys = &systems_stack[i];
+      for (j=0; j<array_size(sys->jumps); j++)
+         if (mask[ sys->jumps[j].targetid ] == 0)
+            mask[ sys->jumps[j].targetid ] = 2;
+   }
+   array_free( sys_signature );
+   sys_signature = signature;
+
+   /* Nothing to do. */
+   for (i=0; i<nsys; i++)
+      if (mask[i])
+         break;
+   if (i >= nsys) {
+      free( mask );
+      return;
+   }
+
+   /* Rebuild the network, keeping the lanes of the systems left alone. */
+   safelanes_buildGraph( &vertices, &edges, &first_vertex, &first_edge );
+   same = !full && safelanes_sameGraph( vertices, edges );
+   reset = array_create( int );
+   if (!full) {
+      for (i=0; i<nsys; i++) {
+         n = first_edge[i+1] - first_edge[i];
+         /* Systems that are left alone have the same routes in the same order. */
+         if (!mask[i] && (n == sys_to_first_edge[i+1] - sys_to_first_edge[i])) {
+            for (j=0; j<n; j++)
+               edges[ first_edge[i]+j ].faction = edge_stack[ sys_to_first_edge[i]+j ].faction;
+            continue;
+         }
+         mask[i] = 1;
+         if (!same)
+            continue;
+         /* Lanes that go away have to be taken out of the factorization. */
+         for (j=0; j<n; j++) {
+            k = sys_to_first_edge[i]+j;
+            if (edge_stack[k].faction >= 0)
+               array_push_back( &reset, k );
+         }
+      }
+   }
+
+   if (same && (safelanes_L != NULL)) {
+      /* Downdate the lanes being reconsidered. */
+      dc = malloc( MAX(1,array_size(reset)) * sizeof(double) );
+      for (i=0; i<array_size(reset); i++)
+         dc[i] = (1. - SAFELANES_COND_UNLIT) / edge_stack[ reset[i] ].length;
+      if (safelanes_updown( reset, dc, 0 ))
+         same = 0;
+      free( dc );
+   }
+   else
+      same = 0;
+   safelanes_freeGraph();
+   vertex_stack = vertices;
+   edge_stack   = edges;
+   sys_to_first_vertex = first_vertex;
+   sys_to_first_edge   = first_edge;
+   if (!same && safelanes_factorize()) {
+      /* Start from scratch next time. */
+      array_free( sys_signature );
+      sys_signature = NULL;
+      array_free( reset );
+      free( mask );
+      safelanes_freeCache();
+      return;
+   }
+   array_free( reset );
+
+   /* Let the factions light new lanes. */
+   safelanes_initBudget( mask );
+   safelanes_optimize( mask );
+   free( mask );
+
+   safelanes_buildCache();
+}
+
+
+/**
+ * @brief Builds the network from the current universe.
+ *
+ *    @param[out] vertices Array (array.h) of vertices.
+ *    @param[out] edges Array (array.h) of edges.
+ *    @param[out] first_vertex Array (array.h) of the first vertex of each system, plus the total.
+ *    @param[out] first_edge Array (array.h) of the first edge of each system, plus the first hyperspace route.
+ */
+static void safelanes_buildGraph( Vertex **vertices, Edge **edges, int **first_vertex, int **first_edge )
+{
+   int i, j, k, a, b;
+   StarSystem *sys;
+   Planet *pnt;
+   JumpPoint *jp;
+   Vertex *v;
+   Edge *e;
+
+   *vertices     = array_create( Vertex );
+   *edges        = array_create( Edge );
+   *first_vertex = array_create_size( int, array_size(systems_stack)+1 );
+   *first_edge   = array_create_size( int, array_size(systems_stack)+1 );
+
+   for (i=0; i<array_size(systems_stack); i++) {
+      sys = &systems_stack[i];
+      array_push_back( first_vertex, array_size(*vertices) );
+      array_push_back( first_edge, array_size(*edges) );
+
+      /* Planets first, then jump points. */
+      for (j=0; j<array_size(sys->planets); j++) {
+         pnt = sys->planets[j];
+         if (pnt->real != ASSET_REAL)
+            continue;
+         v = &array_grow( vertices );
+         v->system = i;
+         v->type   = SAFELANE_LOC_PLANET;
+         v->index  = pnt->id;
+      }
+      for (j=0; j<array_size(sys->jumps); j++) {
+         jp = &sys->jumps[j];
+         if (jp_isFlag( jp, JP_HIDDEN ) || jp_isFlag( jp, JP_EXITONLY ))
+            continue;
+         v = &array_grow( vertices );
+         v->system = i;
+         v->type   = SAFELANE_LOC_DEST_SYS;
+         v->index  = jp->targetid;
+      }
+
+      /* Every pair of vertices in the system gets a route. */
+      a = (*first_vertex)[i];
+      b = array_size(*vertices);
+      for (j=a; j<b; j++) {
+         for (k=j+1; k<b; k++) {
+            e = &array_grow( edges );
+            e->v[0]    = j;
+            e->v[1]    = k;
+            e->jump    = 0;
+            e->faction = -1;
+            e->length  = vect_dist( safelanes_vertexPos( &(*vertices)[j] ),
+                  safelanes_vertexPos( &(*vertices)[k] ) );
+            e->length  = MAX( SAFELANES_LENGTH_MIN, e->length / SAFELANES_LENGTH_SCALE );
+         }
+      }
+   }
+   array_push_back( first_vertex, array_size(*vertices) );
+   array_push_back( first_edge, array_size(*edges) );
+
+   /* Hyperspace routes join matching jump points, each added once. */
+   for (i=0; i<array_size(*vertices); i++) {
+      v = &(*vertices)[i];
+      if ((v->type != SAFELANE_LOC_DEST_SYS) || (v->index < v->system))
+         continue;
+      for (j=(*first_vertex)[v->index]; j<(*first_vertex)[v->index+1]; j++) {
+         if (((*vertices)[j].type != SAFELANE_LOC_DEST_SYS) || ((*vertices)[j].index != v->system))
+            continue;
+         e = &array_grow( edges );
+         e->v[0]    = MIN( i, j );
+         e->v[1]    = MAX( i, j );
+         e->length  = 0.;
+         e->jump    = 1;
+         e->faction = -1;
+         break;
+      }
+   }
+}
+
+
+/**
+ * @brief Gets the position of a vertex in its system.
+ */
+static const Vector2d* safelanes_vertexPos( const Vertex *v )
+{
+   if (v->type == SAFELANE_LOC_PLANET)
+      return &planet_getIndex( v->index )->pos;
+   return &jump_getTarget( system_getIndex( v->index ), system_getIndex( v->system ) )->pos;
+}
+
+
+/**
+ * @brief Checks to see if a network is the same as the current one.
+ *
+ *    @param vertices Vertices of the network.
+ *    @param edges Edges of the network.
+ *    @return 1 if the network is the same, 0 otherwise.
+ */
+static int safelanes_sameGraph( const Vertex *vertices, const Edge *edges )
+{
+   int i;
+
+   if ((array_size(vertices) != array_size(vertex_stack)) ||
+         (array_size(edges) != array_size(edge_stack)))
+      return 0;
+   for (i=0; i<array_size(vertices); i++)
+      if ((vertices[i].system != vertex_stack[i].system) ||
+            (vertices[i].type != vertex_stack[i].type) ||
+            (vertices[i].index != vertex_stack[i].index))
+         return 0;
+   for (i=0; i<array_size(edges); i++)
+      if ((edges[i].v[0] != edge_stack[i].v[0]) ||
+            (edges[i].v[1] != edge_stack[i].v[1]) ||
+            (edges[i].length != edge_stack[i].length))
+         return 0;
+   return 1;
+}
+
+
+/**
+ * @brief Summarizes everything in a system that affects its lanes.
+ *
+ *    @param sys System to summarize.
+ *    @return Hash of the state of the system.
+ */
+static unsigned int safelanes_signature( const StarSystem *sys )
+{
+   int i;
+   unsigned int h;
+   const Planet *pnt;
+   const JumpPoint *jp;
+   const SystemPresence *sp;
+
+   h = 2166136261u;
+   for (i=0; i<array_size(sys->planets); i++) {
+      pnt = sys->planets[i];
+      h = safelanes_hash( h, &pnt->id, sizeof(int) );
+      h = safelanes_hash( h, &pnt->real, sizeof(int) );
+      h = safelanes_hash( h, &pnt->faction, sizeof(int) );
+      h = safelanes_hash( h, &pnt->presenceAmount, sizeof(double) );
+      h = safelanes_hash( h, &pnt->pos, sizeof(Vector2d) );
+   }
+   for (i=0; i<array_size(sys->jumps); i++) {
+      jp = &sys->jumps[i];
+      h = safelanes_hash( h, &jp->targetid, sizeof(int) );
+      h = safelanes_hash( h, &jp->flags, sizeof(unsigned int) );
+      h = safelanes_hash( h, &jp->pos, sizeof(Vector2d) );
+   }
+   for (i=0; i<array_size(sys->presence); i++) {
+      sp = &sys->presence[i];
+      h = safelanes_hash( h, &sp->faction, sizeof(int) );
+      h = safelanes_hash( h, &sp->value, sizeof(double) );
+   }
+   return h;
+}
+
+
+/**
+ * @brief Feeds data into an FNV-1a hash.
+ */
+static unsigned int safelanes_hash( unsigned int h, const void *data, size_t len )
+{
+   size_t i;
+   const unsigned char *c = data;
+   for (i=0; i<len; i++) {
+      h ^= c[i];
+      h *= 16777619u;
+   }
+   return h;
+}
+
+
+/**
+ * @brief Gets the conductance of an edge.
+ */
+static double safelanes_conductance( const Edge *e )
+{
+   if (e->jump)
+      return SAFELANES_COND_JUMP;
+   if (e->faction >= 0)
+      return 1. / e->length;
+   return SAFELANES_COND_UNLIT / e->length;
+}
+
+
+/**
+ * @brief Factorizes the Laplacian of the current network from scratch.
+ *
+ *    @return 0 on success.
+ */
+static int safelanes_factorize (void)
+{
+   int i, n, nnz, *ti, *tj, *perm;
+   double c, *tx;
+   cholmod_triplet *T;
+   cholmod_sparse *A;
+   const Edge *e;
+
+   cholmod_free_factor( &safelanes_L, &C );
+   array_free( safelanes_Pinv );
+   safelanes_Pinv = NULL;
+
+   n = array_size( vertex_stack );
+   if (n == 0)
+      return -1;
+
+   /* Upper triangle only, duplicates get summed. */
+   T  = cholmod_allocate_triplet( n, n, n + 3*array_size(edge_stack), 1, CHOLMOD_REAL, &C );
+   ti = T->i;
+   tj = T->j;
+   tx = T->x;
+   nnz = 0;
+   for (i=0; i<n; i++) {
+      ti[nnz] = tj[nnz] = i;
+      tx[nnz++] = SAFELANES_GROUND;
+   }
+   for (i=0; i<array_size(edge_stack); i++) {
+      e = &edge_stack[i];
+      c = safelanes_conductance( e );
+      ti[nnz] = tj[nnz] = e->v[0];
+      tx[nnz++] = c;
+      ti[nnz] = tj[nnz] = e->v[1];
+      tx[nnz++] = c;
+      ti[nnz] = e->v[0];
+      tj[nnz] = e->v[1];
+      tx[nnz++] = -c;
+   }
+   T->nnz = nnz;
+   A = cholmod_triplet_to_sparse( T, nnz, &C );
+   cholmod_free_triplet( &T, &C );
+
+   safelanes_L = cholmod_analyze( A, &C );
+   if ((safelanes_L == NULL) || !cholmod_factorize( A, safelanes_L, &C ) ||
+         (C.status != CHOLMOD_OK)) {
+      WARN(_("Safe lanes: unable to factorize the network (CHOLMOD status %d)."), C.status);
+      cholmod_free_sparse( &A, &C );
+      cholmod_free_factor( &safelanes_L, &C );
+      return -1;
+   }
+   cholmod_free_sparse( &A, &C );
+
+   /* Update vectors have to be permuted like the factorization. */
+   perm = safelanes_L->Perm;
+   safelanes_Pinv = array_create_size( int, n );
+   array_resize( &safelanes_Pinv, n );
+   for (i=0; i<n; i++)
+      safelanes_Pinv[ perm[i] ] = i;
+
+   return 0;
+}
+
+
+/**
+ * @brief Updates or downdates the factorization after edges changed conductance.
+ *
+ *    @param edges Array (array.h) of the edges that changed.
+ *    @param dc Amount the conductance of each edge changed by.
+ *    @param update 1 if the conductances went up, 0 if they went down.
+ *    @return 0 on success.
+ */
+static int safelanes_updown( const int *edges, const double *dc, int update )
+{
+   int i, k, a, b, *cp, *ci;
+   double s, *cx;
+   cholmod_sparse *U;
+   const Edge *e;
+
+   k = array_size( edges );
+   if ((k == 0) || (safelanes_L == NULL))
+      return 0;
+
+   /* Each edge adds or removes dc (e_u - e_v)(e_u - e_v)'. */
+   U  = cholmod_allocate_sparse( safelanes_L->n, k, 2*k, 1, 1, 0, CHOLMOD_REAL, &C );
+   cp = U->p;
+   ci = U->i;
+   cx = U->x;
+   for (i=0; i<k; i++) {
+      e = &edge_stack[ edges[i] ];
+      a = safelanes_Pinv[ e->v[0] ];
+      b = safelanes_Pinv[ e->v[1] ];
+      s = sqrt( dc[i] );
+      cp[i]     = 2*i;
+      ci[2*i]   = MIN( a, b );
+      ci[2*i+1] = MAX( a, b );
+      cx[2*i]   = s;
+      cx[2*i+1] = -s;
+   }
+   cp[k] = 2*k;
+
+   if (!cholmod_updown( update, U, safelanes_L, &C ) || (C.status != CHOLMOD_OK)) {
+      WARN(_("Safe lanes: unable to update the factorization (CHOLMOD status %d)."), C.status);
+      cholmod_free_sparse( &U, &C );
+      return -1;
+   }
+   cholmod_free_sparse( &U, &C );
+   return 0;
+}
+
+
+/**
+ * @brief Gets the index of a faction in safelanes_factions.
+ *
+ *    @param faction ID of the faction.
+ *    @return Index of the faction, -1 if it doesn't own planets.
+ */
+static int safelanes_factionIndex( int faction )
+{
+   int i;
+   for (i=0; i<array_size(safelanes_factions); i++)
+      if (safelanes_factions[i] == faction)
+         return i;
+   return -1;
+}
+
+
+/**
+ * @brief Refreshes the list of factions owning planets.
+ */
+static void safelanes_initFactions (void)
+{
+   int i;
+   const Planet *pnt;
+
+   array_free( safelanes_factions );
+   safelanes_factions = array_create( int );
+   for (i=0; i<array_size(vertex_stack); i++) {
+      if (vertex_stack[i].type != SAFELANE_LOC_PLANET)
+         continue;
+      pnt = planet_getIndex( vertex_stack[i].index );
+      if ((pnt->faction >= 0) && (safelanes_factionIndex( pnt->faction ) < 0))
+         array_push_back( &safelanes_factions, pnt->faction );
+   }
+}
+
+
+/**
+ * @brief Builds the currents each faction injects into the network.
+ *
+ *    @return Matrix of currents, one column per faction.
+ */
+static cholmod_dense* safelanes_sources (void)
+{
+   int i, j, n, f, nplanets;
+   double *x, w, *total;
+   cholmod_dense *B;
+   const Planet *pnt;
+
+   n = array_size( vertex_stack );
+   f = array_size( safelanes_factions );
+   B = cholmod_zeros( n, MAX(1,f), CHOLMOD_REAL, &C );
+   x = B->x;
+   total = calloc( MAX(1,f), sizeof(double) );
+
+   /* Each faction's planets inject current. */
+   nplanets = 0;
+   for (i=0; i<n; i++) {
+      if (vertex_stack[i].type != SAFELANE_LOC_PLANET)
+         continue;
+      nplanets++;
+      pnt = planet_getIndex( vertex_stack[i].index );
+      j   = safelanes_factionIndex( pnt->faction );
+      if (j < 0)
+         continue;
+      w   = MAX( 1., pnt->presenceAmount );
+      x[ j*n + i ] += w;
+      total[j]     += w;
+   }
+
+   /* All the planets draw it back evenly. */
+   for (i=0; i<n; i++) {
+      if (vertex_stack[i].type != SAFELANE_LOC_PLANET)
+         continue;
+      for (j=0; j<f; j++)
+         x[ j*n + i ] -= total[j] / nplanets;
+   }
+
+   free( total );
+   return B;
+}
+
+
+/**
+ * @brief Sets the budgets of the factions in the systems being reconsidered.
+ *
+ *    @param mask Which systems are being reconsidered.
+ */
+static void safelanes_initBudget( const char *mask )
+{
+   int i, j, k, nsys, f;
+   StarSystem *sys;
+
+   safelanes_initFactions();
+
+   nsys = array_size( systems_stack );
+   f    = array_size( safelanes_factions );
+   array_free( safelanes_budget );
+   safelanes_budget = array_create_size( double, nsys*f );
+   array_resize( &safelanes_budget, nsys*f );
+   memset( safelanes_budget, 0, nsys*f*sizeof(double) );
+
+   for (i=0; i<nsys; i++) {
+      if (!mask[i])
+         continue;
+      sys = &systems_stack[i];
+      for (j=0; j<array_size(sys->presence); j++) {
+         k = safelanes_factionIndex( sys->presence[j].faction );
+         if (k >= 0)
+            safelanes_budget[ i*f+k ] = SAFELANES_BUDGET * MAX( 0., sys->presence[j].value );
+      }
+   }
+}
+
+
+/**
+ * @brief Lets the factions light lanes in the systems being reconsidered.
+ *
+ * Every round, each faction picks the most useful route it can afford in each
+ * system, then the factorization is updated and the potentials recomputed.
+ *
+ *    @param mask Which systems are being reconsidered.
+ */
+static void safelanes_optimize( const char *mask )
+{
+   int i, j, r, s, f, nf, n, best;
+   int *lit;
+   double d, score, bestscore, *x, *dc;
+   cholmod_dense *B, *X;
+   Candidate *cand;
+   const Edge *e;
+
+   B  = safelanes_sources();
+   nf = array_size( safelanes_factions );
+   n  = array_size( vertex_stack );
+   if (nf == 0) {
+      cholmod_free_dense( &B, &C );
+      return;
+   }
+
+   cand = array_create( Candidate );
+   lit  = array_create( int );
+   dc   = NULL;
+   for (r=0; r<SAFELANES_ROUNDS; r++) {
+      X = cholmod_solve( CHOLMOD_A, safelanes_L, B, &C );
+      if (X == NULL) {
+         WARN(_("Safe lanes: unable to solve the network (CHOLMOD status %d)."), C.status);
+         break;
+      }
+      x = X->x;
+
+      /* Each faction picks its best affordable route in each system. */
+      array_resize( &cand, 0 );
+      for (s=0; s<array_size(systems_stack); s++) {
+         if (!mask[s])
+            continue;
+         for (f=0; f<nf; f++) {
+            if (safelanes_budget[ s*nf+f ] <= 0.)
+               continue;
+            best      = -1;
+            bestscore = 0.;
+            for (i=sys_to_first_edge[s]; i<sys_to_first_edge[s+1]; i++) {
+               e = &edge_stack[i];
+               if ((e->faction >= 0) || (e->length > safelanes_budget[ s*nf+f ]))
+                  continue;
+               d     = x[ f*n + e->v[0] ] - x[ f*n + e->v[1] ];
+               score = d*d / (e->length*e->length);
+               if (score > bestscore) {
+                  best      = i;
+                  bestscore = score;
+               }
+            }
+            if (best < 0)
+               continue;
+
+            /* Only the most interested faction gets a contested route. */
+            for (j=0; j<array_size(cand); j++)
+               if (cand[j].edge == best)
+                  break;
+            if (j < array_size(cand)) {
+               if (cand[j].score < bestscore) {
+                  cand[j].faction = f;
+                  cand[j].score   = bestscore;
+               }
+               continue;
+            }
+            array_push_back( &cand, ((Candidate){ .edge=best, .faction=f, .score=bestscore }) );
+         }
+      }
+      cholmod_free_dense( &X, &C );
+      if (array_size(cand) == 0)
+         break;
+
+      /* Light the routes. */
+      array_resize( &lit, 0 );
+      free( dc );
+      dc = malloc( array_size(cand) * sizeof(double) );
+      for (i=0; i<array_size(cand); i++) {
+         j = cand[i].edge;
+         s = vertex_stack[ edge_stack[j].v[0] ].system;
+         edge_stack[j].faction = safelanes_factions[ cand[i].faction ];
+         safelanes_budget[ s*nf + cand[i].faction ] -= edge_stack[j].length;
+         dc[i] = (1. - SAFELANES_COND_UNLIT) / edge_stack[j].length;
+         array_push_back( &lit, j );
+      }
+      if (safelanes_updown( lit, dc, 1 ))
+         break;
+   }
+
+   free( dc );
+   array_free( lit );
+   array_free( cand );
+   cholmod_free_dense( &B, &C );
+}
+
+
+/**
+ * @brief Rebuilds the per-system lane lists from the lit edges.
+ */
+static void safelanes_buildCache (void)
+{
+   int i, j, s;
+   SafeLane *lane;
+   const Edge *e;
+   const Vertex *v;
+
+   safelanes_freeCache();
+   lane_cache = array_create_size( SafeLane*, array_size(systems_stack) );
+   for (s=0; s<array_size(systems_stack); s++) {
+      array_push_back( &lane_cache, array_create( SafeLane ) );
+      for (i=sys_to_first_edge[s]; i<sys_to_first_edge[s+1]; i++) {
+         e = &edge_stack[i];
+         if (e->faction < 0)
+            continue;
+         lane = &array_grow( &lane_cache[s] );
+         lane->faction = e->faction;
+         for (j=0; j<2; j++) {
+            v = &vertex_stack[ e->v[j] ];
+            lane->point_type[j] = v->type;
+            lane->point_id[j]   = v->index;
+         }
+      }
+   }
+}
+
+
+/**
+ * @brief Frees the per-system lane lists.
+ */
+static void safelanes_freeCache (void)
+{
+   int i;
+   for (i=0; i<array_size(lane_cache); i++)
+      array_free( lane_cache[i] );
+   array_free( lane_cache );
+   lane_cache = NULL;
+}
+
+
+/**
+ * @brief Frees the network, its factorization is kept.
+ */
+static void safelanes_freeGraph (void)
+{
+   array_free( vertex_stack );
+   vertex_stack = NULL;
+   array_free( edge_stack );
+   edge_stack = NULL;
+   array_free( sys_to_first_vertex );
+   sys_to_first_vertex = NULL;
+   array_free( sys_to_first_edge );
+   sys_to_first_edge = NULL;
+   array_free( safelanes_factions );
+   safelanes_factions = NULL;
+   array_free( safelanes_budget );
+   safelanes_budget = NULL;
 }
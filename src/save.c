@@ -30,6 +30,7 @@
 #include "ndata.h"
 #include "nlua_var.h"
 #include "nstring.h"
+#include "ntime.h"
 #include "nxml.h"
 #include "player.h"
 #include "shiplog.h"
@@ -63,6 +64,7 @@ extern int economy_sysSave( xmlTextWriterPtr writer ); /**< Saves the economy st
 extern int diff_save( xmlTextWriterPtr writer ); /**< Saves the universe diffs. */
 /* static */
 static int save_data( xmlTextWriterPtr writer );
+static int save_header( const char *path );
 
 
 /**
@@ -164,6 +166,11 @@ int save_all (void)
    }
    xmlFreeDoc(doc);
 
+   /* Write the header index for the load menu. */
+   snprintf(file, sizeof(file), "saves/%s.ns", player.name);
+   if (save_header( file ) < 0)
+      WARN(_("Failed to write header of saved game '%s'."), file);
+
    return 0;
 
 err_writer:
@@ -173,6 +180,69 @@ err:
    return -1;
 }
 
+/**
+ * @brief Writes the header index of a saved game.
+ *
+ * The header holds what the load menu displays, so it does not have to parse
+ *  the whole (possibly compressed) saved game. It stores the size of the save
+ *  it was written for so stale headers can be detected.
+ *
+ *    @param path PhysicsFS path of the saved game.
+ *    @return 0 on success.
+ */
+static int save_header( const char *path )
+{
+   char file[PATH_MAX];
+   xmlDocPtr doc;
+   xmlTextWriterPtr writer;
+   PHYSFS_Stat stat;
+   int cycles, periods, seconds;
+   double rem;
+
+   if (!PHYSFS_stat( path, &stat ))
+      return -1;
+
+   /* Headers are tiny, never compress them. */
+   writer = xmlNewTextWriterDoc(&doc, 0);
+   if (writer == NULL)
+      return -1;
+   xmlw_setParams( writer );
+
+   xmlw_start(writer);
+   xmlw_startElem(writer,"naev_save_header");
+   xmlw_elem(writer,"size","%"PRId64,(int64_t)stat.filesize);
+
+   xmlw_startElem(writer,"version");
+   xmlw_elem( writer, "naev", "%s", VERSION );
+   xmlw_elem( writer, "data", "%s", start_name() );
+   xmlw_endElem(writer); /* "version" */
+
+   xmlw_startElem(writer,"player");
+   xmlw_attr(writer,"name","%s",player.name);
+   xmlw_elem(writer,"location","%s",land_planet->name);
+   xmlw_elem(writer,"credits","%"CREDITS_PRI,player.p->credits);
+   ntime_getR( &cycles, &periods, &seconds, &rem );
+   xmlw_elem(writer,"date","%"PRId64,ntime_create( cycles, periods, seconds ));
+   xmlw_startElem(writer,"ship");
+   xmlw_attr(writer,"name","%s",player.p->name);
+   xmlw_attr(writer,"model","%s",player.p->ship->name);
+   xmlw_endElem(writer); /* "ship" */
+   xmlw_endElem(writer); /* "player" */
+
+   xmlw_endElem(writer); /* "naev_save_header" */
+   xmlw_done(writer);
+   xmlFreeTextWriter(writer);
+
+   snprintf(file, sizeof(file), "%s/%s"SAVE_HEADER_SUFFIX, PHYSFS_getWriteDir(), path);
+   if (xmlSaveFileEnc(file, doc, "UTF-8") < 0) {
+      xmlFreeDoc(doc);
+      return -1;
+   }
+   xmlFreeDoc(doc);
+   return 0;
+}
+
+
 /**
  * @brief Reload the current saved game.
  */
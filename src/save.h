@@ -7,6 +7,9 @@
 #  define SAVE_H
 
 
+#define SAVE_HEADER_SUFFIX ".header" /**< Appended to a save's path to get its header index. */
+
+
 int save_all (void);
 void save_reload (void);
 
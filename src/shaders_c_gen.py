@@ -71,6 +71,14 @@ SHADERS = [
       uniforms = ["projection", "color", "tex_mat"],
       subroutines = {},
    ),
+   Shader(
+      name = "texture_batch",
+      vs_path = "texture_batch.vert",
+      fs_path = "texture_batch.frag",
+      attributes = ["vertex", "vertex_tex", "vertex_color", "vertex_inter"],
+      uniforms = ["projection", "sampler1", "sampler2"],
+      subroutines = {},
+   ),
    Shader(
       name = "texture_interpolate",
       vs_path = "texture.vert",
@@ -115,8 +123,8 @@ SHADERS = [
       name = "font",
       vs_path = "font.vert",
       fs_path = "font.frag",
-      attributes = ["vertex", "tex_coord"],
-      uniforms = ["projection", "color", "outline_color"],
+      attributes = ["vertex", "tex_coord", "vertex_color"],
+      uniforms = ["projection", "outline_color"],
       subroutines = {},
    ),
    Shader(
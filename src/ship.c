@@ -25,6 +25,7 @@
 #include "log.h"
 #include "ndata.h"
 #include "nfile.h"
+#include "nhash.h"
 #include "nstring.h"
 #include "nxml.h"
 #include "shipstats.h"
@@ -49,6 +50,7 @@
 
 
 static Ship* ship_stack = NULL; /**< Stack of ships available in the game. */
+static NHash *ship_names = NULL; /**< Index of the ship stack by name. */
 
 
 /*
@@ -67,13 +69,11 @@ static int ship_parse( Ship *temp, xmlNodePtr parent );
  */
 Ship* ship_get( const char* name )
 {
-   Ship *temp;
    int i;
 
-   temp = ship_stack;
-   for (i=0; i < array_size(ship_stack); i++)
-      if (strcmp(temp[i].name, name)==0)
-         return &temp[i];
+   i = nhash_get( ship_names, name );
+   if (i >= 0)
+      return &ship_stack[i];
 
    WARN(_("Ship %s does not exist"), name);
    return NULL;
@@ -88,13 +88,11 @@ Ship* ship_get( const char* name )
  */
 Ship* ship_getW( const char* name )
 {
-   Ship *temp;
    int i;
 
-   temp = ship_stack;
-   for (i=0; i < array_size(ship_stack); i++)
-      if (strcmp(temp[i].name, name)==0)
-         return &temp[i];
+   i = nhash_get( ship_names, name );
+   if (i >= 0)
+      return &ship_stack[i];
 
    return NULL;
 }
@@ -1082,6 +1080,12 @@ int ships_load (void)
 
    /* Shrink stack. */
    array_shrink(&ship_stack);
+
+   /* Index by name. */
+   nhash_free( ship_names );
+   ship_names = nhash_create( array_size(ship_stack) );
+   for (i=0; i<array_size(ship_stack); i++)
+      nhash_insert( ship_names, ship_stack[i].name, i );
    DEBUG( n_( "Loaded %d Ship", "Loaded %d Ships", array_size(ship_stack) ), array_size(ship_stack) );
 
    /* Clean up. */
@@ -1145,4 +1149,6 @@ void ships_free (void)
 
    array_free(ship_stack);
    ship_stack = NULL;
+   nhash_free( ship_names );
+   ship_names = NULL;
 }
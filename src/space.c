@@ -36,6 +36,7 @@
 #include "ndata.h"
 #include "nebula.h"
 #include "nfile.h"
+#include "nhash.h"
 #include "nlua.h"
 #include "nlua_pilot.h"
 #include "nlua_planet.h"
@@ -72,12 +73,27 @@
 
 #define ASTEROID_EXPLODE_INTERVAL 5. /**< Interval of asteroids randomly exploding */
 #define ASTEROID_EXPLODE_CHANCE   0.1 /**< Chance of asteroid exploding each interval */
+#define ASTEROID_GRID_CELL        256. /**< Target size of the asteroid grid cells. */
+#define ASTEROID_GRID_MAX         64 /**< Maximum amount of asteroid grid cells per side. */
+
+/**
+ * @brief Jump point whose target system is resolved once all systems are loaded.
+ */
+typedef struct JumpPending_ {
+   int sysid; /**< ID of the system containing the jump point. */
+   int jumpid; /**< Index of the jump point in the system. */
+   char *target; /**< Name of the target system. */
+} JumpPending;
 
 /*
  * planet <-> system name stack
  */
 static char** planetname_stack = NULL; /**< Planet name stack corresponding to system. */
 static char** systemname_stack = NULL; /**< System name stack corresponding to planet. */
+static NHash *system_names = NULL; /**< Index of the system stack by name. */
+static NHash *planet_names = NULL; /**< Index of the planet stack by name. */
+static NHash *planetname_names = NULL; /**< Index of the planet name stack by name. */
+static int space_namesDirty = 0; /**< Whether the name indices must be rebuilt. */
 
 
 /*
@@ -126,6 +142,9 @@ static double interference_timer  = 0.; /**< Interference timer. */
 /*
  * Internal Prototypes.
  */
+/* names */
+static void space_initNames (void);
+static void space_buildNames (void);
 /* planet load */
 static int planet_parse( Planet *planet, const xmlNodePtr parent, Commodity **stdList );
 static int space_parseAssets( xmlNodePtr parent, StarSystem* sys );
@@ -137,15 +156,25 @@ static int systems_load (void);
 static int asteroidTypes_load (void);
 static StarSystem* system_parse( StarSystem *system, const xmlNodePtr parent );
 static int system_parseJumpPoint( const xmlNodePtr node, StarSystem *sys );
+static void system_parseJumpPointData( const xmlNodePtr node, StarSystem *sys, JumpPoint *j );
 static int system_parseAsteroidField( const xmlNodePtr node, StarSystem *sys );
 static int system_parseAsteroidExclusion( const xmlNodePtr node, StarSystem *sys );
 static int system_parseJumpPointDiff( const xmlNodePtr node, StarSystem *sys );
-static void system_parseJumps( const xmlNodePtr parent );
+static void system_parseJumps( const xmlNodePtr parent, StarSystem *sys, JumpPending **pending );
+static void systems_resolveJumps( JumpPending *pending );
 static void system_parseAsteroids( const xmlNodePtr parent, StarSystem *sys );
 /* misc */
 static int getPresenceIndex( StarSystem *sys, int faction );
 static void system_scheduler( double dt, int init );
 static void asteroid_explode ( Asteroid *a, AsteroidAnchor *field, int give_reward );
+/* Asteroid grid. */
+static int asteroid_gridCell( const AsteroidGrid *grid, const Vector2d *pos );
+static void asteroid_gridLink( AsteroidGrid *grid, int id, int c );
+static void asteroid_gridUnlink( AsteroidGrid *grid, int id );
+static void asteroid_gridMove( AsteroidAnchor *field, int id );
+static void asteroid_gridBuild( AsteroidAnchor *field );
+static void asteroid_gridFree( AsteroidAnchor *field );
+static int asteroid_gridCmp( const void *a, const void *b );
 /* Render. */
 static void space_renderJumpPoint( const JumpPoint *jp, int i );
 static void space_renderPlanet( const Planet *p );
@@ -795,6 +824,62 @@ int space_sysReachableFromSys( StarSystem *target, StarSystem *sys )
    return 0;
 }
 
+/**
+ * @brief Creates the name indices if they don't exist yet.
+ */
+static void space_initNames (void)
+{
+   if (system_names != NULL)
+      return;
+   system_names      = nhash_create( MAX( array_size(systems_stack), 256 ) );
+   planet_names      = nhash_create( MAX( array_size(planet_stack), 256 ) );
+   planetname_names  = nhash_create( MAX( array_size(planetname_stack), 256 ) );
+}
+
+
+/**
+ * @brief Rebuilds the name indices if they are out of date.
+ *
+ * The indices are kept up to date as systems and planets get named, this is
+ *  only needed after renaming or removing elements.
+ */
+static void space_buildNames (void)
+{
+   int i;
+
+   space_initNames();
+   if (!space_namesDirty)
+      return;
+
+   nhash_clear( system_names );
+   nhash_clear( planet_names );
+   nhash_clear( planetname_names );
+
+   for (i=0; i<array_size(systems_stack); i++)
+      if (systems_stack[i].name != NULL)
+         nhash_insert( system_names, systems_stack[i].name, i );
+   for (i=0; i<array_size(planet_stack); i++)
+      if (planet_stack[i].name != NULL)
+         nhash_insert( planet_names, planet_stack[i].name, i );
+   for (i=0; i<array_size(planetname_stack); i++)
+      nhash_insert( planetname_names, planetname_stack[i], i );
+
+   space_namesDirty = 0;
+}
+
+
+/**
+ * @brief Marks the name indices as out of date.
+ *
+ * Has to be called when a system or planet gets named or renamed outside of
+ *  loading, e.g., by the editors.
+ */
+void space_invalidateNames (void)
+{
+   space_namesDirty = 1;
+}
+
+
 /**
  * @brief Gets an array (array.h) of all star systems.
  */
@@ -866,9 +951,10 @@ StarSystem* system_get( const char* sysname )
    if ( sysname == NULL )
       return NULL;
 
-   for (i=0; i<array_size(systems_stack); i++)
-      if (strcmp(sysname, systems_stack[i].name)==0)
-         return &systems_stack[i];
+   space_buildNames();
+   i = nhash_get( system_names, sysname );
+   if (i >= 0)
+      return &systems_stack[i];
 
    WARN(_("System '%s' not found in stack"), sysname);
    return NULL;
@@ -907,13 +993,8 @@ int system_index( StarSystem *sys )
  */
 int planet_hasSystem( const char* planetname )
 {
-   int i;
-
-   for (i=0; i<array_size(planetname_stack); i++)
-      if (strcmp(planetname_stack[i],planetname)==0)
-         return 1;
-
-   return 0;
+   space_buildNames();
+   return (nhash_get( planetname_names, planetname ) >= 0);
 }
 
 
@@ -927,9 +1008,10 @@ char* planet_getSystem( const char* planetname )
 {
    int i;
 
-   for (i=0; i<array_size(planetname_stack); i++)
-      if (strcmp(planetname_stack[i],planetname)==0)
-         return systemname_stack[i];
+   space_buildNames();
+   i = nhash_get( planetname_names, planetname );
+   if (i >= 0)
+      return systemname_stack[i];
 
    DEBUG(_("Planet '%s' not found in planetname stack"), planetname);
    return NULL;
@@ -951,9 +1033,10 @@ Planet* planet_get( const char* planetname )
       return NULL;
    }
 
-   for (i=0; i<array_size(planet_stack); i++)
-      if (strcmp(planet_stack[i].name,planetname)==0)
-         return &planet_stack[i];
+   space_buildNames();
+   i = nhash_get( planet_names, planetname );
+   if (i >= 0)
+      return &planet_stack[i];
 
    WARN(_("Planet '%s' not found in the universe"), planetname);
    return NULL;
@@ -1017,11 +1100,8 @@ void planet_setKnown( Planet *p )
  */
 int planet_exists( const char* planetname )
 {
-   int i;
-   for (i=0; i<array_size(planet_stack); i++)
-      if (strcmp(planet_stack[i].name,planetname)==0)
-         return 1;
-   return 0;
+   space_buildNames();
+   return (nhash_get( planet_names, planetname ) >= 0);
 }
 
 
@@ -1431,6 +1511,7 @@ void space_update( const double dt )
 
          a->pos.x += a->vel.x * dt;
          a->pos.y += a->vel.y * dt;
+         asteroid_gridMove( ast, j );
 
          if (a->appearing == ASTEROID_VISIBLE) {
             /* Random explosions */
@@ -1519,6 +1600,7 @@ void space_init( const char* sysname )
 {
    char* nt;
    int i, j, n, s;
+   double dt;
    Planet *pnt;
    AsteroidAnchor *ast;
    Asteroid *a;
@@ -1588,6 +1670,7 @@ void space_init( const char* sysname )
       ast->id = i;
 
       /* Add the asteroids to the anchor */
+      asteroid_gridFree( ast );
       ast->asteroids = realloc( ast->asteroids, (ast->nb) * sizeof(Asteroid) );
       for (j=0; j<ast->nb; j++) {
          a = &ast->asteroids[j];
@@ -1595,6 +1678,7 @@ void space_init( const char* sysname )
          a->appearing = ASTEROID_INIT;
          asteroid_init(a, ast);
       }
+      asteroid_gridBuild( ast );
       /* Add the debris to the anchor */
       ast->debris = realloc( ast->debris, (ast->ndebris) * sizeof(Debris) );
       for (j=0; j<ast->ndebris; j++) {
@@ -1641,9 +1725,11 @@ void space_init( const char* sysname )
    s = sound_disabled;
    sound_disabled = 1;
    ntime_allowUpdate( 0 );
-   n = SYSTEM_SIMULATE_TIME / fps_min;
+   /* Coarse step, update_routine() substeps the physics at fps_min. */
+   dt = (conf.simulate_dt > 0.) ? conf.simulate_dt : fps_min;
+   n = conf.simulate_time / dt;
    for (i=0; i<n; i++)
-      update_routine( fps_min, 1 );
+      update_routine( dt, 1 );
    ntime_allowUpdate( 1 );
    sound_disabled = s;
    player_messageToggle( 1 );
@@ -1711,6 +1797,9 @@ void asteroid_init( Asteroid *ast, AsteroidAnchor *field )
    /* Grow effect stuff */
    ast->appearing = ASTEROID_GROWING;
    ast->timer = 0.;
+
+   /* Respawned asteroids may have changed cell. */
+   asteroid_gridMove( field, ast->id );
 }
 
 
@@ -2045,6 +2134,10 @@ static int planet_parse( Planet *planet, const xmlNodePtr parent, Commodity **st
 
    /* Get the name. */
    xmlr_attr_strd( parent, "name", planet->name );
+   if (planet->name != NULL) {
+      space_initNames();
+      nhash_insert( planet_names, planet->name, planet->id );
+   }
 
    node = parent->xmlChildrenNode;
    do {
@@ -2269,6 +2362,8 @@ int system_addPlanet( StarSystem *sys, const char *planetname )
    /* add planet <-> star system to name stack */
    array_push_back( &planetname_stack, planet->name );
    array_push_back( &systemname_stack, sys->name );
+   space_initNames();
+   nhash_insert( planetname_names, planet->name, array_size(planetname_stack)-1 );
 
    economy_addQueuedUpdate();
    /* This is required to clear the player statistics for this planet */
@@ -2330,6 +2425,7 @@ int system_rmPlanet( StarSystem *sys, const char *planetname )
       if (strcmp(planetname, planetname_stack[i])==0) {
          array_erase( &planetname_stack, &planetname_stack[i], &planetname_stack[i+1] );
          array_erase( &systemname_stack, &systemname_stack[i], &systemname_stack[i+1] );
+         space_namesDirty = 1;
          found = 1;
          break;
       }
@@ -2561,6 +2657,10 @@ static StarSystem* system_parse( StarSystem *sys, const xmlNodePtr parent )
    sys->nebu_hue  = NEBULA_DEFAULT_HUE;
 
    xmlr_attr_strd( parent, "name", sys->name );
+   if (sys->name != NULL) {
+      space_initNames();
+      nhash_insert( system_names, sys->name, sys->id );
+   }
 
    node  = parent->xmlChildrenNode;
    do { /* load all the data */
@@ -2782,10 +2882,7 @@ static int system_parseJumpPoint( const xmlNodePtr node, StarSystem *sys )
 {
    JumpPoint *j;
    char *buf;
-   xmlNodePtr cur;
-   double x, y;
    StarSystem *target;
-   int pos;
 
    /* Get target. */
    xmlr_attr_strd( node, "target", buf );
@@ -2822,8 +2919,26 @@ static int system_parseJumpPoint( const xmlNodePtr node, StarSystem *sys )
    j->from = sys;
    j->target = target;
    j->targetid = j->target->id;
-   j->radius = 200.;
+   system_parseJumpPointData( node, sys, j );
+
+   return 0;
+}
+
+
+/**
+ * @brief Parses the data of a single jump point, everything but the target.
+ *
+ *    @param node Parent node containing jump point information.
+ *    @param sys System to which the jump point belongs.
+ *    @param j Jump point to load into.
+ */
+static void system_parseJumpPointData( const xmlNodePtr node, StarSystem *sys, JumpPoint *j )
+{
+   xmlNodePtr cur;
+   double x, y;
+   int pos;
 
+   j->radius = 200.;
    pos = 0;
 
    /* Parse data. */
@@ -2853,50 +2968,99 @@ static int system_parseJumpPoint( const xmlNodePtr node, StarSystem *sys )
 
    if (!jp_isFlag(j,JP_AUTOPOS) && !pos)
       WARN(_("JumpPoint in system '%s' is missing pos element but does not have autopos flag."), sys->name);
-
-   return 0;
 }
 
 
 /**
- * @brief Loads the jumps into a system.
+ * @brief Loads the jumps into a system, leaving their targets pending.
  *
  *    @param parent System parent node.
+ *    @param sys System to load the jumps into.
+ *    @param[out] pending Array (array.h) to add the unresolved targets to.
  */
-static void system_parseJumps( const xmlNodePtr parent )
+static void system_parseJumps( const xmlNodePtr parent, StarSystem *sys, JumpPending **pending )
 {
-   int i;
-   StarSystem *sys;
-   char* name;
+   char *buf;
+   JumpPoint *j;
+   JumpPending *jp;
    xmlNodePtr cur, node;
 
-   xmlr_attr_strd( parent, "name", name );
-   sys = NULL;
-   for (i=0; i<array_size(systems_stack); i++) {
-      if (strcmp( systems_stack[i].name, name)==0) {
-         sys = &systems_stack[i];
-         break;
-      }
-   }
-   if (sys == NULL) {
-      WARN(_("System '%s' was not found in the stack for some reason"),name);
-      return;
-   }
-   free(name); /* no more need for it */
-
    node  = parent->xmlChildrenNode;
 
    do { /* load all the data */
       if (xml_isNode(node,"jumps")) {
          cur = node->children;
          do {
-            if (xml_isNode(cur,"jump"))
-               system_parseJumpPoint( cur, sys );
+            if (!xml_isNode(cur,"jump"))
+               continue;
+
+            xmlr_attr_strd( cur, "target", buf );
+            if (buf == NULL) {
+               WARN(_("JumpPoint node for system '%s' has no target attribute."), sys->name);
+               continue;
+            }
+
+            j = &array_grow( &sys->jumps );
+            memset( j, 0, sizeof(JumpPoint) );
+            system_parseJumpPointData( cur, sys, j );
+
+            jp = &array_grow( pending );
+            jp->sysid  = sys->id;
+            jp->jumpid = array_size(sys->jumps)-1;
+            jp->target = buf;
          } while (xml_nextNode(cur));
       }
    } while (xml_nextNode(node));
+}
+
+
+/**
+ * @brief Resolves the targets of the jumps loaded by system_parseJumps().
+ *
+ * Jumps with invalid targets are removed.
+ *
+ *    @param pending Unresolved jump targets, in the order they were loaded.
+ */
+static void systems_resolveJumps( JumpPending *pending )
+{
+   int i, k;
+   StarSystem *sys, *target;
+   JumpPoint *j;
+
+   for (i=0; i<array_size(pending); i++) {
+      sys = &systems_stack[ pending[i].sysid ];
+      j   = &sys->jumps[ pending[i].jumpid ];
+      target = system_get( pending[i].target );
+      if (target == NULL) {
+         WARN(_("JumpPoint node for system '%s' has invalid target '%s'."), sys->name, pending[i].target );
+         continue;
+      }
+
+#ifdef DEBUGGING
+      for (k=0; k<pending[i].jumpid; k++) {
+         if ((sys->jumps[k].target == NULL) || (sys->jumps[k].targetid != target->id))
+            continue;
+
+         WARN(_("Star System '%s' has duplicate jump point to '%s'."),
+               sys->name, target->name );
+         break;
+      }
+#endif /* DEBUGGING */
+
+      /* Set some stuff. */
+      j->from = sys;
+      j->target = target;
+      j->targetid = target->id;
+   }
 
-   array_shrink( &sys->jumps );
+   /* Get rid of the jumps that went nowhere. */
+   for (i=0; i<array_size(systems_stack); i++) {
+      sys = &systems_stack[i];
+      for (k=array_size(sys->jumps)-1; k>=0; k--)
+         if (sys->jumps[k].target == NULL)
+            array_erase( &sys->jumps, &sys->jumps[k], &sys->jumps[k+1] );
+      array_shrink( &sys->jumps );
+   }
 }
 
 
@@ -3243,10 +3407,8 @@ static int asteroidTypes_load (void)
 /**
  * @brief Loads the entire systems, needs to be called after planets_load.
  *
- * Does multiple passes to load:
- *
- *  - First loads the star systems.
- *  - Next sets the jump routes.
+ * Each file is only parsed once, the jump routes are loaded along with the
+ * star systems and have their targets resolved once all the systems exist.
  *
  *    @return 0 on success.
  */
@@ -3256,6 +3418,7 @@ static int systems_load (void)
    xmlNodePtr node;
    xmlDocPtr doc;
    StarSystem *sys;
+   JumpPending *pending;
    size_t i;
 
    /* Allocate if needed. */
@@ -3263,9 +3426,10 @@ static int systems_load (void)
       systems_stack = array_create( StarSystem );
 
    system_files = PHYSFS_enumerateFiles( SYSTEM_DATA_PATH );
+   pending = array_create( JumpPending );
 
    /*
-    * First pass - loads all the star systems_stack.
+    * Load all the star systems_stack, leaving the jump targets pending.
     */
    for (i=0; system_files[i]!=NULL; i++) {
       if (!ndata_matchExt( system_files[i], "xml" ))
@@ -3274,19 +3438,23 @@ static int systems_load (void)
       asprintf( &file, "%s%s", SYSTEM_DATA_PATH, system_files[i] );
       /* Load the file. */
       doc = xml_parsePhysFS( file );
-      if (doc == NULL)
+      if (doc == NULL) {
+         free( file );
          continue;
+      }
 
       node = doc->xmlChildrenNode; /* first planet node */
       if (node == NULL) {
          WARN(_("Malformed %s file: does not contain elements"),file);
          xmlFreeDoc(doc);
+         free( file );
          continue;
       }
 
       sys = system_new();
       system_parse( sys, node );
       system_parseAsteroids(node, sys); /* load the asteroids anchors */
+      system_parseJumps(node, sys, &pending); /* targets get resolved later */
 
       /* Clean up. */
       xmlFreeDoc(doc);
@@ -3294,28 +3462,12 @@ static int systems_load (void)
    }
 
    /*
-    * Second pass - loads all the jump routes.
+    * Resolve the jump routes now that all the systems exist.
     */
-   for (i=0; system_files[i]!=NULL; i++) {
-      asprintf( &file, "%s%s", SYSTEM_DATA_PATH, system_files[i] );
-      /* Load the file. */
-      doc = xml_parsePhysFS( file );
-      free( file );
-      file = NULL;
-      if (doc == NULL)
-         continue;
-
-      node = doc->xmlChildrenNode; /* first planet node */
-      if (node == NULL) {
-         xmlFreeDoc(doc);
-         continue;
-      }
-
-      system_parseJumps(node); /* will automatically load the jumps into the system */
-
-      /* Clean up. */
-      xmlFreeDoc(doc);
-   }
+   systems_resolveJumps( pending );
+   for (i=0; i<(size_t)array_size(pending); i++)
+      free( pending[i].target );
+   array_free( pending );
 
    DEBUG( n_( "Loaded %d Star System", "Loaded %d Star Systems", array_size(systems_stack) ), array_size(systems_stack) );
    DEBUG( n_( "       with %d Planet", "       with %d Planets", array_size(planet_stack) ), array_size(planet_stack) );
@@ -3363,6 +3515,7 @@ void space_renderOverlay( const double dt )
    /* Render the debris. */
    pplayer = pilot_get( PLAYER_ID );
    if (pplayer != NULL) {
+      gl_batchBegin();
       psolid  = pplayer->solid;
       for (i=0; i < array_size(cur_system->asteroids); i++) {
          ast = &cur_system->asteroids[i];
@@ -3373,6 +3526,7 @@ void space_renderOverlay( const double dt )
               space_renderDebris( &ast->debris[j], x, y );
          }
       }
+      gl_batchEnd();
    }
 
    /* Render overlay if necessary. */
@@ -3399,6 +3553,8 @@ void planets_render (void)
    if (cur_system==NULL)
       return;
 
+   gl_batchBegin();
+
    /* Render the jumps. */
    for (i=0; i < array_size(cur_system->jumps); i++)
       space_renderJumpPoint( &cur_system->jumps[i], i );
@@ -3432,6 +3588,7 @@ void planets_render (void)
    /* Render gatherable stuff. */
    gatherable_render();
 
+   gl_batchEnd();
 }
 
 
@@ -3558,6 +3715,13 @@ void space_exit (void)
    /* Free the names. */
    array_free(planetname_stack);
    array_free(systemname_stack);
+   nhash_free(system_names);
+   nhash_free(planet_names);
+   nhash_free(planetname_names);
+   system_names      = NULL;
+   planet_names      = NULL;
+   planetname_names  = NULL;
+   space_namesDirty  = 0;
 
    /* Free the planets. */
    for (i=0; i < array_size(planet_stack); i++) {
@@ -3610,6 +3774,7 @@ void space_exit (void)
 
       for (j=0; j < array_size(sys->asteroids); j++) {
          ast = &sys->asteroids[j];
+         asteroid_gridFree(ast);
          free(ast->asteroids);
          free(ast->debris);
          free(ast->type);
@@ -4116,14 +4281,14 @@ int space_isInField( const Vector2d *p )
    /* Always return -1 if in an exclusion zone */
    for (i=0; i < array_size(cur_system->astexclude); i++) {
       e = &cur_system->astexclude[i];
-      if (vect_dist( p, &e->pos ) <= e->radius)
+      if (vect_dist2( p, &e->pos ) <= pow2(e->radius))
          return -1;
    }
 
    /* Check if in asteroid field */
    for (i=0; i < array_size(cur_system->asteroids); i++) {
       a = &cur_system->asteroids[i];
-      if (vect_dist( p, &a->pos ) <= a->radius)
+      if (vect_dist2( p, &a->pos ) <= pow2(a->radius))
          return i;
    }
 
@@ -4218,6 +4383,188 @@ static void asteroid_explode ( Asteroid *a, AsteroidAnchor *field, int give_rewa
 }
 
 
+/**
+ * @brief Gets the grid cell a position falls in.
+ *
+ *    @param grid Grid to check.
+ *    @param pos Position to get the cell of.
+ *    @return Index of the cell, the overflow cell if outside the grid.
+ */
+static int asteroid_gridCell( const AsteroidGrid *grid, const Vector2d *pos )
+{
+   int cx, cy;
+
+   cx = (int)floor( (pos->x - grid->x) / grid->cell );
+   cy = (int)floor( (pos->y - grid->y) / grid->cell );
+   if ((cx < 0) || (cy < 0) || (cx >= grid->n) || (cy >= grid->n))
+      return grid->n * grid->n;
+   return cy * grid->n + cx;
+}
+
+
+/**
+ * @brief Adds an asteroid to the head of a grid cell.
+ */
+static void asteroid_gridLink( AsteroidGrid *grid, int id, int c )
+{
+   grid->cell_of[id] = c;
+   grid->prev[id]    = -1;
+   grid->next[id]    = grid->head[c];
+   if (grid->head[c] >= 0)
+      grid->prev[ grid->head[c] ] = id;
+   grid->head[c] = id;
+}
+
+
+/**
+ * @brief Removes an asteroid from its grid cell.
+ */
+static void asteroid_gridUnlink( AsteroidGrid *grid, int id )
+{
+   if (grid->prev[id] >= 0)
+      grid->next[ grid->prev[id] ] = grid->next[id];
+   else
+      grid->head[ grid->cell_of[id] ] = grid->next[id];
+   if (grid->next[id] >= 0)
+      grid->prev[ grid->next[id] ] = grid->prev[id];
+}
+
+
+/**
+ * @brief Updates the grid cell of an asteroid after it moved.
+ *
+ *    @param field Field the asteroid belongs to.
+ *    @param id ID of the asteroid in the field.
+ */
+static void asteroid_gridMove( AsteroidAnchor *field, int id )
+{
+   int c;
+   AsteroidGrid *grid = &field->grid;
+
+   /* Grid not built yet. */
+   if (grid->head == NULL)
+      return;
+
+   c = asteroid_gridCell( grid, &field->asteroids[id].pos );
+   if (c == grid->cell_of[id])
+      return;
+   asteroid_gridUnlink( grid, id );
+   asteroid_gridLink( grid, id, c );
+}
+
+
+/**
+ * @brief Builds the spatial index of an asteroid field.
+ *
+ *    @param field Field to build the index of.
+ */
+static void asteroid_gridBuild( AsteroidAnchor *field )
+{
+   int i, j, ncells;
+   AsteroidGrid *grid;
+   AsteroidType *at;
+
+   grid = &field->grid;
+
+   /* Cover the field's bounding square. */
+   grid->n     = (int)CLAMP( 1., ASTEROID_GRID_MAX, ceil( 2.*field->radius / ASTEROID_GRID_CELL ) );
+   grid->cell  = MAX( 1., 2.*field->radius / grid->n );
+   grid->x     = field->pos.x - field->radius;
+   grid->y     = field->pos.y - field->radius;
+
+   /* Asteroids are indexed by their centre, so queries get padded by their size. */
+   grid->margin = 0.;
+   for (i=0; i<field->ntype; i++) {
+      at = &asteroid_types[ field->type[i] ];
+      for (j=0; j<array_size(at->gfxs); j++)
+         grid->margin = MAX( grid->margin, MAX( at->gfxs[j]->sw, at->gfxs[j]->sh ) / 2. );
+   }
+
+   ncells = grid->n * grid->n + 1;
+   grid->head    = malloc( ncells * sizeof(int) );
+   grid->next    = malloc( MAX(1,field->nb) * sizeof(int) );
+   grid->prev    = malloc( MAX(1,field->nb) * sizeof(int) );
+   grid->cell_of = malloc( MAX(1,field->nb) * sizeof(int) );
+   for (i=0; i<ncells; i++)
+      grid->head[i] = -1;
+   for (i=0; i<field->nb; i++)
+      asteroid_gridLink( grid, i, asteroid_gridCell( grid, &field->asteroids[i].pos ) );
+}
+
+
+/**
+ * @brief Frees the spatial index of an asteroid field.
+ *
+ *    @param field Field to free the index of.
+ */
+static void asteroid_gridFree( AsteroidAnchor *field )
+{
+   free( field->grid.head );
+   free( field->grid.next );
+   free( field->grid.prev );
+   free( field->grid.cell_of );
+   memset( &field->grid, 0, sizeof(AsteroidGrid) );
+}
+
+
+/**
+ * @brief Compares two asteroid IDs.
+ */
+static int asteroid_gridCmp( const void *a, const void *b )
+{
+   return *(const int*)a - *(const int*)b;
+}
+
+
+/**
+ * @brief Gets the asteroids of a field that may overlap a bounding box.
+ *
+ * The results are a superset of the overlapping asteroids, so callers still
+ *  have to run the exact tests. IDs are returned in increasing order.
+ *
+ *    @param field Field to get asteroids of.
+ *    @param[out] idx Array (array.h) to fill with asteroid IDs. Is created if
+ *                    NULL and cleared otherwise.
+ *    @param x1 Minimum X coordinate of the box.
+ *    @param y1 Minimum Y coordinate of the box.
+ *    @param x2 Maximum X coordinate of the box.
+ *    @param y2 Maximum Y coordinate of the box.
+ *    @return Number of asteroids found.
+ */
+int asteroid_gridQuery( const AsteroidAnchor *field, int **idx,
+      double x1, double y1, double x2, double y2 )
+{
+   int i, cx, cy, cx1, cy1, cx2, cy2;
+   const AsteroidGrid *grid;
+
+   if (*idx == NULL)
+      *idx = array_create( int );
+   else
+      array_erase( idx, array_begin(*idx), array_end(*idx) );
+
+   grid = &field->grid;
+   if (grid->head == NULL)
+      return 0;
+
+   /* Cells overlapped by the padded box, clamped to the grid. */
+   cx1 = (int)CLAMP( 0., grid->n, floor( (x1 - grid->margin - grid->x) / grid->cell ) );
+   cy1 = (int)CLAMP( 0., grid->n, floor( (y1 - grid->margin - grid->y) / grid->cell ) );
+   cx2 = (int)CLAMP( -1., grid->n-1, floor( (x2 + grid->margin - grid->x) / grid->cell ) );
+   cy2 = (int)CLAMP( -1., grid->n-1, floor( (y2 + grid->margin - grid->y) / grid->cell ) );
+   for (cy=cy1; cy<=cy2; cy++)
+      for (cx=cx1; cx<=cx2; cx++)
+         for (i=grid->head[ cy*grid->n + cx ]; i>=0; i=grid->next[i])
+            array_push_back( idx, i );
+
+   /* Asteroids that drifted out of the grid. */
+   for (i=grid->head[ grid->n*grid->n ]; i>=0; i=grid->next[i])
+      array_push_back( idx, i );
+
+   qsort( *idx, array_size(*idx), sizeof(int), asteroid_gridCmp );
+   return array_size(*idx);
+}
+
+
 /**
  * @brief See if the system has a planet or station.
  *
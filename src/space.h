@@ -20,8 +20,6 @@ typedef struct JumpPoint_ JumpPoint;
 #include "tech.h"
 
 
-#define SYSTEM_SIMULATE_TIME  30. /**< Time to simulate system before player is added. */
-
 #define MAX_HYPERSPACE_VEL    25 /**< Speed to brake to before jumping. */
 
 #define ASSET_VIRTUAL         0 /**< The asset is virtual. */
@@ -249,6 +247,27 @@ extern glTexture **asteroid_gfx; /**< Asteroid graphics list. */
 
 
 
+/**
+ * @brief Spatial index of the asteroids of a field.
+ *
+ * Uniform grid covering the field's bounding square. Each cell holds an
+ *  intrusive doubly linked list of asteroid indices so moving an asteroid
+ *  between cells is O(1). Asteroids that drift outside the grid go into an
+ *  extra overflow cell that is always checked.
+ */
+typedef struct AsteroidGrid_ {
+   int n;         /**< Number of cells per side. */
+   double x;      /**< X coordinate of the grid's corner. */
+   double y;      /**< Y coordinate of the grid's corner. */
+   double cell;   /**< Size of a cell. */
+   double margin; /**< Largest asteroid half-size, used to pad queries. */
+   int *head;     /**< First asteroid of each cell (n*n+1 cells, last one is overflow). */
+   int *next;     /**< Next asteroid in the same cell or -1. */
+   int *prev;     /**< Previous asteroid in the same cell or -1. */
+   int *cell_of;  /**< Cell each asteroid is in. */
+} AsteroidGrid;
+
+
 /**
  * @brief Represents an asteroid field anchor.
  */
@@ -264,6 +283,7 @@ typedef struct AsteroidAnchor_ {
    double area; /**< Field's area. */
    int *type; /**< Types of asteroids. */
    int ntype; /**< Number of types. */
+   AsteroidGrid grid; /**< Spatial index of the asteroids. */
 } AsteroidAnchor;
 
 
@@ -385,6 +405,7 @@ const char *jump_getSymbol( JumpPoint *jp );
 void system_reconstructJumps (StarSystem *sys);
 void systems_reconstructJumps (void);
 void systems_reconstructPlanets (void);
+void space_invalidateNames (void);
 StarSystem *system_new (void);
 int system_addPlanet( StarSystem *sys, const char *planetname );
 int system_rmPlanet( StarSystem *sys, const char *planetname );
@@ -463,6 +484,8 @@ int space_calcJumpInPos( const StarSystem *in, const StarSystem *out, Vector2d *
  * Asteroids
  */
 void asteroid_hit( Asteroid *a, const Damage *dmg );
+int asteroid_gridQuery( const AsteroidAnchor *field, int **idx,
+      double x1, double y1, double x2, double y2 );
 int space_isInField ( const Vector2d *p );
 AsteroidType *space_getType ( int ID );
 
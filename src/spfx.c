@@ -484,6 +484,10 @@ void spfx_add( int effect,
       return;
    }
 
+   /* Nobody sees the system being simulated. */
+   if (space_isSimulation())
+      return;
+
    /*
     * Select the Layer
     */
@@ -839,6 +843,9 @@ void spfx_trail_draw( const Trail_spfx* trail )
       return;
    styles = trail->spec->style;
 
+   /* Draw pending sprites first. */
+   gl_batchFlush();
+
    /* Stuff that doesn't change for the entire trail. */
    glUseProgram( shaders.trail.program );
    if (gl_has( OPENGL_SUBROUTINES ))
@@ -1062,6 +1069,7 @@ void spfx_render( const int layer )
       }
 
    /* Now render the layer */
+   gl_batchBegin();
    for (i=array_size(spfx_stack)-1; i>=0; i--) {
       spfx   = &spfx_stack[i];
       effect = &spfx_effects[ spfx->effect ];
@@ -1084,6 +1092,7 @@ void spfx_render( const int layer )
             continue;
 
          /* Let's get to business. */
+         gl_batchFlush();
          glUseProgram( effect->shader );
 
          /* Set up the vertex. */
@@ -1131,6 +1140,7 @@ void spfx_render( const int layer )
                NULL );
       }
    }
+   gl_batchEnd();
 }
 
 
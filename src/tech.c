@@ -20,6 +20,7 @@
 #include "economy.h"
 #include "log.h"
 #include "ndata.h"
+#include "nhash.h"
 #include "nxml.h"
 #include "outfit.h"
 #include "ship.h"
@@ -71,6 +72,7 @@ struct tech_group_s {
  * Group list.
  */
 static tech_group_t *tech_groups = NULL;
+static NHash *tech_names = NULL; /**< Index of the tech groups by name. */
 
 
 /*
@@ -99,7 +101,7 @@ static void** tech_addGroupItem( void **items, tech_item_type_t type, tech_group
 int tech_load (void)
 {
    int i, ret, s;
-   char *buf;
+   char *buf, *loaded;
    xmlNodePtr node, parent;
    xmlDocPtr doc;
    tech_group_t *tech;
@@ -142,9 +144,19 @@ int tech_load (void)
    } while (xml_nextNode(node));
    array_shrink( &tech_groups );
 
+   /* Index by name, groups reference each other. */
+   s           = array_size( tech_groups );
+   tech_names  = nhash_create( s );
+   for (i=0; i<s; i++) {
+      if (nhash_get( tech_names, tech_groups[i].name ) >= 0)
+         WARN(_("Tech group '%s' is defined more than once, only the first definition is used."),
+               tech_groups[i].name );
+      nhash_insert( tech_names, tech_groups[i].name, i );
+   }
+
    /* Now we load the data. */
-   node  = parent->xmlChildrenNode;
-   s     = array_size( tech_groups );
+   loaded   = calloc( MAX(s,1), sizeof(char) );
+   node     = parent->xmlChildrenNode;
    do {
       /* Must match tag. */
       if (!xml_isNode(node, XML_TECH_TAG))
@@ -154,11 +166,11 @@ int tech_load (void)
       if (buf == NULL)
          continue;
 
-      /* Load next tech. */
-      for (i=0; i<s; i++) {
-         tech  = &tech_groups[i];
-         if (strcmp(tech->name, buf)==0)
-            tech_parseNodeData( tech, node );
+      /* Load next tech, duplicates were already warned about. */
+      i = tech_getID( buf );
+      if ((i >= 0) && !loaded[i]) {
+         tech_parseNodeData( &tech_groups[i], node );
+         loaded[i] = 1;
       }
 
       /* Free memory. */
@@ -169,6 +181,7 @@ int tech_load (void)
    DEBUG( n_( "Loaded %d tech group", "Loaded %d tech groups", s ), s );
 
    /* Free memory. */
+   free(loaded);
    xmlFreeDoc(doc);
 
    return 0;
@@ -189,6 +202,8 @@ void tech_free (void)
 
    /* Free the tech array. */
    array_free( tech_groups );
+   nhash_free( tech_names );
+   tech_names = NULL;
 }
 
 
@@ -578,19 +593,7 @@ int tech_rmItem( const char *name, const char *value )
  */
 static int tech_getID( const char *name )
 {
-   int i, s;
-   tech_group_t *tech;
-
-   s  = array_size( tech_groups );
-   for (i=0; i<s; i++) {
-      tech  = &tech_groups[i];
-      if (tech->name == NULL)
-         continue;
-      if (strcmp(tech->name, name)==0)
-         return i;
-   }
-
-   return -1L;
+   return nhash_get( tech_names, name );
 }
 
 
@@ -567,24 +567,32 @@ static int vpool_worker( void *data )
  */
 void vpool_wait( ThreadQueue *queue )
 {
-   int i, cnt;
+   int i, n, cnt;
    SDL_cond *cond;
    SDL_mutex *mutex;
    vpoolThreadData *arg;
    ThreadQueueData *node;
 
+   /* This might be a little ugly (and inefficient?) */
+   cnt   = SDL_SemValue( queue->semaphore );
+   n     = cnt;
+
+   /* Nothing to wait for, nobody would ever signal us. */
+   if (cnt <= 0) {
+      tq_destroy( queue );
+      return;
+   }
+
    /* Create temporary threading structures. */
    cond  = SDL_CreateCond();
    mutex = SDL_CreateMutex();
-   /* This might be a little ugly (and inefficient?) */
-   cnt   = SDL_SemValue( queue->semaphore );
 
    /* Allocate all vpoolThreadData objects */
-   arg = calloc( cnt, sizeof(vpoolThreadData) );
+   arg = calloc( n, sizeof(vpoolThreadData) );
 
    SDL_mutexP( mutex );
    /* Initialize the vpoolThreadData */
-   for (i=0; i<cnt; i++) {
+   for (i=0; i<n; i++) {
       /* This is needed to keep the invariants of the queue */
       while (SDL_SemWait( queue->semaphore ) == -1) {
           /* Again, a really bad idea */
@@ -598,18 +606,22 @@ void vpool_wait( ThreadQueue *queue )
       arg[i].mutex   = mutex;
       arg[i].count   = &cnt;
 
-      /* Launch new job. */
-      threadpool_newJob( vpool_worker, &arg[i] );
+      /* Launch new job, run it here if there is no threadpool (mutex is recursive). */
+      if (threadpool_newJob( vpool_worker, &arg[i] ) < 0)
+         vpool_worker( &arg[i] );
    }
 
-   /* Wait for the threads to finish */
-   SDL_CondWait( cond, mutex );
+   /* Wait for the threads to finish, the wait may wake up spuriously. */
+   while (cnt > 0)
+      SDL_CondWait( cond, mutex );
    SDL_mutexV( mutex );
 
    /* Clean up */
    SDL_DestroyMutex( mutex );
    SDL_DestroyCond( cond );
    tq_destroy( queue );
+   for (i=0; i<n; i++)
+      free( arg[i].node );
    free( arg );
 }
 
@@ -31,13 +31,17 @@
 #include "nstring.h"
 #include "opengl.h"
 #include "pilot.h"
+#include "pilot_grid.h"
 #include "player.h"
+#include "profile.h"
 #include "rng.h"
 #include "spfx.h"
 
 
 #define weapon_isSmart(w)     (w->think != NULL) /**< Checks if the weapon w is smart. */
 
+#define WEAPON_CHUNK          256 /**< Number of weapons allocated at once by the pool. */
+
 /* Weapon status */
 #define WEAPON_STATUS_OK         0 /**< Weapon is fine */
 #define WEAPON_STATUS_JAMMED     1 /**< Got jammed */
@@ -50,8 +54,10 @@
  * @brief In-game representation of a weapon.
  */
 typedef struct Weapon_ {
-   Solid *solid; /**< Actually has its own solid :) */
+   Solid solid; /**< Actually has its own solid :) */
    unsigned int ID; /**< Only used for beam weapons. */
+   int lidx; /**< Position in its layer, -1 if not in a layer. */
+   int dead; /**< Destroyed while updating, removed by weapons_purge(). */
 
    int faction; /**< faction of pilot that shot it */
    unsigned int parent; /**< pilot that shot it */
@@ -88,6 +94,11 @@ static Weapon** wbackLayer = NULL; /**< behind pilots */
 /* behind player layer */
 static Weapon** wfrontLayer = NULL; /**< in front of pilots, behind player */
 
+/* Storage. */
+static Weapon **weapon_chunks = NULL; /**< Array (array.h): Blocks of WEAPON_CHUNK weapons, never moved. */
+static Weapon **weapon_pool   = NULL; /**< Array (array.h): Unused weapons, most recently freed last. */
+static int weapon_updating    = 0; /**< Whether the layers are being updated, removals get deferred. */
+
 /* Graphics. */
 static gl_vbo  *weapon_vbo     = NULL; /**< Weapon VBO. */
 static GLfloat *weapon_vboData = NULL; /**< Data of weapon VBO. */
@@ -96,6 +107,7 @@ static size_t weapon_vboSize   = 0; /**< Size of the VBO. */
 
 /* Internal stuff. */
 static unsigned int beam_idgen = 0; /**< Beam identifier generator. */
+static int *weapon_candidates = NULL; /**< Array (array.h): Pilots a weapon may collide with. */
 
 
 /*
@@ -118,7 +130,11 @@ static void weapons_updateLayer( const double dt, const WeaponLayer layer );
 static void weapon_update( Weapon* w, const double dt, WeaponLayer layer );
 static void weapon_sample_trail( Weapon* w );
 /* Destruction. */
+static Weapon** weapon_layer( WeaponLayer layer );
+static Weapon* weapon_alloc (void);
+static void weapon_insert( Weapon *w, WeaponLayer layer );
 static void weapon_destroy( Weapon* w, WeaponLayer layer );
+static void weapons_purge( WeaponLayer layer );
 static void weapon_free( Weapon* w );
 static void weapon_explodeLayer( WeaponLayer layer,
       double x, double y, double radius,
@@ -146,6 +162,9 @@ void weapon_init (void)
 {
    wfrontLayer = array_create(Weapon*);
    wbackLayer  = array_create(Weapon*);
+   weapon_chunks = array_create(Weapon*);
+   weapon_pool   = array_create(Weapon*);
+   weapon_candidates = array_create(int);
 }
 
 
@@ -182,12 +201,12 @@ void weapon_minimap( const double res, const double w,
       wp = wbackLayer[i];
 
       /* Make sure is in range. */
-      if (!pilot_inRange( player.p, wp->solid->pos.x, wp->solid->pos.y ))
+      if (!pilot_inRange( player.p, wp->solid.pos.x, wp->solid.pos.y ))
          continue;
 
       /* Get radar position. */
-      x = (wp->solid->pos.x - player.p->solid->pos.x) / res;
-      y = (wp->solid->pos.y - player.p->solid->pos.y) / res;
+      x = (wp->solid.pos.x - player.p->solid->pos.x) / res;
+      y = (wp->solid.pos.y - player.p->solid->pos.y) / res;
 
       /* Make sure in range. */
       if (shape==RADAR_RECT && (ABS(x)>w/2. || ABS(y)>h/2.))
@@ -228,12 +247,12 @@ void weapon_minimap( const double res, const double w,
       wp = wfrontLayer[i];
 
       /* Make sure is in range. */
-      if (!pilot_inRange( player.p, wp->solid->pos.x, wp->solid->pos.y ))
+      if (!pilot_inRange( player.p, wp->solid.pos.x, wp->solid.pos.y ))
          continue;
 
       /* Get radar position. */
-      x = (wp->solid->pos.x - player.p->solid->pos.x) / res;
-      y = (wp->solid->pos.y - player.p->solid->pos.y) / res;
+      x = (wp->solid.pos.x - player.p->solid->pos.x) / res;
+      y = (wp->solid.pos.y - player.p->solid->pos.y) / res;
 
       /* Make sure in range. */
       if (shape==RADAR_RECT && (ABS(x)>w/2. || ABS(y)>h/2.))
@@ -285,7 +304,7 @@ void weapon_minimap( const double res, const double w,
  */
 static void weapon_setThrust( Weapon *w, double thrust )
 {
-   w->solid->thrust = thrust;
+   w->solid.thrust = thrust;
 }
 
 
@@ -294,7 +313,7 @@ static void weapon_setThrust( Weapon *w, double thrust )
  */
 static void weapon_setTurn( Weapon *w, double turn )
 {
-   w->solid->dir_vel = turn;
+   w->solid.dir_vel = turn;
 }
 
 
@@ -335,21 +354,21 @@ static void think_seeker( Weapon* w, const double dt )
          if (w->outfit->u.amm.ai == AMMO_AI_SMART) {
 
             /* Calculate time to reach target. */
-            vect_cset( &v, p->solid->pos.x - w->solid->pos.x,
-                  p->solid->pos.y - w->solid->pos.y );
+            vect_cset( &v, p->solid->pos.x - w->solid.pos.x,
+                  p->solid->pos.y - w->solid.pos.y );
             t = vect_odist( &v ) / w->outfit->u.amm.speed;
 
             /* Calculate target's movement. */
-            vect_cset( &v, v.x + t*(p->solid->vel.x - w->solid->vel.x),
-                  v.y + t*(p->solid->vel.y - w->solid->vel.y) );
+            vect_cset( &v, v.x + t*(p->solid->vel.x - w->solid.vel.x),
+                  v.y + t*(p->solid->vel.y - w->solid.vel.y) );
 
             /* Get the angle now. */
-            diff = angle_diff(w->solid->dir, VANGLE(v) );
+            diff = angle_diff(w->solid.dir, VANGLE(v) );
          }
          /* Other seekers are simplistic. */
          else {
-            diff = angle_diff(w->solid->dir, /* Get angle to target pos */
-                  vect_angle(&w->solid->pos, &p->solid->pos));
+            diff = angle_diff(w->solid.dir, /* Get angle to target pos */
+                  vect_angle(&w->solid.pos, &p->solid->pos));
          }
 
          /* Set turn. */
@@ -369,10 +388,10 @@ static void think_seeker( Weapon* w, const double dt )
 
    /* Limit speed here */
    w->real_vel = MIN( w->outfit->u.amm.speed, w->real_vel + w->outfit->u.amm.thrust*dt );
-   vect_pset( &w->solid->vel, /* ewtrack * */ w->real_vel, w->solid->dir );
+   vect_pset( &w->solid.vel, /* ewtrack * */ w->real_vel, w->solid.dir );
 
    /* Modulate max speed. */
-   //w->solid->speed_max = w->outfit->u.amm.speed * ewtrack;
+   //w->solid.speed_max = w->outfit->u.amm.speed * ewtrack;
 }
 
 
@@ -409,17 +428,17 @@ static void think_beam( Weapon* w, const double dt )
 
    /* Use mount position. */
    pilot_getMount( p, w->mount, &v );
-   w->solid->pos.x = p->solid->pos.x + v.x;
-   w->solid->pos.y = p->solid->pos.y + v.y;
+   w->solid.pos.x = p->solid->pos.x + v.x;
+   w->solid.pos.y = p->solid->pos.y + v.y;
 
    /* Handle aiming at the target. */
    t = (w->target != w->parent) ? pilot_get(w->target) : NULL;
    switch (w->outfit->type) {
       case OUTFIT_TYPE_BEAM:
          if (w->outfit->u.bem.swivel > 0.)
-            w->solid->dir = weapon_aimTurret( w->outfit, p, t, &w->solid->pos, &p->solid->vel, p->solid->dir, w->outfit->u.bem.swivel, 0. );
+            w->solid.dir = weapon_aimTurret( w->outfit, p, t, &w->solid.pos, &p->solid->vel, p->solid->dir, w->outfit->u.bem.swivel, 0. );
          else
-            w->solid->dir = p->solid->dir;
+            w->solid.dir = p->solid->dir;
          break;
 
       case OUTFIT_TYPE_TURRET_BEAM:
@@ -432,15 +451,15 @@ static void think_beam( Weapon* w, const double dt )
                field = &cur_system->asteroids[p->nav_anchor];
                ast = &field->asteroids[p->nav_asteroid];
 
-               diff = angle_diff(w->solid->dir, /* Get angle to target pos */
-                     vect_angle(&w->solid->pos, &ast->pos));
+               diff = angle_diff(w->solid.dir, /* Get angle to target pos */
+                     vect_angle(&w->solid.pos, &ast->pos));
             }
             else
-               diff = angle_diff(w->solid->dir, p->solid->dir);
+               diff = angle_diff(w->solid.dir, p->solid->dir);
          }
          else
-            diff = angle_diff(w->solid->dir, /* Get angle to target pos */
-                  vect_angle(&w->solid->pos, &t->solid->pos));
+            diff = angle_diff(w->solid.dir, /* Get angle to target pos */
+                  vect_angle(&w->solid.pos, &t->solid->pos));
 
          weapon_setTurn( w, CLAMP( -w->outfit->u.bem.turn, w->outfit->u.bem.turn,
                   10 * diff *  w->outfit->u.bem.turn ));
@@ -459,8 +478,13 @@ static void think_beam( Weapon* w, const double dt )
  */
 void weapons_update( const double dt )
 {
+   /* Weapons destroyed while updating stay in place until the end, so no weapon gets skipped. */
+   weapon_updating = 1;
    weapons_updateLayer(dt,WEAPON_LAYER_BG);
    weapons_updateLayer(dt,WEAPON_LAYER_FG);
+   weapon_updating = 0;
+   weapons_purge(WEAPON_LAYER_BG);
+   weapons_purge(WEAPON_LAYER_FG);
 }
 
 
@@ -493,10 +517,14 @@ static void weapons_updateLayer( const double dt, const WeaponLayer layer )
          return;
    }
 
-   i = 0;
-   while (i < array_size(wlayer)) {
+   profile_begin( PROFILE_WEAPON_LAYER );
+   for (i=0; i<array_size(wlayer); i++) {
       w = wlayer[i];
 
+      /* Destroyed earlier during this update. */
+      if (w->dead)
+         continue;
+
       switch (w->outfit->type) {
 
          /* most missiles behave the same */
@@ -513,17 +541,17 @@ static void weapons_updateLayer( const double dt, const WeaponLayer layer )
                   spfx = outfit_spfxShield(w->outfit);
                /* Add death sprite if needed. */
                if (spfx != -1) {
-                  spfx_add( spfx, w->solid->pos.x, w->solid->pos.y,
-                        w->solid->vel.x, w->solid->vel.y,
+                  spfx_add( spfx, w->solid.pos.x, w->solid.pos.y,
+                        w->solid.vel.x, w->solid.vel.y,
                         SPFX_LAYER_MIDDLE ); /* presume middle. */
                   /* Add sound if explodes and has it. */
                   s = outfit_soundHit(w->outfit);
                   if (s != -1)
                      w->voice = sound_playPos(s,
-                           w->solid->pos.x,
-                           w->solid->pos.y,
-                           w->solid->vel.x,
-                           w->solid->vel.y);
+                           w->solid.pos.x,
+                           w->solid.pos.y,
+                           w->solid.vel.x,
+                           w->solid.vel.y);
                }
                weapon_destroy(w,layer);
                break;
@@ -543,17 +571,17 @@ static void weapons_updateLayer( const double dt, const WeaponLayer layer )
                   spfx = outfit_spfxShield(w->outfit);
                /* Add death sprite if needed. */
                if (spfx != -1) {
-                  spfx_add( spfx, w->solid->pos.x, w->solid->pos.y,
-                        w->solid->vel.x, w->solid->vel.y,
+                  spfx_add( spfx, w->solid.pos.x, w->solid.pos.y,
+                        w->solid.vel.x, w->solid.vel.y,
                         SPFX_LAYER_MIDDLE ); /* presume middle. */
                   /* Add sound if explodes and has it. */
                   s = outfit_soundHit(w->outfit);
                   if (s != -1)
                      w->voice = sound_playPos(s,
-                           w->solid->pos.x,
-                           w->solid->pos.y,
-                           w->solid->vel.x,
-                           w->solid->vel.y);
+                           w->solid.pos.x,
+                           w->solid.pos.y,
+                           w->solid.vel.x,
+                           w->solid.vel.y);
                }
                weapon_destroy(w,layer);
                break;
@@ -589,17 +617,13 @@ static void weapons_updateLayer( const double dt, const WeaponLayer layer )
             break;
       }
 
-      /* Out of bounds, loop is over. */
-      if (i >= array_size(wlayer))
-         break;
+      /* Only update if weapon wasn't destroyed. */
+      if (w->dead)
+         continue;
 
-      /* Only increment if weapon wasn't deleted. */
-      if (w == wlayer[i]) {
-         weapon_update(w,dt,layer);
-         if ((i < array_size(wlayer)) && (w == wlayer[i]))
-            i++;
-      }
+      weapon_update(w,dt,layer);
    }
+   profile_end( PROFILE_WEAPON_LAYER );
 }
 
 
@@ -627,8 +651,10 @@ void weapons_render( const WeaponLayer layer, const double dt )
          return;
    }
 
+   gl_batchBegin();
    for (i=0; i<array_size(wlayer); i++)
       weapon_render( wlayer[i], dt );
+   gl_batchEnd();
 }
 
 
@@ -639,6 +665,9 @@ static void weapon_renderBeam( Weapon* w, const double dt ) {
    /* Animation. */
    w->anim += dt;
 
+   /* Draw pending sprites first. */
+   gl_batchFlush();
+
    /* Load GLSL program */
    glUseProgram(shaders.beam.program);
 
@@ -646,10 +675,10 @@ static void weapon_renderBeam( Weapon* w, const double dt ) {
    z = cam_getZoom();
 
    /* Position. */
-   gl_gameToScreenCoords( &x, &y, w->solid->pos.x, w->solid->pos.y );
+   gl_gameToScreenCoords( &x, &y, w->solid.pos.x, w->solid.pos.y );
 
    projection = gl_Matrix4_Translate( gl_view_matrix, x, y, 0. );
-   projection = gl_Matrix4_Rotate2d( projection, w->solid->dir );
+   projection = gl_Matrix4_Rotate2d( projection, w->solid.dir );
    projection = gl_Matrix4_Scale( projection, w->outfit->u.bem.range*z,w->outfit->u.bem.width * z, 1 );
    projection = gl_Matrix4_Translate( projection, 0., -0.5, 0. );
 
@@ -719,10 +748,10 @@ static void weapon_render( Weapon* w, const double dt )
             if (outfit_isBolt(w->outfit) && w->outfit->u.blt.gfx_end)
                gl_blitSpriteInterpolate( gfx, w->outfit->u.blt.gfx_end,
                      w->timer / w->life,
-                     w->solid->pos.x, w->solid->pos.y,
+                     w->solid.pos.x, w->solid.pos.y,
                      w->sprite % (int)gfx->sx, w->sprite / (int)gfx->sx, &c );
             else
-               gl_blitSprite( gfx, w->solid->pos.x, w->solid->pos.y,
+               gl_blitSprite( gfx, w->solid.pos.x, w->solid.pos.y,
                      w->sprite % (int)gfx->sx, w->sprite / (int)gfx->sx, &c );
          }
          /* Outfit faces direction. */
@@ -730,9 +759,9 @@ static void weapon_render( Weapon* w, const double dt )
             if (outfit_isBolt(w->outfit) && w->outfit->u.blt.gfx_end)
                gl_blitSpriteInterpolate( gfx, w->outfit->u.blt.gfx_end,
                      w->timer / w->life,
-                     w->solid->pos.x, w->solid->pos.y, w->sx, w->sy, &c );
+                     w->solid.pos.x, w->solid.pos.y, w->sx, w->sy, &c );
             else
-               gl_blitSprite( gfx, w->solid->pos.x, w->solid->pos.y, w->sx, w->sy, &c );
+               gl_blitSprite( gfx, w->solid.pos.x, w->solid.pos.y, w->sx, w->sy, &c );
          }
          break;
 
@@ -839,16 +868,17 @@ static void weapon_update( Weapon* w, const double dt, WeaponLayer layer )
    Asteroid *a;
    AsteroidType *at;
    Pilot *const* pilot_stack;
+   double r, x1, y1, x2, y2;
+   Uint64 t0;
 
    gfx = NULL;
    polygon = NULL;
-   pilot_stack = pilot_getAll();
 
    /* Get the sprite direction to speed up calculations. */
    b     = outfit_isBeam(w->outfit);
    if (!b) {
       gfx = outfit_gfx(w->outfit);
-      gl_getSpriteFromDir( &w->sx, &w->sy, gfx, w->solid->dir );
+      gl_getSpriteFromDir( &w->sx, &w->sy, gfx, w->solid.dir );
       n = gfx->sx * w->sy + w->sx;
       plg = outfit_plg(w->outfit);
       polygon = &plg[n];
@@ -862,6 +892,13 @@ static void weapon_update( Weapon* w, const double dt, WeaponLayer layer )
          if (array_size(w->outfit->u.amm.polygon) == 0)
             usePoly = 0;
       }
+
+      /* Box swept by the sprite during this frame. */
+      r  = MAX( gfx->sw, gfx->sh ) / 2.;
+      x1 = MIN( w->solid.pos.x, w->solid.pos.x - w->solid.vel.x*dt ) - r;
+      y1 = MIN( w->solid.pos.y, w->solid.pos.y - w->solid.vel.y*dt ) - r;
+      x2 = MAX( w->solid.pos.x, w->solid.pos.x - w->solid.vel.x*dt ) + r;
+      y2 = MAX( w->solid.pos.y, w->solid.pos.y - w->solid.vel.y*dt ) + r;
    }
    else {
       p = pilot_get( w->parent );
@@ -877,15 +914,32 @@ static void weapon_update( Weapon* w, const double dt, WeaponLayer layer )
          }
          w->dam_as_dis_mod = CLAMP( 0., 1., w->dam_as_dis_mod );
       }
+
+      /* Box containing the beam. */
+      x1 = w->solid.pos.x + w->outfit->u.bem.range * cos(w->solid.dir);
+      y1 = w->solid.pos.y + w->outfit->u.bem.range * sin(w->solid.dir);
+      x2 = MAX( x1, w->solid.pos.x );
+      y2 = MAX( y1, w->solid.pos.y );
+      x1 = MIN( x1, w->solid.pos.x );
+      y1 = MIN( y1, w->solid.pos.y );
    }
 
-   for (i=0; i<array_size(pilot_stack); i++) {
+   /* Only look at the pilots near the weapon. */
+   t0 = profile_counter();
+   pilot_gridQuery( &weapon_candidates, x1, y1, x2, y2 );
+
+   for (j=0; j<array_size(weapon_candidates); j++) {
+      /* Hits can run hooks that modify the stack, so always refetch it. */
+      pilot_stack = pilot_getAll();
+      i = weapon_candidates[j];
+      if (i >= array_size(pilot_stack))
+         break;
       p = pilot_stack[i];
 
-      psx = pilot_stack[i]->tsx;
-      psy = pilot_stack[i]->tsy;
+      psx = p->tsx;
+      psy = p->tsy;
 
-      if (w->parent == pilot_stack[i]->id) continue; /* pilot is self */
+      if (w->parent == p->id) continue; /* pilot is self */
 
       /* See if the ship has a collision polygon. */
       if (array_size(p->ship->polygon) == 0)
@@ -897,12 +951,12 @@ static void weapon_update( Weapon* w, const double dt, WeaponLayer layer )
          if (weapon_checkCanHit(w,p)) {
             if (usePoly) {
                k = p->ship->gfx_space->sx * psy + psx;
-               coll = CollideLinePolygon( &w->solid->pos, w->solid->dir,
+               coll = CollideLinePolygon( &w->solid.pos, w->solid.dir,
                      w->outfit->u.bem.range, &p->ship->polygon[k],
                      &p->solid->pos, crash);
             }
             else {
-               coll = CollideLineSprite( &w->solid->pos, w->solid->dir,
+               coll = CollideLineSprite( &w->solid.pos, w->solid.dir,
                      w->outfit->u.bem.range, p->ship->gfx_space, psx, psy,
                      &p->solid->pos, crash);
             }
@@ -915,21 +969,22 @@ static void weapon_update( Weapon* w, const double dt, WeaponLayer layer )
       /* smart weapons only collide with their target */
       else if (weapon_isSmart(w)) {
 
-         if ( (pilot_stack[i]->id == w->target) &&
+         if ( (p->id == w->target) &&
                (w->status == WEAPON_STATUS_OK) &&
                weapon_checkCanHit(w,p) ) {
             if (usePoly) {
                k = p->ship->gfx_space->sx * psy + psx;
                coll = CollidePolygon( &p->ship->polygon[k], &p->solid->pos,
-                        polygon, &w->solid->pos, &crash[0] );
+                        polygon, &w->solid.pos, &crash[0] );
             }
             else {
-               coll = CollideSprite( gfx, w->sx, w->sy, &w->solid->pos,
+               coll = CollideSprite( gfx, w->sx, w->sy, &w->solid.pos,
                         p->ship->gfx_space, psx, psy,
                         &p->solid->pos, &crash[0] );
             }
             if (coll) {
                weapon_hit( w, p, layer, &crash[0] );
+               profile_accumulate( PROFILE_COLLISION, t0 );
                return; /* Weapon is destroyed. */
             }
          }
@@ -940,84 +995,62 @@ static void weapon_update( Weapon* w, const double dt, WeaponLayer layer )
             if (usePoly) {
                k = p->ship->gfx_space->sx * psy + psx;
                coll = CollidePolygon( &p->ship->polygon[k], &p->solid->pos,
-                        polygon, &w->solid->pos, &crash[0] );
+                        polygon, &w->solid.pos, &crash[0] );
             }
             else {
-               coll = CollideSprite( gfx, w->sx, w->sy, &w->solid->pos,
+               coll = CollideSprite( gfx, w->sx, w->sy, &w->solid.pos,
                         p->ship->gfx_space, psx, psy,
                         &p->solid->pos, &crash[0] );
             }
 
             if (coll) {
             weapon_hit( w, p, layer, &crash[0] );
+            profile_accumulate( PROFILE_COLLISION, t0 );
             return; /* Weapon is destroyed. */
             }
          }
       }
    }
 
-   /* Collide with asteroids*/
-   if (outfit_isAmmo(w->outfit)) {
-      for (i=0; i<array_size(cur_system->asteroids); i++) {
-         ast = &cur_system->asteroids[i];
-         for (j=0; j<ast->nb; j++) {
-            a = &ast->asteroids[j];
-            at = space_getType ( a->type );
-            if ( ((a->appearing == ASTEROID_VISIBLE)||(a->appearing == ASTEROID_EXPLODING)) &&
-                  CollideSprite( gfx, w->sx, w->sy, &w->solid->pos,
-                        at->gfxs[a->gfxID], 0, 0, &a->pos,
-                        &crash[0] ) ) {
-               weapon_hitAst( w, a, layer, &crash[0] );
-               return; /* Weapon is destroyed. */
-            }
-         }
-      }
-   }
-   else if (outfit_isBolt(w->outfit)) {
-      for (i=0; i<array_size(cur_system->asteroids); i++) {
-         ast = &cur_system->asteroids[i];
-         for (j=0; j<ast->nb; j++) {
-            a = &ast->asteroids[j];
-            at = space_getType ( a->type );
-            if ( ((a->appearing == ASTEROID_VISIBLE)||(a->appearing == ASTEROID_EXPLODING)) &&
-                  CollideSprite( gfx, w->sx, w->sy, &w->solid->pos,
-                        at->gfxs[a->gfxID], 0, 0, &a->pos,
-                        &crash[0] ) ) {
-               weapon_hitAst( w, a, layer, &crash[0] );
-               return; /* Weapon is destroyed. */
-            }
-         }
-      }
-   }
-   else if (b) { /* Beam */
-      for (i=0; i<array_size(cur_system->asteroids); i++) {
-         ast = &cur_system->asteroids[i];
-         for (j=0; j<ast->nb; j++) {
-            a = &ast->asteroids[j];
-            at = space_getType ( a->type );
-            if ( ((a->appearing == ASTEROID_VISIBLE)||(a->appearing == ASTEROID_EXPLODING)) &&
-                  CollideLineSprite( &w->solid->pos, w->solid->dir,
-                        w->outfit->u.bem.range,
-                        at->gfxs[a->gfxID], 0, 0, &a->pos,
-                        crash ) ) {
+   /* Collide with asteroids, only looking at the ones near the weapon. */
+   for (i=0; i<array_size(cur_system->asteroids); i++) {
+      ast = &cur_system->asteroids[i];
+      asteroid_gridQuery( ast, &weapon_candidates, x1, y1, x2, y2 );
+      for (k=0; k<array_size(weapon_candidates); k++) {
+         a = &ast->asteroids[ weapon_candidates[k] ];
+         if ((a->appearing != ASTEROID_VISIBLE) && (a->appearing != ASTEROID_EXPLODING))
+            continue;
+         at = space_getType ( a->type );
+         if (b) { /* Beam */
+            if (CollideLineSprite( &w->solid.pos, w->solid.dir,
+                     w->outfit->u.bem.range,
+                     at->gfxs[a->gfxID], 0, 0, &a->pos,
+                     crash ))
                weapon_hitAstBeam( w, a, layer, crash, dt );
                /* No return because beam can still think, it's not
                 * destroyed like the other weapons.*/
-            }
+         }
+         else if (CollideSprite( gfx, w->sx, w->sy, &w->solid.pos,
+                  at->gfxs[a->gfxID], 0, 0, &a->pos,
+                  &crash[0] )) {
+            weapon_hitAst( w, a, layer, &crash[0] );
+            profile_accumulate( PROFILE_COLLISION, t0 );
+            return; /* Weapon is destroyed. */
          }
       }
    }
+   profile_accumulate( PROFILE_COLLISION, t0 );
 
    /* smart weapons also get to think their next move */
    if (weapon_isSmart(w))
       (*w->think)(w,dt);
 
    /* Update the solid position. */
-   (*w->solid->update)(w->solid, dt);
+   (*w->solid.update)(&w->solid, dt);
 
    /* Update the sound. */
-   sound_updatePos(w->voice, w->solid->pos.x, w->solid->pos.y,
-         w->solid->vel.x, w->solid->vel.y);
+   sound_updatePos(w->voice, w->solid.pos.x, w->solid.pos.y,
+         w->solid.vel.x, w->solid.vel.y);
 
    /* Update the trail. */
    if (w->trail != NULL)
@@ -1034,19 +1067,19 @@ static void weapon_sample_trail( Weapon* w )
    TrailMode mode;
 
    /* Compute the engine offset. */
-   a  = w->solid->dir;
+   a  = w->solid.dir;
    dx = w->outfit->u.amm.trail_x_offset * cos(a);
    dy = w->outfit->u.amm.trail_x_offset * sin(a);
 
    /* Set the colour. */
-   if (w->solid->thrust > 0)
+   if (w->solid.thrust > 0)
       mode = MODE_AFTERBURN;
-   else if (w->solid->dir_vel != 0.)
+   else if (w->solid.dir_vel != 0.)
       mode = MODE_GLOW;
    else
       mode = MODE_IDLE;
 
-   spfx_trail_sample( w->trail, w->solid->pos.x + dx, w->solid->pos.y + dy*M_SQRT1_2, mode, 0 );
+   spfx_trail_sample( w->trail, w->solid.pos.x + dx, w->solid.pos.y + dy*M_SQRT1_2, mode, 0 );
 }
 
 
@@ -1144,13 +1177,13 @@ static void weapon_hit( Weapon* w, Pilot* p, WeaponLayer layer, Vector2d* pos )
    s = outfit_soundHit(w->outfit);
    if (s != -1)
       w->voice = sound_playPos( s,
-            w->solid->pos.x,
-            w->solid->pos.y,
-            w->solid->vel.x,
-            w->solid->vel.y);
+            w->solid.pos.x,
+            w->solid.pos.y,
+            w->solid.vel.x,
+            w->solid.vel.y);
 
    /* Have pilot take damage and get real damage done. */
-   damage = pilot_hit( p, w->solid, w->parent, &dmg, 1 );
+   damage = pilot_hit( p, &w->solid, w->parent, &dmg, 1 );
 
    /* Get the layer. */
    spfx_layer = (p==player.p) ? SPFX_LAYER_FRONT : SPFX_LAYER_MIDDLE;
@@ -1195,10 +1228,10 @@ static void weapon_hitAst( Weapon* w, Asteroid* a, WeaponLayer layer, Vector2d*
    s = outfit_soundHit(w->outfit);
    if (s != -1)
       w->voice = sound_playPos( s,
-            w->solid->pos.x,
-            w->solid->pos.y,
-            w->solid->vel.x,
-            w->solid->vel.y);
+            w->solid.pos.x,
+            w->solid.pos.y,
+            w->solid.vel.x,
+            w->solid.vel.y);
 
    /* Add the spfx */
    spfx = outfit_spfxArmour(w->outfit);
@@ -1241,7 +1274,7 @@ static void weapon_hitBeam( Weapon* w, Pilot* p, WeaponLayer layer,
    dmg.disable       = MAX( 0., w->dam_mod * w->strength * odmg->disable * dt + damage * w->dam_as_dis_mod );
 
    /* Have pilot take damage and get real damage done. */
-   damage = pilot_hit( p, w->solid, w->parent, &dmg, 1 );
+   damage = pilot_hit( p, &w->solid, w->parent, &dmg, 1 );
 
    /* Add sprite, layer depends on whether player shot or not. */
    if (w->exp_timer == -1.) {
@@ -1450,16 +1483,16 @@ static void weapon_createBolt( Weapon *w, const Outfit* outfit, double T,
    vect_cadd( &v, outfit->u.blt.speed*cos(rdir), outfit->u.blt.speed*sin(rdir));
    w->timer = outfit->u.blt.range / outfit->u.blt.speed;
    w->falloff = w->timer - outfit->u.blt.falloff / outfit->u.blt.speed;
-   w->solid = solid_create( mass, rdir, pos, &v, SOLID_UPDATE_EULER );
+   solid_init( &w->solid, mass, rdir, pos, &v, SOLID_UPDATE_EULER );
    w->voice = sound_playPos( w->outfit->u.blt.sound,
-         w->solid->pos.x,
-         w->solid->pos.y,
-         w->solid->vel.x,
-         w->solid->vel.y);
+         w->solid.pos.x,
+         w->solid.pos.y,
+         w->solid.vel.x,
+         w->solid.vel.y);
 
    /* Set facing direction. */
    gfx = outfit_gfx( w->outfit );
-   gl_getSpriteFromDir( &w->sx, &w->sy, gfx, w->solid->dir );
+   gl_getSpriteFromDir( &w->sx, &w->sy, gfx, w->solid.dir );
 }
 
 
@@ -1521,10 +1554,10 @@ static void weapon_createAmmo( Weapon *w, const Outfit* launcher, double T,
    /* Set up ammo details. */
    mass        = w->outfit->mass;
    w->timer    = ammo->u.amm.duration * parent->stats.launch_range;
-   w->solid    = solid_create( mass, rdir, pos, &v, SOLID_UPDATE_RK4 );
+   solid_init( &w->solid, mass, rdir, pos, &v, SOLID_UPDATE_RK4 );
    if (w->outfit->u.amm.thrust != 0.) {
       weapon_setThrust( w, w->outfit->u.amm.thrust * mass );
-      w->solid->speed_max = w->outfit->u.amm.speed; /* Limit speed, we only care if it has thrust. */
+      w->solid.speed_max = w->outfit->u.amm.speed; /* Limit speed, we only care if it has thrust. */
    }
 
    /* Handle seekers. */
@@ -1540,14 +1573,14 @@ static void weapon_createAmmo( Weapon *w, const Outfit* launcher, double T,
 
    /* Play sound. */
    w->voice    = sound_playPos(w->outfit->u.amm.sound,
-         w->solid->pos.x,
-         w->solid->pos.y,
-         w->solid->vel.x,
-         w->solid->vel.y);
+         w->solid.pos.x,
+         w->solid.pos.y,
+         w->solid.vel.x,
+         w->solid.vel.y);
 
    /* Set facing direction. */
    gfx = outfit_gfx( w->outfit );
-   gl_getSpriteFromDir( &w->sx, &w->sy, gfx, w->solid->dir );
+   gl_getSpriteFromDir( &w->sx, &w->sy, gfx, w->solid.dir );
 
    /* Set up trails. */
    if (ammo->u.amm.trail_spec != NULL)
@@ -1580,7 +1613,7 @@ static Weapon* weapon_create( const Outfit* outfit, double T,
    Weapon* w;
 
    /* Create basic features */
-   w           = calloc( 1, sizeof(Weapon) );
+   w           = weapon_alloc();
    w->dam_mod  = 1.; /* Default of 100% damage. */
    w->dam_as_dis_mod = 0.; /* Default of 0% damage to disable. */
    w->faction  = parent->faction; /* non-changeable */
@@ -1628,14 +1661,14 @@ static Weapon* weapon_create( const Outfit* outfit, double T,
             rdir -= 2.*M_PI;
          mass = 1.; /**< Needs a mass. */
          w->r     = RNGF(); /* Set unique value. */
-         w->solid = solid_create( mass, rdir, pos, vel, SOLID_UPDATE_EULER );
+         solid_init( &w->solid, mass, rdir, pos, vel, SOLID_UPDATE_EULER );
          w->think = think_beam;
          w->timer = outfit->u.bem.duration;
          w->voice = sound_playPos( w->outfit->u.bem.sound,
-               w->solid->pos.x,
-               w->solid->pos.y,
-               w->solid->vel.x,
-               w->solid->vel.y);
+               w->solid.pos.x,
+               w->solid.pos.y,
+               w->solid.vel.x,
+               w->solid.vel.y);
 
          if (outfit->type == OUTFIT_TYPE_BEAM) {
             w->dam_mod       *= parent->stats.fwd_damage;
@@ -1659,7 +1692,7 @@ static Weapon* weapon_create( const Outfit* outfit, double T,
       default:
          WARN(_("Weapon of type '%s' has no create implemented yet!"),
                w->outfit->name);
-         w->solid = solid_create( 1., dir, pos, vel, SOLID_UPDATE_EULER );
+         solid_init( &w->solid, 1., dir, pos, vel, SOLID_UPDATE_EULER );
          break;
    }
 
@@ -1687,7 +1720,7 @@ void weapon_add( const Outfit* outfit, const double T, const double dir,
       const Pilot *parent, unsigned int target, double time )
 {
    WeaponLayer layer;
-   Weapon *w, **m;
+   Weapon *w;
    GLsizei size;
    size_t bufsize;
 
@@ -1699,21 +1732,7 @@ void weapon_add( const Outfit* outfit, const double T, const double dir,
 
    layer = (parent->id==PLAYER_ID) ? WEAPON_LAYER_FG : WEAPON_LAYER_BG;
    w     = weapon_create( outfit, T, dir, pos, vel, parent, target, time );
-
-   /* set the proper layer */
-   switch (layer) {
-      case WEAPON_LAYER_BG:
-         m = &array_grow(&wbackLayer);
-         break;
-      case WEAPON_LAYER_FG:
-         m = &array_grow(&wfrontLayer);
-         break;
-
-      default:
-         WARN(_("Unknown weapon layer!"));
-         return;
-   }
-   *m = w;
+   weapon_insert( w, layer );
 
    /* Grow the vertex stuff if needed. */
    bufsize = array_reserved(wfrontLayer) + array_reserved(wbackLayer);
@@ -1748,7 +1767,7 @@ unsigned int beam_start( const Outfit* outfit,
       PilotOutfitSlot *mount )
 {
    WeaponLayer layer;
-   Weapon *w, **m;
+   Weapon *w;
    GLsizei size;
    size_t bufsize;
 
@@ -1762,21 +1781,7 @@ unsigned int beam_start( const Outfit* outfit,
    w->ID = ++beam_idgen;
    w->mount = mount;
    w->exp_timer = 0.;
-
-   /* set the proper layer */
-   switch (layer) {
-      case WEAPON_LAYER_BG:
-         m = &array_grow(&wbackLayer);
-         break;
-      case WEAPON_LAYER_FG:
-         m = &array_grow(&wfrontLayer);
-         break;
-
-      default:
-         ERR(_("Invalid WEAPON_LAYER specified"));
-         return -1;
-   }
-   *m = w;
+   weapon_insert( w, layer );
 
    /* Grow the vertex stuff if needed. */
    bufsize = array_reserved(wfrontLayer) + array_reserved(wbackLayer);
@@ -1824,7 +1829,7 @@ void beam_end( const unsigned int parent, unsigned int beam )
 
    /* Now try to destroy the beam. */
    for (i=0; i<array_size(curLayer); i++) {
-      if (curLayer[i]->ID == beam) { /* Found it. */
+      if ((curLayer[i]->ID == beam) && !curLayer[i]->dead) { /* Found it. */
          weapon_destroy(curLayer[i], layer);
          break;
       }
@@ -1833,37 +1838,147 @@ void beam_end( const unsigned int parent, unsigned int beam )
 
 
 /**
- * @brief Destroys a weapon.
+ * @brief Gets the weapons of a layer.
  *
- *    @param w Weapon to destroy.
- *    @param layer Layer to which the weapon belongs.
+ *    @param layer Layer to get.
+ *    @return Array (array.h): Weapons of the layer, NULL if invalid.
  */
-static void weapon_destroy( Weapon* w, WeaponLayer layer )
+static Weapon** weapon_layer( WeaponLayer layer )
+{
+   switch (layer) {
+      case WEAPON_LAYER_BG:
+         return wbackLayer;
+      case WEAPON_LAYER_FG:
+         return wfrontLayer;
+
+      default:
+         WARN(_("Unknown weapon layer!"));
+         return NULL;
+   }
+}
+
+
+/**
+ * @brief Gets a cleared weapon from the pool.
+ *
+ * Weapons are allocated WEAPON_CHUNK at a time so they are contiguous in
+ *  memory and never move, and reused instead of freed.
+ *
+ *    @return A zeroed weapon.
+ */
+static Weapon* weapon_alloc (void)
 {
    int i;
-   Weapon** wlayer;
+   Weapon *chunk, *w;
+
+   if (array_size(weapon_pool) == 0) {
+      chunk = malloc( WEAPON_CHUNK * sizeof(Weapon) );
+      if (chunk == NULL)
+         ERR(_("Out of Memory"));
+      array_push_back( &weapon_chunks, chunk );
+      /* Reversed so the chunk gets used in order. */
+      for (i=WEAPON_CHUNK-1; i>=0; i--)
+         array_push_back( &weapon_pool, &chunk[i] );
+   }
+
+   w = array_back( weapon_pool );
+   array_erase( &weapon_pool, array_end(weapon_pool)-1, array_end(weapon_pool) );
+   memset( w, 0, sizeof(Weapon) );
+   return w;
+}
 
+
+/**
+ * @brief Adds a weapon to a layer.
+ *
+ *    @param w Weapon to add.
+ *    @param layer Layer to add it to.
+ */
+static void weapon_insert( Weapon *w, WeaponLayer layer )
+{
    switch (layer) {
       case WEAPON_LAYER_BG:
-         wlayer = wbackLayer;
+         w->lidx = array_size(wbackLayer);
+         array_push_back( &wbackLayer, w );
          break;
       case WEAPON_LAYER_FG:
-         wlayer = wfrontLayer;
+         w->lidx = array_size(wfrontLayer);
+         array_push_back( &wfrontLayer, w );
          break;
 
       default:
          WARN(_("Unknown weapon layer!"));
-         return;
+         break;
    }
+}
+
+
+/**
+ * @brief Destroys a weapon.
+ *
+ *    @param w Weapon to destroy.
+ *    @param layer Layer to which the weapon belongs.
+ */
+static void weapon_destroy( Weapon* w, WeaponLayer layer )
+{
+   int i, n;
+   Weapon **wlayer;
+
+   /* Already destroyed, e.g., by an explosion while hitting. */
+   if (w->dead)
+      return;
 
-   for (i=0; (wlayer[i] != w) && (i < array_size(wlayer)); i++); /* get to the current position */
-   if (i >= array_size(wlayer)) {
+   /* Removing would move weapons that are still to be updated. */
+   if (weapon_updating) {
+      w->dead = 1;
+      return;
+   }
+
+   wlayer = weapon_layer( layer );
+   if (wlayer == NULL)
+      return;
+
+   i = w->lidx;
+   n = array_size(wlayer);
+   if ((i < 0) || (i >= n) || (wlayer[i] != w)) {
       WARN(_("Trying to destroy weapon not found in stack!"));
       return;
    }
 
-   weapon_free(wlayer[i]);
-   array_erase( &wlayer, &wlayer[i], &wlayer[i+1] );
+   /* Swap with the last weapon, order doesn't matter. */
+   wlayer[i]         = wlayer[n-1];
+   wlayer[i]->lidx   = i;
+   array_erase( &wlayer, &wlayer[n-1], array_end(wlayer) );
+   weapon_free( w );
+}
+
+
+/**
+ * @brief Removes the weapons destroyed while updating from a layer.
+ *
+ * Keeps the order of the remaining weapons.
+ *
+ *    @param layer Layer to purge.
+ */
+static void weapons_purge( WeaponLayer layer )
+{
+   int i, n;
+   Weapon **wlayer;
+
+   wlayer = weapon_layer( layer );
+   if (wlayer == NULL)
+      return;
+
+   n = 0;
+   for (i=0; i<array_size(wlayer); i++) {
+      if (wlayer[i]->dead) {
+         weapon_free( wlayer[i] );
+         continue;
+      }
+      wlayer[i]->lidx = n;
+      wlayer[n++]     = wlayer[i];
+   }
+   array_erase( &wlayer, &wlayer[n], array_end(wlayer) );
 }
 
 
@@ -1889,15 +2004,12 @@ static void weapon_free( Weapon* w )
    if (outfit_isBeam(w->outfit)) {
       sound_stop( w->voice );
       sound_playPos(w->outfit->u.bem.sound_off,
-            w->solid->pos.x,
-            w->solid->pos.y,
-            w->solid->vel.x,
-            w->solid->vel.y);
+            w->solid.pos.x,
+            w->solid.pos.y,
+            w->solid.vel.x,
+            w->solid.vel.y);
    }
 
-   /* Free the solid. */
-   solid_free(w->solid);
-
    /* Free the trail, if any. */
    spfx_trail_remove(w->trail);
 
@@ -1905,7 +2017,9 @@ static void weapon_free( Weapon* w )
    memset(w, 0, sizeof(Weapon));
 #endif /* DEBUGGING */
 
-   free(w);
+   /* Give it back to the pool. */
+   w->lidx = -1;
+   array_push_back( &weapon_pool, w );
 }
 
 /**
@@ -1932,6 +2046,8 @@ void weapon_clear (void)
  */
 void weapon_exit (void)
 {
+   int i;
+
    weapon_clear();
 
    /* Destroy front layer. */
@@ -1940,6 +2056,18 @@ void weapon_exit (void)
    /* Destroy back layer. */
    array_free(wfrontLayer);
 
+   /* Destroy collision candidates. */
+   array_free(weapon_candidates);
+   weapon_candidates = NULL;
+
+   /* Destroy storage. */
+   for (i=0; i<array_size(weapon_chunks); i++)
+      free( weapon_chunks[i] );
+   array_free( weapon_chunks );
+   weapon_chunks = NULL;
+   array_free( weapon_pool );
+   weapon_pool = NULL;
+
    /* Destroy VBO. */
    free( weapon_vboData );
    weapon_vboData = NULL;
@@ -1962,6 +2090,17 @@ void weapon_explode( double x, double y, double radius,
 }
 
 
+/**
+ * @brief Gets the number of weapons in flight.
+ *
+ *    @return Number of weapons on all layers.
+ */
+int weapon_count (void)
+{
+   return array_size(wbackLayer) + array_size(wfrontLayer);
+}
+
+
 /**
  * @brief Explodes all the things on a layer.
  */
@@ -1992,11 +2131,13 @@ static void weapon_explodeLayer( WeaponLayer layer,
 
    /* Now try to destroy the weapons affected. */
    for (i=0; i<array_size(curLayer); i++) {
+      if (curLayer[i]->dead)
+         continue;
       if (((mode & EXPL_MODE_MISSILE) && outfit_isAmmo(curLayer[i]->outfit)) ||
             ((mode & EXPL_MODE_BOLT) && outfit_isBolt(curLayer[i]->outfit))) {
 
-         dist = pow2(curLayer[i]->solid->pos.x - x) +
-               pow2(curLayer[i]->solid->pos.y - y);
+         dist = pow2(curLayer[i]->solid.pos.x - x) +
+               pow2(curLayer[i]->solid.pos.y - y);
 
          if (dist < rad2) {
             weapon_destroy(curLayer[i], layer);
@@ -42,6 +42,7 @@ void beam_end( const unsigned int parent, unsigned int beam );
 /*
  * Misc stuff.
  */
+int weapon_count (void);
 void weapon_explode( double x, double y, double radius,
       int dtype, double damage,
       const Pilot *parent, int mode );